@@ -16,7 +16,7 @@ export GREP_COLOR='0;32' # green
 WARNINGS="-Wall -Wextra -Werror -Wcast-qual -Wdisabled-optimization -Wshadow \
 	-Wwrite-strings -Wundef -Wendif-labels -Wstrict-overflow=1 -Wunused-parameter"
 
-# Test gcc with both -std=c++98 and -std=c++14.  Not using -pedantic-errors with
+# Test gcc with -std=c++98, -std=c++14 and -std=c++20 (for coroutines.)  Not using -pedantic-errors with
 # c++98 as "anonymous variadic macros were introduced in c++11."  (This code base
 # and gcc's defaults cheat slightly by pretending c99 was available in c++98.)
 # -Wno-unused-local-typedefs is only for the c++98 version of static_assert. 
@@ -33,8 +33,26 @@ echo gcc c++14 -O$I "$@"
 gcc -Iinclude -O$I -pedantic-errors $WARNINGS -DHX_RELEASE=$I "$@" -pthread \
 	-std=c++14 -fno-exceptions -fno-rtti */*.cpp *.o -lpthread -lstdc++ -o hxtest
 ./hxtest | grep '\[  PASSED  \]' --color || ./hxtest
+rm hxtest
+echo gcc c++20 -O$I "$@"
+gcc -Iinclude -O$I -pedantic-errors $WARNINGS -DHX_RELEASE=$I "$@" -pthread \
+	-std=c++20 -fno-exceptions -fno-rtti */*.cpp *.o -lpthread -lstdc++ -o hxtest
+./hxtest | grep '\[  PASSED  \]' --color || ./hxtest
+rm hxtest *.o
+done
+
+# Test the SSE4.1 versions of hxSortNetwork on x86.
+if [ "$(uname -m)" = "x86_64" ]; then
+for I in 0 3; do
+echo gcc c++20 -O$I -msse4.1 "$@"
+gcc -Iinclude -O$I -Wall -Wextra -Werror -pedantic-errors -DHX_RELEASE=$I -msse4.1 "$@" \
+	-std=c99 -c src/*.c
+gcc -Iinclude -O$I -pedantic-errors $WARNINGS -DHX_RELEASE=$I -msse4.1 "$@" -pthread \
+	-std=c++20 -fno-exceptions -fno-rtti */*.cpp *.o -lpthread -lstdc++ -o hxtest
+./hxtest | grep '\[  PASSED  \]' --color || ./hxtest
 rm hxtest *.o
 done
+fi
 
 # Test undefined behavior/address use with clang.
 clang --version | grep clang
@@ -51,8 +69,11 @@ clang -Iinclude -O$I -pedantic-errors $WARNINGS -DHX_RELEASE=$I \
 rm hxtest *.o
 done
 
-# Remove output.
-rm log.txt profile.json hxConsoleTest_FileTest.txt hxFileTest_Operators.bin \
-	hxFileTest_ReadWrite.txt
+# Remove output.  profile_perf.json is only written where perf events are
+# available.
+rm -f log.txt profile.json hxConsoleTest_FileTest.txt hxFileTest_Operators.bin \
+	hxFileTest_ReadWrite.txt hxBenchmarkTest_Baseline.txt profile_snapshot.json profile_flush.bin \
+	profile.hxpc profile.hxpc.json profile_counters.hxpc profile_counters.json \
+	profile_counters2.json profile_perf.json profile.folded
 
 echo test.sh passed.
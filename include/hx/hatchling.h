@@ -192,4 +192,8 @@ HX_CONSTEXPR_FN const T_& hxClamp(const T_& x_, const T_& minimum_, const T_& ma
 	hxAssert(!(maximum_ < minimum_));
 	return (x_ < minimum_) ? minimum_ : ((maximum_ < x_) ? maximum_ : x_);
 }
+
+// Exchanges the values of x and y using assignment.
+template<typename T_>
+HX_INLINE void hxSwap(T_& x_, T_& y_) { T_ t_(x_); x_ = y_; y_ = t_; }
 #endif
@@ -38,6 +38,11 @@ void hxDmaEndFrame();
 // syncPoint.
 void hxDmaAddSyncPoint(hxDmaSyncPoint& syncPoint_);
 
+// Returns true if all DMA proceeding the corresponding call to
+// hxDmaAddSyncPoint() is completed.  Does not wait.  hxDmaAwaitSyncPoint() is
+// still required to complete the sync point.
+bool hxDmaIsSyncPointComplete(const hxDmaSyncPoint& syncPoint_);
+
 #if HX_PROFILE
 // Initiates a DMA transfer from src to dst of bytes length.  labelStringLiteral,
 // if non-null, is used in profiling and debug diagnostic messages.
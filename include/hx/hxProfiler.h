@@ -3,7 +3,7 @@
 // Copyright 2017 Leap Motion
 
 #include <hx/hatchling.h>
-#include <hx/hxStockpile.h>
+#include <hx/hxAllocator.h>
 #include <hx/hxTime.h>
 
 #if HX_PROFILE
@@ -17,28 +17,114 @@
 // hxProfiler API
 //
 // hxProfileScope declares an RAII-style profiling sample.  WARNING: A pointer
-// to labelStringLiteral is kept.  c_hxProfilerDefaultSamplingCutoff is provided
-// in hxTime.h as a recommended MinCycles cutoff.
+// to labelStringLiteral is kept.  g_hxTimeDefaultTimingCutoff is provided
+// in hxTime.h as a recommended MinCycles cutoff.  Each call site caches whether
+// its label passes the filters set with hxProfilerAddFilter() and so must
+// always use the same label.  Use hxProfileScopeUncached() where it varies.
 
 // hxProfileScope(const char* labelStringLiteral)
 #define hxProfileScope(labelStringLiteral_) \
-	HX_PROFILE_FN( hxProfilerScopeInternal<> HX_CONCATENATE(hxProfileScope_,__LINE__)(labelStringLiteral_) )
+	HX_PROFILE_FN( static hxProfilerCallsite HX_CONCATENATE(hxProfileCallsite_,__LINE__); \
+		hxProfilerScopeInternal HX_CONCATENATE(hxProfileScope_,__LINE__)(labelStringLiteral_, \
+			&HX_CONCATENATE(hxProfileCallsite_,__LINE__)) )
 
-// hxProfileScopeMin(const char* labelStringLiteral, uint32_t minCycles)
+// hxProfileScopeMin(const char* labelStringLiteral, hx_cycles_t minCycles)
+// minCycles may be a runtime value such as g_hxTimeDefaultTimingCutoff.
 #define hxProfileScopeMin(labelStringLiteral_, minCycles_) \
-	HX_PROFILE_FN( hxProfilerScopeInternal<minCycles_> HX_CONCATENATE(hxProfileScope_,__LINE__)(labelStringLiteral_) )
+	HX_PROFILE_FN( static hxProfilerCallsite HX_CONCATENATE(hxProfileCallsite_,__LINE__); \
+		hxProfilerScopeInternal HX_CONCATENATE(hxProfileScope_,__LINE__)(labelStringLiteral_, \
+			&HX_CONCATENATE(hxProfileCallsite_,__LINE__), (minCycles_)) )
+
+// hxProfileScopeUncached(const char* label, hx_cycles_t minCycles)
+// For call sites whose label varies, such as task labels.  Checks the filters
+// on every call instead of caching the result.  label must still be static.
+#define hxProfileScopeUncached(label_, minCycles_) \
+	HX_PROFILE_FN( hxProfilerScopeInternal HX_CONCATENATE(hxProfileScope_,__LINE__)(label_, \
+		hxnull, (minCycles_)) )
+
+// hxProfileCounter(const char* labelStringLiteral, hx_timestamp_t value)
+// Samples a non-negative integer counter, e.g. a queue depth or bytes in use.
+// Written as a chrome://tracing counter track named by the label.
+#define hxProfileCounter(labelStringLiteral_, value_) HX_PROFILE_FN( do { \
+	static hxProfilerCallsite hxProfileCallsite_; \
+	g_hxProfiler.recordCounter(labelStringLiteral_, (hx_timestamp_t)(value_), hxProfileCallsite_); } while (0) )
+
+// hxProfileMark(const char* labelStringLiteral)
+// Records an instant event.
+#define hxProfileMark(labelStringLiteral_) HX_PROFILE_FN( do { \
+	static hxProfilerCallsite hxProfileCallsite_; \
+	g_hxProfiler.recordMark(labelStringLiteral_, hxProfileCallsite_); } while (0) )
 
 // Clears samples and begins sampling.
 #define hxProfilerStart() HX_PROFILE_FN( g_hxProfiler.start() )
 
+// Clears samples and begins sampling without a limit.  Once all records are
+// used the oldest blocks of records are recycled, keeping the most recent
+// HX_PROFILER_MAX_RECORDS records as a flight recorder.
+#define hxProfilerStartContinuous() HX_PROFILE_FN( g_hxProfiler.start(true) )
+
+// Clears samples and begins updating per-label statistics without keeping
+// records.  Memory use is fixed and does not grow with the number of samples.
+// See HX_PROFILER_AGGREGATE_THREADS and hxProfilerLogStats().
+#define hxProfilerStartAggregating() HX_PROFILE_FN( g_hxProfiler.startAggregating() )
+
+// Begins statistical sampling instead of recording scopes.  A SIGPROF timer
+// interrupts threads that are using CPU time and copies their stack of active
+// scope labels.  Scopes only push and pop a label.  The timer is process wide,
+// so threads that never enter a scope while sampling still take the signal
+// but are not recorded.  See HX_USE_SIGPROF and hxProfilerWriteFoldedStacks().
+#define hxProfilerStartSampling(samplesPerSecond_) HX_PROFILE_FN( g_hxProfiler.startSampling(samplesPerSecond_) )
+
+// Filters labels by prefix.  decimation 0 disables matching labels, 1 enables
+// them and N records 1 in N.  The most recently added matching filter is used.
+// Labels are enabled when no filter matches.  An empty prefix matches all
+// labels.  See HX_PROFILER_MAX_FILTERS.
+#define hxProfilerAddFilter(prefix_, decimation_) HX_PROFILE_FN( g_hxProfiler.addFilter(prefix_, decimation_) )
+
+// Removes all filters.
+#define hxProfilerClearFilters() HX_PROFILE_FN( g_hxProfiler.clearFilters() )
+
+// Scopes shorter than minCycles are not recorded.  In addition to the
+// minCycles of hxProfileScopeMin().
+#define hxProfilerSetMinCycles(minCycles_) HX_PROFILE_FN( g_hxProfiler.setMinCycles(minCycles_) )
+
 // Ends sampling.  Does not clear samples.
 #define hxProfilerStop() HX_PROFILE_FN( g_hxProfiler.stop() )
 
+// Ends sampling and frees memory allocated by the profiler.  Called by
+// hxShutdown().
+#define hxProfilerShutDown() HX_PROFILE_FN( g_hxProfiler.shutDown() )
+
 // Writes samples to the system log.
 #define hxProfilerLog() HX_PROFILE_FN( g_hxProfiler.log() )
 
+// Logs count, total, self, mean, min, max and p50/p90/p99/p999 durations for
+// each label.  Self time excludes nested scopes.  Does not end sampling.
+#define hxProfilerLogStats() HX_PROFILE_FN( g_hxProfiler.logStats() )
+
 // filename is a C string representing a writable destination.  Writes profiling
 // data in a format usable by Chrome's chrome://tracing view.  Usage: In Chrome
 // go to "chrome://tracing/". Load the generated json file.  Use the W/A/S/D keys.
 // See http://www.chromium.org/developers/how-tos/trace-event-profiling-tool
 #define hxProfilerWriteToChromeTracing(filename_) HX_PROFILE_FN( g_hxProfiler.writeToChromeTracing(filename_) )
+
+// filename is a C string representing a writable destination.  Writes samples
+// in a compact binary format without ending sampling.  Much faster than
+// hxProfilerWriteToChromeTracing().  Use the "profileconvert" console command to
+// produce a chrome://tracing file offline.
+#define hxProfilerWriteCapture(filename_) HX_PROFILE_FN( g_hxProfiler.writeCapture(filename_) )
+
+// Writes samples ending in the last seconds in the chrome://tracing format
+// without ending sampling.  Intended for use with hxProfilerStartContinuous().
+#define hxProfilerWriteSnapshotToChromeTracing(filename_, seconds_) \
+	HX_PROFILE_FN( g_hxProfiler.writeSnapshotToChromeTracing(filename_, seconds_) )
+
+// filename is a C string representing a writable destination.  Writes the
+// samples from hxProfilerStartSampling() as "outer;inner count" lines.  This is
+// the folded stack format used by flame graph tools.  Does not end sampling.
+#define hxProfilerWriteFoldedStacks(filename_) HX_PROFILE_FN( g_hxProfiler.writeFoldedStacks(filename_) )
+
+// Streams samples recorded since the previous call to an hxFile opened for
+// binary writing.  See hxProfiler::FileChunk.  May be called periodically by a
+// single thread, e.g. a background thread or task, while sampling continues.
+#define hxProfilerFlush(file_) HX_PROFILE_FN( g_hxProfiler.flush(file_) )
@@ -0,0 +1,282 @@
+#pragma once
+// Copyright 2017-2019 Adrian Johnston
+
+#include <hx/hatchling.h>
+#include <hx/hxSort.h>
+
+#if defined(_MSC_VER)
+#include <intrin.h> // HX_PREFETCH and _BitScanForward
+#endif
+
+// ----------------------------------------------------------------------------
+// hxLowerBound
+//
+// Returns the first element of the sorted range [first, last) that is not
+// ordered before value, or last if there is none.  Uses a branchless binary
+// search that halves the range with a conditional move, so the number of
+// iterations depends only on the size of the range.  Above
+// HX_SEARCH_PREFETCH_MIN_SIZE elements both possible next midpoints are
+// prefetched.  Value may be of a different type than the elements if compare
+// accepts both.  See hxInsertionSort for the compare parameter.
+
+template<typename T_, typename Key_, typename Compare_>
+HX_INLINE T_* hxLowerBound(T_* first_, T_* last_, const Key_& value_, const Compare_& compare_) {
+	uint32_t size_ = (uint32_t)(last_ - first_);
+	if (size_ == 0u) {
+		return first_;
+	}
+	if (size_ > HX_SEARCH_PREFETCH_MIN_SIZE) {
+		while (size_ > 1u) {
+			uint32_t half_ = size_ >> 1;
+			HX_PREFETCH(first_ + (half_ >> 1));
+			HX_PREFETCH(first_ + half_ + (half_ >> 1));
+			first_ = compare_(first_[half_], value_) ? first_ + half_ : first_;
+			size_ -= half_;
+		}
+	}
+	while (size_ > 1u) {
+		uint32_t half_ = size_ >> 1;
+		first_ = compare_(first_[half_], value_) ? first_ + half_ : first_;
+		size_ -= half_;
+	}
+	return first_ + (compare_(*first_, value_) ? 1 : 0);
+}
+
+// A specialization of hxLowerBound using hxLess.
+template<typename T_, typename Key_>
+HX_INLINE T_* hxLowerBound(T_* first_, T_* last_, const Key_& value_) {
+	return hxLowerBound(first_, last_, value_, hxLess());
+}
+
+// ----------------------------------------------------------------------------
+// hxUpperBound
+//
+// Returns the first element of the sorted range [first, last) that value is
+// ordered before, or last if there is none.  Branchless like hxLowerBound.
+
+template<typename T_, typename Key_, typename Compare_>
+HX_INLINE T_* hxUpperBound(T_* first_, T_* last_, const Key_& value_, const Compare_& compare_) {
+	uint32_t size_ = (uint32_t)(last_ - first_);
+	if (size_ == 0u) {
+		return first_;
+	}
+	if (size_ > HX_SEARCH_PREFETCH_MIN_SIZE) {
+		while (size_ > 1u) {
+			uint32_t half_ = size_ >> 1;
+			HX_PREFETCH(first_ + (half_ >> 1));
+			HX_PREFETCH(first_ + half_ + (half_ >> 1));
+			first_ = compare_(value_, first_[half_]) ? first_ : first_ + half_;
+			size_ -= half_;
+		}
+	}
+	while (size_ > 1u) {
+		uint32_t half_ = size_ >> 1;
+		first_ = compare_(value_, first_[half_]) ? first_ : first_ + half_;
+		size_ -= half_;
+	}
+	return first_ + (compare_(value_, *first_) ? 0 : 1);
+}
+
+// A specialization of hxUpperBound using hxLess.
+template<typename T_, typename Key_>
+HX_INLINE T_* hxUpperBound(T_* first_, T_* last_, const Key_& value_) {
+	return hxUpperBound(first_, last_, value_, hxLess());
+}
+
+// ----------------------------------------------------------------------------
+// hxEqualRange
+//
+// Returns the first element of the sorted range [first, last) equivalent to
+// value and sets upper to the end of the elements equivalent to value.  Both
+// are hxLowerBound when there are none.
+
+template<typename T_, typename Key_, typename Compare_>
+HX_INLINE T_* hxEqualRange(T_* first_, T_* last_, const Key_& value_, T_*& upper_,
+		const Compare_& compare_) {
+	T_* lower_ = hxLowerBound(first_, last_, value_, compare_);
+	upper_ = hxUpperBound(lower_, last_, value_, compare_);
+	return lower_;
+}
+
+// A specialization of hxEqualRange using hxLess.
+template<typename T_, typename Key_>
+HX_INLINE T_* hxEqualRange(T_* first_, T_* last_, const Key_& value_, T_*& upper_) {
+	return hxEqualRange(first_, last_, value_, upper_, hxLess());
+}
+
+// ----------------------------------------------------------------------------
+// hxEytzinger
+//
+// A copy of a sorted array stored in Eytzinger (breadth first) order for
+// lookups into large static tables.  The root is element 1 and the children
+// of element k are 2k and 2k + 1, so every search walks down from the front
+// of the array and the top levels of the tree share a few cache lines.  The
+// descendants of k four levels down (for 4-byte T) are one cache line, which
+// is prefetched at every step.  Searches are branchless and return an element
+// or null.  The storage is aligned to HX_CACHE_LINE_SIZE and allocated from
+// the current memory manager.  T must be copy constructible.
+
+template<typename T_>
+class hxEytzinger {
+public:
+	typedef T_ T;
+
+	HX_INLINE explicit hxEytzinger() : m_data(hxnull), m_size(0u), m_levels(0u), m_prefetchShift(0u) { }
+
+	// Builds from the sorted range [first, last).
+	HX_INLINE explicit hxEytzinger(const T* first_, const T* last_)
+			: m_data(hxnull), m_size(0u), m_levels(0u), m_prefetchShift(0u) {
+		assign(first_, last_);
+	}
+
+	HX_INLINE ~hxEytzinger() { clear(); }
+
+	// Replaces the contents with the sorted range [first, last).  Copies the
+	// elements with an in-order walk of the tree.
+	void assign(const T* first_, const T* last_) {
+		clear();
+		m_size = (uint32_t)(last_ - first_);
+		if (m_size == 0u) {
+			return;
+		}
+		// Element 0 is padding so that element k's descendants are aligned.
+		m_data = (T*)hxMallocExt((m_size + 1u) * sizeof(T), hxMemoryManagerId_Current,
+			HX_CACHE_LINE_SIZE - 1u);
+		for (uint32_t size_ = m_size; size_ != 0u; size_ >>= 1) {
+			++m_levels;
+		}
+		m_prefetchShift = 1u;
+		while ((2u << m_prefetchShift) * sizeof(T) <= HX_CACHE_LINE_SIZE) {
+			++m_prefetchShift;
+		}
+
+		uint32_t k_ = 1u;
+		while (2u * k_ <= m_size) {
+			k_ *= 2u;
+		}
+		for (const T* it_ = first_; it_ != last_; ++it_) {
+			::new(m_data + k_) T(*it_);
+			// Next in order: the leftmost descendant of the right child, or else
+			// the first ancestor reached from a left child.
+			if (2u * k_ + 1u <= m_size) {
+				k_ = 2u * k_ + 1u;
+				while (2u * k_ <= m_size) {
+					k_ *= 2u;
+				}
+			}
+			else {
+				k_ = finish_(k_);
+			}
+		}
+	}
+
+	HX_INLINE void clear() {
+		if (m_data) {
+			for (uint32_t k_ = 1u; k_ <= m_size; ++k_) {
+				m_data[k_].~T();
+			}
+			hxFree(m_data);
+			m_data = hxnull;
+		}
+		m_size = 0u;
+		m_levels = 0u;
+	}
+
+	HX_INLINE uint32_t size() const { return m_size; }
+	HX_INLINE bool empty() const { return m_size == 0u; }
+
+	// Elements in Eytzinger order.
+	HX_INLINE const T* begin() const { return m_data ? m_data + 1 : hxnull; }
+	HX_INLINE const T* end() const { return m_data ? m_data + 1 + m_size : hxnull; }
+
+	// Returns the first element in sorted order that is not ordered before value
+	// or null.  Value may be of a different type than T if compare accepts both.
+	// See hxInsertionSort for the compare parameter.
+	template<typename Key_, typename Compare_>
+	HX_INLINE const T* lowerBound(const Key_& value_, const Compare_& compare_) const {
+		uint32_t k_ = 1u;
+		while (k_ <= m_size) {
+			HX_PREFETCH(m_data + (k_ << m_prefetchShift));
+			k_ = 2u * k_ + (compare_(m_data[k_], value_) ? 1u : 0u);
+		}
+		k_ = finish_(k_);
+		return k_ ? m_data + k_ : hxnull;
+	}
+
+	template<typename Key_>
+	HX_INLINE const T* lowerBound(const Key_& value_) const { return lowerBound(value_, hxLess()); }
+
+	// Returns the first element in sorted order that value is ordered before or
+	// null.
+	template<typename Key_, typename Compare_>
+	HX_INLINE const T* upperBound(const Key_& value_, const Compare_& compare_) const {
+		uint32_t k_ = 1u;
+		while (k_ <= m_size) {
+			HX_PREFETCH(m_data + (k_ << m_prefetchShift));
+			k_ = 2u * k_ + (compare_(value_, m_data[k_]) ? 0u : 1u);
+		}
+		k_ = finish_(k_);
+		return k_ ? m_data + k_ : hxnull;
+	}
+
+	template<typename Key_>
+	HX_INLINE const T* upperBound(const Key_& value_) const { return upperBound(value_, hxLess()); }
+
+	// Writes lowerBound(*it) to out for each value in [first, last).  Walks
+	// HX_SEARCH_BATCH_SIZE searches down the tree together so that their cache
+	// misses overlap instead of being taken one after another.
+	template<typename Key_, typename Compare_>
+	void lowerBounds(const Key_* first_, const Key_* last_, const T** out_, const Compare_& compare_) const {
+		uint32_t ks_[HX_SEARCH_BATCH_SIZE];
+		while (first_ != last_) {
+			uint32_t count_ = hxMin((uint32_t)(last_ - first_), (uint32_t)HX_SEARCH_BATCH_SIZE);
+			for (uint32_t i_ = 0u; i_ < count_; ++i_) {
+				ks_[i_] = 1u;
+			}
+			// Every search takes the same path length through the full levels.
+			for (uint32_t level_ = m_levels; level_ > 1u; --level_) {
+				for (uint32_t i_ = 0u; i_ < count_; ++i_) {
+					uint32_t k_ = ks_[i_];
+					HX_PREFETCH(m_data + (k_ << m_prefetchShift));
+					ks_[i_] = 2u * k_ + (compare_(m_data[k_], first_[i_]) ? 1u : 0u);
+				}
+			}
+			for (uint32_t i_ = 0u; i_ < count_; ++i_) {
+				uint32_t k_ = ks_[i_];
+				if (k_ <= m_size) {
+					k_ = 2u * k_ + (compare_(m_data[k_], first_[i_]) ? 1u : 0u);
+				}
+				k_ = finish_(k_);
+				out_[i_] = k_ ? m_data + k_ : hxnull;
+			}
+			first_ += count_;
+			out_ += count_;
+		}
+	}
+
+	template<typename Key_>
+	HX_INLINE void lowerBounds(const Key_* first_, const Key_* last_, const T** out_) const {
+		lowerBounds(first_, last_, out_, hxLess());
+	}
+
+private:
+	HX_INLINE explicit hxEytzinger(const hxEytzinger&); // = delete
+	HX_INLINE void operator=(const hxEytzinger&); // = delete
+
+	// Undoes the right turns taken after the last left turn and then that left
+	// turn, giving the last element the search went left from.  Zero if none.
+	static HX_INLINE uint32_t finish_(uint32_t k_) {
+#if defined(_MSC_VER)
+		unsigned long ones_;
+		_BitScanForward(&ones_, ~k_);
+		return (k_ >> ones_) >> 1;
+#else
+		return (k_ >> __builtin_ctz(~k_)) >> 1;
+#endif
+	}
+
+	T* m_data;
+	uint32_t m_size;
+	uint32_t m_levels; // levels of the tree including a partial last level.
+	uint32_t m_prefetchShift;
+};
@@ -38,6 +38,39 @@
 #if !defined(HX_USE_CPP14_CONSTEXPR)
 #define HX_USE_CPP14_CONSTEXPR 0 // silently generating horrible assembly as of MSVC 15.8.9.
 #endif
+#if !defined(HX_USE_THREAD_AFFINITY)
+#define HX_USE_THREAD_AFFINITY HX_USE_CPP11_THREADS // SetThreadAffinityMask
+#endif
+#if !defined(HX_USE_TSC)
+#if defined(_M_X64) || defined(_M_IX86)
+#define HX_USE_TSC 1 // __rdtsc
+#else
+#define HX_USE_TSC 0
+#endif
+#endif
+#if !defined(HX_USE_SIGPROF)
+#define HX_USE_SIGPROF 0
+#endif
+#if !defined(HX_USE_STREAMING_STORES)
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define HX_USE_STREAMING_STORES 1 // _mm_stream_si128
+#else
+#define HX_USE_STREAMING_STORES 0
+#endif
+#endif
+#if !defined(HX_USE_SSE4_1)
+#if defined(__AVX__)
+#define HX_USE_SSE4_1 1 // _mm_min_epu32
+#else
+#define HX_USE_SSE4_1 0
+#endif
+#endif
+
+#if defined(_M_X64) || defined(_M_IX86)
+#define HX_PREFETCH(p_) _mm_prefetch((const char*)(p_), _MM_HINT_T0) // <intrin.h>
+#else
+#define HX_PREFETCH(p_) ((void)(p_))
+#endif
 
 #define HX_RESTRICT __restrict
 #define HX_INLINE __forceinline
@@ -71,7 +104,48 @@
 // "__cpp_constexpr >= 201304" may not compile as C++
 #define HX_USE_CPP14_CONSTEXPR (__cplusplus >= 201402L)
 #endif
+#if !defined(HX_USE_THREAD_AFFINITY)
+#if defined(__linux__)
+#define HX_USE_THREAD_AFFINITY HX_USE_CPP11_THREADS // pthread_setaffinity_np
+#else
+#define HX_USE_THREAD_AFFINITY 0
+#endif
+#endif
+// HX_USE_TSC: Use the CPU timestamp counter for hxTimeSampleTimestamp().
+#if !defined(HX_USE_TSC)
+#if (defined(__x86_64__) || defined(__i386__) || defined(__aarch64__)) && !HX_USE_WASM
+#define HX_USE_TSC 1
+#else
+#define HX_USE_TSC 0
+#endif
+#endif
+// HX_USE_SIGPROF: Use setitimer and SIGPROF for hxProfilerStartSampling().
+#if !defined(HX_USE_SIGPROF)
+#if (defined(__linux__) || defined(__APPLE__)) && !HX_USE_WASM
+#define HX_USE_SIGPROF 1
+#else
+#define HX_USE_SIGPROF 0
+#endif
+#endif
+// HX_USE_STREAMING_STORES: Use SSE2 non-temporal stores for data that will not
+// be read again soon.
+#if !defined(HX_USE_STREAMING_STORES)
+#if defined(__SSE2__) && !HX_USE_WASM
+#define HX_USE_STREAMING_STORES 1
+#else
+#define HX_USE_STREAMING_STORES 0
+#endif
+#endif
+// HX_USE_SSE4_1: Use SSE4.1 sorting networks in hxSortNetwork().
+#if !defined(HX_USE_SSE4_1)
+#if defined(__SSE4_1__) && !HX_USE_WASM
+#define HX_USE_SSE4_1 1
+#else
+#define HX_USE_SSE4_1 0
+#endif
+#endif
 
+#define HX_PREFETCH(p_) __builtin_prefetch(p_)
 #define HX_RESTRICT __restrict
 #define HX_INLINE inline __attribute__((always_inline))
 #define HX_LINK_SCRATCHPAD // TODO: Configure for target.  A linker section is required.
@@ -103,6 +177,15 @@
 #define HX_CONSTEXPR_FN HX_INLINE
 #endif
 
+// HX_USE_CPP20_COROUTINES.  Enables hxCoroutineTask.  See <hx/hxTaskCoroutine.h>.
+#if !defined(HX_USE_CPP20_COROUTINES)
+#if defined(__cpp_impl_coroutine)
+#define HX_USE_CPP20_COROUTINES (__cpp_impl_coroutine >= 201902L)
+#else
+#define HX_USE_CPP20_COROUTINES 0
+#endif
+#endif
+
 // HX_THREAD_LOCAL.  A version of thread_local that compiles out when there is
 // no threading.
 #if HX_USE_CPP11_THREADS
@@ -111,6 +194,13 @@
 #define HX_THREAD_LOCAL // single threaded operation can ignore thread_local
 #endif
 
+// HX_USE_NUMA.  Allows hxTaskQueue pool threads to be grouped by NUMA node.
+// Each node gets its own task lists and pool threads prefer memory from their
+// node.  Requires threads.
+#if !defined(HX_USE_NUMA)
+#define HX_USE_NUMA HX_USE_CPP11_THREADS
+#endif
+
 // ----------------------------------------------------------------------------
 // Maximum length for formatted messages printed with this platform.
 #if !defined(HX_MAX_LINE)
@@ -159,11 +249,68 @@
 #define HX_PROFILE (HX_RELEASE) < 2
 #endif
 
+// HX_PROFILE_PERF_COUNTERS: 1 adds hardware counter deltas to hxProfileScope
+// records using Linux perf_event_open.  Adds 32 bytes per record.  Counters
+// are read with rdpmc when the kernel allows it.  Requires HX_PROFILE.
+#if !defined(HX_PROFILE_PERF_COUNTERS)
+#define HX_PROFILE_PERF_COUNTERS 0
+#endif
+
 // The profiler doesn't reallocate.  This is the maximum.
 #if !defined(HX_PROFILER_MAX_RECORDS)
 #define HX_PROFILER_MAX_RECORDS 4096
 #endif
 
+// Records are divided into blocks owned by a single thread.  The maximum number
+// of threads recording at once is HX_PROFILER_MAX_RECORDS / HX_PROFILER_BLOCK_RECORDS.
+#if !defined(HX_PROFILER_BLOCK_RECORDS)
+#define HX_PROFILER_BLOCK_RECORDS 256
+#endif
+
+// hxProfilerStartAggregating() keeps a fixed table of statistics for each
+// thread instead of records.  These are the maximum number of threads and of
+// distinct labels per thread.  Further samples are dropped.
+#if !defined(HX_PROFILER_AGGREGATE_THREADS)
+#define HX_PROFILER_AGGREGATE_THREADS 8
+#endif
+
+#if !defined(HX_PROFILER_AGGREGATE_LABELS)
+#define HX_PROFILER_AGGREGATE_LABELS 32
+#endif
+
+// Maximum number of hxProfilerAddFilter() filters.
+#if !defined(HX_PROFILER_MAX_FILTERS)
+#define HX_PROFILER_MAX_FILTERS 16
+#endif
+
+// hxProfilerStartSampling() keeps the most recent HX_PROFILER_MAX_SAMPLES
+// samples of the scope labels active on the interrupted thread.  Only the
+// outermost HX_PROFILER_SAMPLE_DEPTH labels are kept.
+#if !defined(HX_PROFILER_MAX_SAMPLES)
+#define HX_PROFILER_MAX_SAMPLES 1024
+#endif
+
+#if !defined(HX_PROFILER_SAMPLE_DEPTH)
+#define HX_PROFILER_SAMPLE_DEPTH 16
+#endif
+
+// Number of distinct task labels tracked by hxTaskQueue statistics.  Further
+// labels are combined into a single entry.
+#if !defined(HX_TASK_QUEUE_STATS_LABELS)
+#define HX_TASK_QUEUE_STATS_LABELS 32
+#endif
+
+// Maximum number of NUMA nodes an hxTaskQueue may group its pool threads into
+// when HX_USE_NUMA.
+#if !defined(HX_NUMA_MAX_NODES)
+#define HX_NUMA_MAX_NODES 8
+#endif
+
+// Interval at which a suspended hxTaskPoll awaitable checks its condition.
+#if !defined(HX_TASK_POLL_MICROSECONDS)
+#define HX_TASK_POLL_MICROSECONDS 100
+#endif
+
 // ----------------------------------------------------------------------------
 // HX_DEBUG_DMA.  Internal validation, set to 1 or 0 as needed
 #if !defined(HX_DEBUG_DMA)
@@ -186,6 +333,44 @@
 #define HX_TEST_DIE_AT_THE_END 0
 #endif
 
+// ----------------------------------------------------------------------------
+// HX_BENCHMARK_*.  Defaults for hxBenchmark::setLimits() and regression checks.
+#if !defined(HX_BENCHMARK_MILLISECONDS)
+#define HX_BENCHMARK_MILLISECONDS 100 // time budget including warmup.
+#endif
+
+#if !defined(HX_BENCHMARK_ITERATIONS)
+#define HX_BENCHMARK_ITERATIONS 100000000u // measured iterations, not counting warmup.
+#endif
+
+#if !defined(HX_BENCHMARK_REGRESSION_PERCENT)
+#define HX_BENCHMARK_REGRESSION_PERCENT 10 // slowdown relative to a baseline.
+#endif
+
+// ----------------------------------------------------------------------------
+// HX_SORT_*.  Tuning comparison sort algorithms.
+#if !defined(HX_SORT_MIN_SIZE)
+#define HX_SORT_MIN_SIZE 24u // uses hxInsertionSort() below this.
+#endif
+
+#if !defined(HX_SORT_NETWORK_MAX_SIZE)
+#define HX_SORT_NETWORK_MAX_SIZE 64u // largest SIMD hxSortNetwork().
+#endif
+
+#if !defined(HX_SORT_GALLOP_SIZE)
+#define HX_SORT_GALLOP_SIZE 7u // hxMerge() gallops after this many in a row.
+#endif
+
+// ----------------------------------------------------------------------------
+// HX_SEARCH_*.  Tuning sorted array search.
+#if !defined(HX_SEARCH_BATCH_SIZE)
+#define HX_SEARCH_BATCH_SIZE 8u // lookups in flight in hxEytzinger::lowerBounds().
+#endif
+
+#if !defined(HX_SEARCH_PREFETCH_MIN_SIZE)
+#define HX_SEARCH_PREFETCH_MIN_SIZE 4096u // hxLowerBound() prefetches above this.
+#endif
+
 // ----------------------------------------------------------------------------
 // HX_RADIX_SORT_*.  Tuning radix sort algorithm.
 // These need to be determined by benchmarking on the target platform.  The 8-
@@ -199,6 +384,22 @@
 #define HX_RADIX_SORT_MIN_SIZE 50u // uses hxInsertionSort() below this.
 #endif
 
+#if !defined(HX_RADIX_SORT_WRITE_COMBINE_BYTES)
+#define HX_RADIX_SORT_WRITE_COMBINE_BYTES 1048576u // buffers scattered writes above this.
+#endif
+
+#if !defined(HX_CACHE_LINE_SIZE)
+#define HX_CACHE_LINE_SIZE 64u
+#endif
+
+#if !defined(HX_RADIX_SORT_PARALLEL_MIN_SIZE)
+#define HX_RADIX_SORT_PARALLEL_MIN_SIZE 16384u // sorts on a single thread below this.
+#endif
+
+#if !defined(HX_RADIX_SORT_TASKS)
+#define HX_RADIX_SORT_TASKS 8 // chunks sorted in parallel.
+#endif
+
 // ----------------------------------------------------------------------------
 // Default undetected HX_USE_* features.
 
@@ -4,6 +4,12 @@
 #include <hx/hatchling.h>
 #include <hx/hxArray.h>
 
+#if HX_USE_STREAMING_STORES
+#include <emmintrin.h>
+#endif
+
+class hxTaskQueue;
+
 // ----------------------------------------------------------------------------
 // hxLess
 //
@@ -15,6 +21,12 @@ struct hxLess {
 	HX_INLINE bool operator()(const T1_& lhs_, const T2_& rhs_) const { return lhs_ < rhs_; }
 };
 
+// hxGreater.  Reverses comparison order by swapping the arguments to operator <.
+struct hxGreater {
+	template<typename T1_, typename T2_>
+	HX_INLINE bool operator()(const T1_& lhs_, const T2_& rhs_) const { return rhs_ < lhs_; }
+};
+
 // ----------------------------------------------------------------------------
 // hxInsertionSort
 //
@@ -52,64 +64,1399 @@ HX_INLINE void hxInsertionSort(T* first_, T* last_) {
 	hxInsertionSort(first_, last_, hxLess());
 }
 
+// ----------------------------------------------------------------------------
+// hxHeapSort
+//
+// Sorts the elements in the range [first, last) in comparison order using the
+// heap sort algorithm.  O(n log n) in the worst case and allocates nothing.
+// Not stable.  See hxInsertionSort for the compare parameter.
+
+template<typename T_, typename Compare_>
+HX_INLINE void hxHeapSift(T_* first_, uint32_t root_, uint32_t size_, const Compare_& compare_) {
+	T_ t_ = first_[root_];
+	for (uint32_t child_ = 2u * root_ + 1u; child_ < size_; child_ = 2u * root_ + 1u) {
+		if (child_ + 1u < size_ && compare_(first_[child_], first_[child_ + 1u])) {
+			++child_;
+		}
+		if (!compare_(t_, first_[child_])) {
+			break;
+		}
+		first_[root_] = first_[child_];
+		root_ = child_;
+	}
+	first_[root_] = t_;
+}
+
+template<typename T_, typename Compare_>
+void hxHeapSort(T_* first_, T_* last_, const Compare_& compare_) {
+	uint32_t size_ = (uint32_t)(last_ - first_);
+	for (uint32_t i_ = size_ / 2u; i_--;) {
+		hxHeapSift(first_, i_, size_, compare_);
+	}
+	while (size_ > 1u) {
+		--size_;
+		hxSwap(first_[0], first_[size_]);
+		hxHeapSift(first_, 0u, size_, compare_);
+	}
+}
+
+// ----------------------------------------------------------------------------
+// hxSortNetwork
+//
+// Sorts the elements in the range [first, last) with a bitonic sorting
+// network.  The comparisons made do not depend on the data and elements are
+// exchanged without branching, so there are no mispredictions.  O(n log^2 n)
+// and intended for small arrays.  Not stable.  See hxInsertionSort for the
+// compare parameter.
+//
+// The uint32_t and float versions are limited to HX_SORT_NETWORK_MAX_SIZE
+// elements and use SSE4.1 when HX_USE_SSE4_1.  Floats are ordered as by
+// hxRadixSortKey<float>, with -0.0 before 0.0.  hxSortNetworkKeyValues()
+// sorts uint32_t values by their uint32_t or float keys.
+
+template<typename T_, typename Compare_>
+HX_INLINE void hxSortNetworkExchange(T_& a_, T_& b_, const Compare_& compare_) {
+	bool isSwap_ = compare_(b_, a_);
+	T_ t_ = isSwap_ ? b_ : a_;
+	b_ = isSwap_ ? a_ : b_;
+	a_ = t_;
+}
+
+template<typename T_, typename Compare_>
+void hxSortNetwork(T_* first_, T_* last_, const Compare_& compare_) {
+	// Exchanges with elements past the end are skipped as if they were padding
+	// greater than every element.
+	uint32_t size_ = (uint32_t)(last_ - first_);
+	for (uint32_t k_ = 2u; k_ < 2u * size_; k_ <<= 1) {
+		// Merge pairs of sorted blocks of k/2 starting with mirrored elements.
+		for (uint32_t i_ = 0u; i_ < size_; ++i_) {
+			uint32_t j_ = i_ ^ (k_ - 1u);
+			if (i_ < j_ && j_ < size_) {
+				hxSortNetworkExchange(first_[i_], first_[j_], compare_);
+			}
+		}
+		for (uint32_t stride_ = k_ >> 2; stride_ != 0u; stride_ >>= 1) {
+			for (uint32_t i_ = 0u; i_ < size_; ++i_) {
+				uint32_t j_ = i_ ^ stride_;
+				if (i_ < j_ && j_ < size_) {
+					hxSortNetworkExchange(first_[i_], first_[j_], compare_);
+				}
+			}
+		}
+	}
+}
+
+// A specialization of hxSortNetwork using hxLess.
+template<typename T_>
+HX_INLINE void hxSortNetwork(T_* first_, T_* last_) {
+	hxSortNetwork(first_, last_, hxLess());
+}
+
+void hxSortNetwork(uint32_t* first_, uint32_t* last_);
+void hxSortNetwork(float* first_, float* last_);
+void hxSortNetworkKeyValues(uint32_t* keys_, uint32_t* values_, uint32_t size_);
+void hxSortNetworkKeyValues(float* keys_, uint32_t* values_, uint32_t size_);
+
+// Sorts ranges smaller than HX_SORT_MIN_SIZE for hxSort() and hxMergeSort().
+// Keys of uint32_t and float use hxSortNetwork() when it is vectorized.
+template<typename T_, typename Compare_>
+HX_INLINE void hxSortSmall(T_* first_, T_* last_, const Compare_& compare_) {
+	hxInsertionSort(first_, last_, compare_);
+}
+
+#if HX_USE_SSE4_1
+HX_STATIC_ASSERT(HX_SORT_MIN_SIZE <= HX_SORT_NETWORK_MAX_SIZE, "HX_SORT_NETWORK_MAX_SIZE too small");
+HX_INLINE void hxSortSmall(uint32_t* first_, uint32_t* last_, const hxLess& compare_) {
+	(void)compare_;
+	hxSortNetwork(first_, last_);
+}
+HX_INLINE void hxSortSmall(float* first_, float* last_, const hxLess& compare_) {
+	(void)compare_;
+	hxSortNetwork(first_, last_);
+}
+#endif
+
+// ----------------------------------------------------------------------------
+// hxSort
+//
+// Sorts the elements in the range [first, last) in comparison order using
+// pattern-defeating quicksort.  Partitions are made without branching on
+// comparisons and partitions smaller than HX_SORT_MIN_SIZE are finished with
+// hxSortSmall().  Falls back to hxHeapSort() when partitions are too
+// unbalanced for O(n log n).  Sorted, reversed and repeated inputs take
+// O(n).  Not stable, see hxMergeSort().  Allocates nothing.  See
+// hxInsertionSort for the compare parameter.
+
+HX_STATIC_ASSERT(HX_SORT_MIN_SIZE >= 8u, "HX_SORT_MIN_SIZE too small for hxSort");
+
+template<typename T_, typename Compare_>
+HX_INLINE void hxSortSort3(T_* a_, T_* b_, T_* c_, const Compare_& compare_) {
+	if (compare_(*b_, *a_)) { hxSwap(*a_, *b_); }
+	if (compare_(*c_, *b_)) { hxSwap(*b_, *c_); }
+	if (compare_(*b_, *a_)) { hxSwap(*a_, *b_); }
+}
+
+// Moves the median of 3, or the pseudomedian of 9 for larger ranges, to first.
+// Leaves an element not less than the pivot at the end.
+template<typename T_, typename Compare_>
+HX_INLINE void hxSortChoosePivot(T_* first_, T_* last_, const Compare_& compare_) {
+	uint32_t size_ = (uint32_t)(last_ - first_);
+	uint32_t half_ = size_ / 2u;
+	if (size_ > 128u) {
+		hxSortSort3(first_, first_ + half_, last_ - 1, compare_);
+		hxSortSort3(first_ + 1, first_ + (half_ - 1u), last_ - 2, compare_);
+		hxSortSort3(first_ + 2, first_ + (half_ + 1u), last_ - 3, compare_);
+		hxSortSort3(first_ + (half_ - 1u), first_ + half_, first_ + (half_ + 1u), compare_);
+		hxSwap(*first_, first_[half_]);
+	}
+	else {
+		hxSortSort3(first_ + half_, first_, last_ - 1, compare_);
+	}
+}
+
+// Partitions around *first with elements equal to the pivot on the right.
+// Requires an element not less than the pivot to the right.  Returns the
+// pivot position and sets isPartitioned when nothing moved.  Misplaced
+// elements are found in blocks of 64 by adding comparison results to offsets
+// and are then swapped as pairs.
+template<typename T_, typename Compare_>
+T_* hxSortPartitionRight(T_* first_, T_* last_, const Compare_& compare_, bool& isPartitioned_) {
+	T_ pivot_ = *first_;
+	T_* l_ = first_;
+	T_* r_ = last_;
+	while (compare_(*++l_, pivot_)) { }
+	if (l_ - 1 == first_) {
+		while (l_ < r_ && !compare_(*--r_, pivot_)) { }
+	}
+	else {
+		while (!compare_(*--r_, pivot_)) { }
+	}
+
+	isPartitioned_ = l_ >= r_;
+	if (!isPartitioned_) {
+		hxSwap(*l_, *r_);
+		++l_;
+
+		const uint32_t blockSize_ = 64u;
+		unsigned char offsetsL_[64];
+		unsigned char offsetsR_[64];
+		T_* baseL_ = l_;
+		T_* baseR_ = r_;
+		uint32_t countL_ = 0u;
+		uint32_t countR_ = 0u;
+		uint32_t startL_ = 0u;
+		uint32_t startR_ = 0u;
+		while (l_ < r_) {
+			// Refill whichever blocks are empty from the unknown range.
+			uint32_t unknown_ = (uint32_t)(r_ - l_);
+			uint32_t splitL_ = (countL_ == 0u) ? ((countR_ == 0u) ? unknown_ / 2u : unknown_) : 0u;
+			uint32_t splitR_ = (countR_ == 0u) ? unknown_ - splitL_ : 0u;
+			splitL_ = hxMin(splitL_, blockSize_);
+			splitR_ = hxMin(splitR_, blockSize_);
+			for (uint32_t i_ = 0u; i_ < splitL_; ++i_) {
+				offsetsL_[countL_] = (unsigned char)i_;
+				countL_ += !compare_(*l_++, pivot_) ? 1u : 0u;
+			}
+			for (uint32_t i_ = 0u; i_ < splitR_;) {
+				offsetsR_[countR_] = (unsigned char)++i_;
+				countR_ += compare_(*--r_, pivot_) ? 1u : 0u;
+			}
+
+			// Equal counts swap pairs to keep reversed input O(n).  Otherwise
+			// rotating through the pairs saves a move per pair.
+			uint32_t count_ = hxMin(countL_, countR_);
+			if (countL_ == countR_) {
+				for (uint32_t i_ = 0u; i_ < count_; ++i_) {
+					hxSwap(baseL_[offsetsL_[startL_ + i_]], *(baseR_ - offsetsR_[startR_ + i_]));
+				}
+			}
+			else if (count_ != 0u) {
+				T_* pl_ = baseL_ + offsetsL_[startL_];
+				T_* pr_ = baseR_ - offsetsR_[startR_];
+				T_ t_ = *pl_;
+				*pl_ = *pr_;
+				for (uint32_t i_ = 1u; i_ < count_; ++i_) {
+					pl_ = baseL_ + offsetsL_[startL_ + i_];
+					*pr_ = *pl_;
+					pr_ = baseR_ - offsetsR_[startR_ + i_];
+					*pl_ = *pr_;
+				}
+				*pr_ = t_;
+			}
+			countL_ -= count_;
+			countR_ -= count_;
+			startL_ += count_;
+			startR_ += count_;
+			if (countL_ == 0u) {
+				startL_ = 0u;
+				baseL_ = l_;
+			}
+			if (countR_ == 0u) {
+				startR_ = 0u;
+				baseR_ = r_;
+			}
+		}
+
+		// Move the elements left in one block across the partition.
+		if (countL_ != 0u) {
+			while (countL_--) {
+				hxSwap(baseL_[offsetsL_[startL_ + countL_]], *--r_);
+			}
+			l_ = r_;
+		}
+		else if (countR_ != 0u) {
+			while (countR_--) {
+				hxSwap(*(baseR_ - offsetsR_[startR_ + countR_]), *l_++);
+			}
+		}
+	}
+
+	T_* pivotPosition_ = l_ - 1;
+	*first_ = *pivotPosition_;
+	*pivotPosition_ = pivot_;
+	return pivotPosition_;
+}
+
+// Partitions around *first with elements equal to the pivot on the left.  Used
+// when the pivot equals the previous pivot, leaving the left side sorted.
+template<typename T_, typename Compare_>
+T_* hxSortPartitionLeft(T_* first_, T_* last_, const Compare_& compare_) {
+	T_ pivot_ = *first_;
+	T_* l_ = first_;
+	T_* r_ = last_;
+	while (compare_(pivot_, *--r_)) { }
+	if (r_ + 1 == last_) {
+		while (l_ < r_ && !compare_(pivot_, *++l_)) { }
+	}
+	else {
+		while (!compare_(pivot_, *++l_)) { }
+	}
+	while (l_ < r_) {
+		hxSwap(*l_, *r_);
+		while (compare_(pivot_, *--r_)) { }
+		while (!compare_(pivot_, *++l_)) { }
+	}
+	*first_ = *r_;
+	*r_ = pivot_;
+	return r_;
+}
+
+// Insertion sort that gives up after moving 8 elements.  Returns whether the
+// range was sorted.
+template<typename T_, typename Compare_>
+bool hxSortPartialInsertion(T_* first_, T_* last_, const Compare_& compare_) {
+	if (first_ == last_) {
+		return true;
+	}
+	uint32_t moves_ = 0u;
+	for (T_* i_ = first_ + 1; i_ != last_; ++i_) {
+		T_* j_ = i_;
+		if (compare_(*j_, *(j_ - 1))) {
+			T_ t_ = *j_;
+			do {
+				*j_ = *(j_ - 1);
+				--j_;
+			} while (j_ != first_ && compare_(t_, *(j_ - 1)));
+			*j_ = t_;
+			moves_ += (uint32_t)(i_ - j_);
+			if (moves_ > 8u) {
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+template<typename T_, typename Compare_>
+void hxSortLoop(T_* first_, T_* last_, const Compare_& compare_, uint32_t badAllowed_, bool isLeftmost_) {
+	for (;;) {
+		uint32_t size_ = (uint32_t)(last_ - first_);
+		if (size_ < HX_SORT_MIN_SIZE) {
+			hxSortSmall(first_, last_, compare_);
+			return;
+		}
+
+		hxSortChoosePivot(first_, last_, compare_);
+
+		// Nothing here is less than the previous pivot at first[-1].  If the
+		// pivot equals it then put equal elements on the left and skip them.
+		if (!isLeftmost_ && !compare_(*(first_ - 1), *first_)) {
+			first_ = hxSortPartitionLeft(first_, last_, compare_) + 1;
+			continue;
+		}
+
+		bool isPartitioned_;
+		T_* pivot_ = hxSortPartitionRight(first_, last_, compare_, isPartitioned_);
+		uint32_t sizeL_ = (uint32_t)(pivot_ - first_);
+		uint32_t sizeR_ = (uint32_t)(last_ - (pivot_ + 1));
+
+		if (sizeL_ < size_ / 8u || sizeR_ < size_ / 8u) {
+			if (--badAllowed_ == 0u) {
+				hxHeapSort(first_, last_, compare_);
+				return;
+			}
+
+			// Break up patterns that produce bad pivots.
+			if (sizeL_ >= HX_SORT_MIN_SIZE) {
+				hxSwap(first_[0], first_[sizeL_ / 4u]);
+				hxSwap(pivot_[-1], *(pivot_ - sizeL_ / 4u));
+				if (sizeL_ > 128u) {
+					hxSwap(first_[1], first_[sizeL_ / 4u + 1u]);
+					hxSwap(first_[2], first_[sizeL_ / 4u + 2u]);
+					hxSwap(pivot_[-2], *(pivot_ - (sizeL_ / 4u + 1u)));
+					hxSwap(pivot_[-3], *(pivot_ - (sizeL_ / 4u + 2u)));
+				}
+			}
+			if (sizeR_ >= HX_SORT_MIN_SIZE) {
+				hxSwap(pivot_[1], pivot_[1u + sizeR_ / 4u]);
+				hxSwap(last_[-1], *(last_ - sizeR_ / 4u));
+				if (sizeR_ > 128u) {
+					hxSwap(pivot_[2], pivot_[2u + sizeR_ / 4u]);
+					hxSwap(pivot_[3], pivot_[3u + sizeR_ / 4u]);
+					hxSwap(last_[-2], *(last_ - (1u + sizeR_ / 4u)));
+					hxSwap(last_[-3], *(last_ - (2u + sizeR_ / 4u)));
+				}
+			}
+		}
+		else if (isPartitioned_ && hxSortPartialInsertion(first_, pivot_, compare_)
+				&& hxSortPartialInsertion(pivot_ + 1, last_, compare_)) {
+			return;
+		}
+
+		// Recurse on the left and loop on the right.
+		hxSortLoop(first_, pivot_, compare_, badAllowed_, isLeftmost_);
+		first_ = pivot_ + 1;
+		isLeftmost_ = false;
+	}
+}
+
+template<typename T_, typename Compare_>
+HX_INLINE void hxSort(T_* first_, T_* last_, const Compare_& compare_) {
+	// Allow log2(size) unbalanced partitions.
+	uint32_t badAllowed_ = 0u;
+	for (uint32_t size_ = (uint32_t)(last_ - first_); size_ > 1u; size_ >>= 1) {
+		++badAllowed_;
+	}
+	hxSortLoop(first_, last_, compare_, badAllowed_, true);
+}
+
+// A specialization of hxSort using hxLess.
+template<typename T_>
+HX_INLINE void hxSort(T_* first_, T_* last_) {
+	hxSort(first_, last_, hxLess());
+}
+
+// ----------------------------------------------------------------------------
+// hxMerge
+//
+// Stable merge of the sorted ranges [first1, last1) and [first2, last2) into
+// out.  Returns the end of the output.  Equal elements are taken from the
+// first range first.  After HX_SORT_GALLOP_SIZE elements in a row from one
+// range it gallops, finding the rest of that run with an exponential search
+// and copying it with memmove.  Runs that are already in order or that
+// interleave coarsely are then merged in O(log n) comparisons per run.  The
+// output may overlap [first2, last2) if it starts at or before first2, as in
+// hxMergeSort.  See hxInsertionSort for the compare parameter.
+
+// Returns the first element of [first, last) that is not ordered before value.
+// Or with IsUpper, the first element that value is ordered before.
+template<bool IsUpper_, typename T_, typename Compare_>
+HX_INLINE const T_* hxMergeGallop(const T_* first_, const T_* last_, const T_& value_,
+		const Compare_& compare_) {
+	uint32_t size_ = (uint32_t)(last_ - first_);
+	uint32_t lo_ = 0u;
+	uint32_t step_ = 1u;
+	while (step_ <= size_ - lo_ && (IsUpper_ ? !compare_(value_, first_[lo_ + step_ - 1u])
+			: compare_(first_[lo_ + step_ - 1u], value_))) {
+		lo_ += step_;
+		step_ <<= 1;
+	}
+	uint32_t hi_ = hxMin(lo_ + step_ - 1u, size_);
+	while (lo_ < hi_) {
+		uint32_t mid_ = lo_ + ((hi_ - lo_) >> 1);
+		if (IsUpper_ ? !compare_(value_, first_[mid_]) : compare_(first_[mid_], value_)) {
+			lo_ = mid_ + 1u;
+		}
+		else {
+			hi_ = mid_;
+		}
+	}
+	return first_ + lo_;
+}
+
+template<typename T_, typename Compare_>
+T_* hxMerge(const T_* first1_, const T_* last1_, const T_* first2_, const T_* last2_,
+		T_* out_, const Compare_& compare_) {
+	uint32_t count1_ = 0u;
+	uint32_t count2_ = 0u;
+	while (first1_ != last1_ && first2_ != last2_) {
+		if (compare_(*first2_, *first1_)) {
+			*out_++ = *first2_++;
+			count1_ = 0u;
+			if (++count2_ == HX_SORT_GALLOP_SIZE && first2_ != last2_) {
+				const T_* end_ = hxMergeGallop<false>(first2_, last2_, *first1_, compare_);
+				::memmove((void*)out_, (const void*)first2_, (size_t)(end_ - first2_) * sizeof(T_));
+				out_ += end_ - first2_;
+				first2_ = end_;
+				count2_ = 0u;
+			}
+		}
+		else {
+			*out_++ = *first1_++;
+			count2_ = 0u;
+			if (++count1_ == HX_SORT_GALLOP_SIZE && first1_ != last1_) {
+				const T_* end_ = hxMergeGallop<true>(first1_, last1_, *first2_, compare_);
+				::memmove((void*)out_, (const void*)first1_, (size_t)(end_ - first1_) * sizeof(T_));
+				out_ += end_ - first1_;
+				first1_ = end_;
+				count1_ = 0u;
+			}
+		}
+	}
+	::memmove((void*)out_, (const void*)first1_, (size_t)(last1_ - first1_) * sizeof(T_));
+	out_ += last1_ - first1_;
+	if (out_ != first2_) {
+		::memmove((void*)out_, (const void*)first2_, (size_t)(last2_ - first2_) * sizeof(T_));
+	}
+	return out_ + (last2_ - first2_);
+}
+
+// A specialization of hxMerge using hxLess.
+template<typename T_>
+HX_INLINE T_* hxMerge(const T_* first1_, const T_* last1_, const T_* first2_, const T_* last2_,
+		T_* out_) {
+	return hxMerge(first1_, last1_, first2_, last2_, out_, hxLess());
+}
+
+// ----------------------------------------------------------------------------
+// hxMergeSort
+//
+// Stable sort of the elements in the range [first, last) in comparison order
+// using merge sort.  Allocates half the size of the array from tempMemory.
+// Runs smaller than HX_SORT_MIN_SIZE use hxSortSmall() and are combined with
+// hxMerge().  T is moved with
+// memcpy and assignment.  See hxInsertionSort for the compare parameter.
+
+template<typename T_, typename Compare_>
+void hxMergeSortRecurse(T_* first_, T_* last_, const Compare_& compare_, T_* HX_RESTRICT buffer_) {
+	uint32_t size_ = (uint32_t)(last_ - first_);
+	if (size_ < HX_SORT_MIN_SIZE) {
+		hxSortSmall(first_, last_, compare_);
+		return;
+	}
+	T_* mid_ = first_ + size_ / 2u;
+	hxMergeSortRecurse(first_, mid_, compare_, buffer_);
+	hxMergeSortRecurse(mid_, last_, compare_, buffer_);
+	if (!compare_(*mid_, *(mid_ - 1))) {
+		return; // Already in order.
+	}
+
+	// Merge the left half from the buffer.  The right half is in place.
+	uint32_t sizeL_ = size_ / 2u;
+	::memcpy((void*)buffer_, (const void*)first_, sizeL_ * sizeof(T_));
+	hxMerge(buffer_, buffer_ + sizeL_, mid_, last_, first_, compare_);
+}
+
+template<typename T_, typename Compare_>
+void hxMergeSort(T_* first_, T_* last_, const Compare_& compare_, hxMemoryManagerId tempMemory_) {
+	uint32_t size_ = (uint32_t)(last_ - first_);
+	if (size_ < HX_SORT_MIN_SIZE) {
+		hxSortSmall(first_, last_, compare_);
+		return;
+	}
+	hxMemoryManagerScope allocatorScope_(tempMemory_);
+	T_* buffer_ = (T_*)hxMalloc(size_ / 2u * sizeof(T_));
+	hxMergeSortRecurse(first_, last_, compare_, buffer_);
+	hxFree(buffer_);
+}
+
+// A specialization of hxMergeSort using hxLess.
+template<typename T_>
+HX_INLINE void hxMergeSort(T_* first_, T_* last_, hxMemoryManagerId tempMemory_) {
+	hxMergeSort(first_, last_, hxLess(), tempMemory_);
+}
+
+// ----------------------------------------------------------------------------
+// hxMergeRuns
+//
+// Stable merge of count sorted runs [firsts[i], lasts[i]) into out.  Returns
+// the end of the output.  Equal elements are taken from the lower numbered run
+// first.  Uses a loser tree, which is O(n log k) for n elements in k runs and
+// replays one leaf to root path of log k comparisons per element.  A run that
+// is used up is removed and the tree rebuilt, which keeps end of run checks
+// out of the comparisons.  The last two runs use hxMerge().  Allocates O(k)
+// from tempMemory.  T is moved with memcpy and assignment.  See
+// hxInsertionSort for the compare parameter.
+
+// Returns true if the next element of run a is ordered before that of run b.
+// Ties go to the lower run.
+template<typename T_, typename Compare_>
+HX_INLINE bool hxMergeRunsBefore(uint32_t a_, uint32_t b_, const T_* const* cursors_,
+		const Compare_& compare_) {
+	return a_ < b_ ? !compare_(*cursors_[b_], *cursors_[a_]) : compare_(*cursors_[a_], *cursors_[b_]);
+}
+
+template<typename T_, typename Compare_>
+T_* hxMergeRuns(const T_* const* firsts_, const T_* const* lasts_, uint32_t count_, T_* out_,
+		const Compare_& compare_, hxMemoryManagerId tempMemory_) {
+	hxMemoryManagerScope allocatorScope_(tempMemory_);
+	const T_** cursors_ = (const T_**)hxMalloc(count_ * (2u * sizeof(const T_*) + 2u * sizeof(uint32_t)) + 1u);
+	const T_** ends_ = cursors_ + count_;
+	uint32_t* losers_ = (uint32_t*)(ends_ + count_);
+	uint32_t* winners_ = losers_ + count_;
+
+	// Keep the non-empty runs in order.
+	uint32_t size_ = 0u;
+	for (uint32_t i_ = 0u; i_ < count_; ++i_) {
+		if (firsts_[i_] != lasts_[i_]) {
+			cursors_[size_] = firsts_[i_];
+			ends_[size_++] = lasts_[i_];
+		}
+	}
+	count_ = size_;
+
+	while (count_ > 2u) {
+		// Internal node j has children 2j and 2j + 1.  Leaf i is node count + i.
+		for (uint32_t node_ = count_ - 1u; node_ != 0u; --node_) {
+			uint32_t child_ = 2u * node_;
+			uint32_t l_ = child_ < count_ ? winners_[child_] : child_ - count_;
+			uint32_t r_ = child_ + 1u < count_ ? winners_[child_ + 1u] : child_ + 1u - count_;
+			bool isLeft_ = hxMergeRunsBefore(l_, r_, cursors_, compare_);
+			winners_[node_] = isLeft_ ? l_ : r_;
+			losers_[node_] = isLeft_ ? r_ : l_;
+		}
+
+		// Take the winner and replay its path against the losers stored there.
+		uint32_t winner_ = winners_[1];
+		for (;;) {
+			*out_++ = *cursors_[winner_]++;
+			if (cursors_[winner_] == ends_[winner_]) {
+				break;
+			}
+			for (uint32_t node_ = (winner_ + count_) >> 1; node_ != 0u; node_ >>= 1) {
+				uint32_t loser_ = losers_[node_];
+				bool isBefore_ = hxMergeRunsBefore(loser_, winner_, cursors_, compare_);
+				losers_[node_] = isBefore_ ? winner_ : loser_;
+				winner_ = isBefore_ ? loser_ : winner_;
+			}
+		}
+
+		// Remove the used up run without reordering the rest.
+		--count_;
+		for (uint32_t i_ = winner_; i_ < count_; ++i_) {
+			cursors_[i_] = cursors_[i_ + 1u];
+			ends_[i_] = ends_[i_ + 1u];
+		}
+	}
+
+	if (count_ == 2u) {
+		out_ = hxMerge(cursors_[0], ends_[0], cursors_[1], ends_[1], out_, compare_);
+	}
+	else if (count_ == 1u) {
+		::memcpy((void*)out_, (const void*)cursors_[0], (size_t)(ends_[0] - cursors_[0]) * sizeof(T_));
+		out_ += ends_[0] - cursors_[0];
+	}
+	hxFree(cursors_);
+	return out_;
+}
+
+// A specialization of hxMergeRuns using hxLess.
+template<typename T_>
+HX_INLINE T_* hxMergeRuns(const T_* const* firsts_, const T_* const* lasts_, uint32_t count_,
+		T_* out_, hxMemoryManagerId tempMemory_) {
+	return hxMergeRuns(firsts_, lasts_, count_, out_, hxLess(), tempMemory_);
+}
+
+// hxMergeArrays.  Appends the stable merge of count sorted arrays to out using
+// hxMergeRuns().  Resizes out once, so a fixed capacity or a prior reserve()
+// keeps this from allocating it.
+template<typename T_, uint32_t Capacity_, uint32_t OutCapacity_, typename Compare_>
+void hxMergeArrays(const hxArray<T_, Capacity_>* arrays_, uint32_t count_,
+		hxArray<T_, OutCapacity_>& out_, const Compare_& compare_, hxMemoryManagerId tempMemory_) {
+	uint32_t size_ = out_.size();
+	uint32_t total_ = size_;
+	for (uint32_t i_ = 0u; i_ < count_; ++i_) {
+		total_ += arrays_[i_].size();
+	}
+	out_.resize(total_);
+	if (total_ == size_) {
+		return;
+	}
+
+	hxMemoryManagerScope allocatorScope_(tempMemory_);
+	const T_** runs_ = (const T_**)hxMalloc(2u * count_ * sizeof(const T_*));
+	for (uint32_t i_ = 0u; i_ < count_; ++i_) {
+		runs_[i_] = arrays_[i_].begin();
+		runs_[count_ + i_] = arrays_[i_].end();
+	}
+	hxMergeRuns(runs_, runs_ + count_, count_, out_.data() + size_, compare_, tempMemory_);
+	hxFree(runs_);
+}
+
+// A specialization of hxMergeArrays using hxLess.
+template<typename T_, uint32_t Capacity_, uint32_t OutCapacity_>
+HX_INLINE void hxMergeArrays(const hxArray<T_, Capacity_>* arrays_, uint32_t count_,
+		hxArray<T_, OutCapacity_>& out_, hxMemoryManagerId tempMemory_) {
+	hxMergeArrays(arrays_, count_, out_, hxLess(), tempMemory_);
+}
+
+// ----------------------------------------------------------------------------
+// hxNthElement
+//
+// Rearranges [first, last) so that nth holds the element that would be there
+// if the range were sorted.  Elements before nth are not ordered after it and
+// elements after nth are not ordered before it.  Uses the partitioning of
+// hxSort() and only continues into the side holding nth, which is O(n) on
+// average.  Falls back to hxHeapSort() like hxSort().  See hxInsertionSort for
+// the compare parameter.
+
+template<typename T_, typename Compare_>
+void hxNthElement(T_* first_, T_* nth_, T_* last_, const Compare_& compare_) {
+	if (nth_ == last_) {
+		return;
+	}
+	uint32_t badAllowed_ = 0u;
+	for (uint32_t size_ = (uint32_t)(last_ - first_); size_ > 1u; size_ >>= 1) {
+		++badAllowed_;
+	}
+	bool isLeftmost_ = true;
+	for (;;) {
+		uint32_t size_ = (uint32_t)(last_ - first_);
+		if (size_ < HX_SORT_MIN_SIZE) {
+			hxSortSmall(first_, last_, compare_);
+			return;
+		}
+		hxSortChoosePivot(first_, last_, compare_);
+
+		// Skip the elements equal to the previous pivot as hxSort() does.
+		if (!isLeftmost_ && !compare_(*(first_ - 1), *first_)) {
+			T_* pivot_ = hxSortPartitionLeft(first_, last_, compare_);
+			if (nth_ <= pivot_) {
+				return;
+			}
+			first_ = pivot_ + 1;
+			continue;
+		}
+
+		bool isPartitioned_;
+		T_* pivot_ = hxSortPartitionRight(first_, last_, compare_, isPartitioned_);
+		if (pivot_ == nth_) {
+			return;
+		}
+		uint32_t sizeL_ = (uint32_t)(pivot_ - first_);
+		uint32_t sizeR_ = (uint32_t)(last_ - (pivot_ + 1));
+		if ((sizeL_ < size_ / 8u || sizeR_ < size_ / 8u) && --badAllowed_ == 0u) {
+			hxHeapSort(first_, last_, compare_);
+			return;
+		}
+		if (nth_ < pivot_) {
+			last_ = pivot_;
+		}
+		else {
+			first_ = pivot_ + 1;
+			isLeftmost_ = false;
+		}
+	}
+}
+
+// A specialization of hxNthElement using hxLess.
+template<typename T_>
+HX_INLINE void hxNthElement(T_* first_, T_* nth_, T_* last_) {
+	hxNthElement(first_, nth_, last_, hxLess());
+}
+
+// ----------------------------------------------------------------------------
+// hxPartialSort
+//
+// Sorts the elements that belong in [first, middle) and leaves the rest of
+// [first, last) in [middle, last) in no particular order.  Uses
+// hxNthElement() and then hxSort(), which is O(n + k log k) for k = middle -
+// first.  See hxInsertionSort for the compare parameter.
+
+template<typename T_, typename Compare_>
+void hxPartialSort(T_* first_, T_* middle_, T_* last_, const Compare_& compare_) {
+	hxNthElement(first_, middle_, last_, compare_);
+	hxSort(first_, middle_, compare_);
+}
+
+// A specialization of hxPartialSort using hxLess.
+template<typename T_>
+HX_INLINE void hxPartialSort(T_* first_, T_* middle_, T_* last_) {
+	hxPartialSort(first_, middle_, last_, hxLess());
+}
+
+// ----------------------------------------------------------------------------
+// hxTopK
+//
+// Keeps the first k elements in comparison order from a stream of elements.
+// Use hxGreater to keep the largest.  The kept elements are a heap with the
+// last of them on top, so a rejected element costs one comparison and a kept
+// element O(log k).  Allocates k elements from the current memory manager
+// unless Capacity is fixed as with hxArray.  See hxInsertionSort for the
+// compare parameter.
+
+template<typename T_, typename Compare_=hxLess, uint32_t Capacity_=hxAllocatorDynamicCapacity>
+class hxTopK {
+public:
+	typedef T_ T;
+
+	HX_INLINE explicit hxTopK(uint32_t k_, const Compare_& compare_=Compare_())
+			: m_compare(compare_), m_k(k_) {
+		m_heap.reserve(k_);
+	}
+
+	HX_INLINE void push(const T& x_) {
+		if (m_heap.size() < m_k) {
+			m_heap.push_back(x_);
+			siftUp_();
+		}
+		else if (m_k != 0u && m_compare(x_, m_heap[0])) {
+			m_heap[0] = x_;
+			hxHeapSift(m_heap.data(), 0u, m_k, m_compare);
+		}
+	}
+
+	HX_INLINE void push(const T* first_, const T* last_) {
+		for (; first_ != last_; ++first_) {
+			push(*first_);
+		}
+	}
+
+	// Returns the last kept element.  Once full this is the k-th element.
+	HX_INLINE const T& top() const { return m_heap.front(); }
+
+	// The kept elements in heap order until sort() is called.
+	HX_INLINE const T* begin() const { return m_heap.begin(); }
+	HX_INLINE const T* end() const { return m_heap.end(); }
+
+	// Sorts the kept elements in comparison order.  No elements may be pushed
+	// after sorting until clear() is called.
+	HX_INLINE void sort() { hxSort(m_heap.begin(), m_heap.end(), m_compare); }
+
+	HX_INLINE uint32_t size() const { return m_heap.size(); }
+	HX_INLINE bool empty() const { return m_heap.empty(); }
+	HX_INLINE void clear() { m_heap.clear(); }
+
+private:
+	hxTopK(const hxTopK&); // = delete
+	void operator=(const hxTopK&); // = delete
+
+	HX_INLINE void siftUp_() {
+		T* heap_ = m_heap.data();
+		uint32_t i_ = m_heap.size() - 1u;
+		T t_ = heap_[i_];
+		while (i_ != 0u) {
+			uint32_t parent_ = (i_ - 1u) / 2u;
+			if (!m_compare(heap_[parent_], t_)) {
+				break;
+			}
+			heap_[i_] = heap_[parent_];
+			i_ = parent_;
+		}
+		heap_[i_] = t_;
+	}
+
+	hxArray<T, Capacity_> m_heap;
+	Compare_ m_compare;
+	uint32_t m_k;
+};
+
+// ----------------------------------------------------------------------------
+// hxRadixSortKey
+//
+// Function object mapping a key to an unsigned integer Key with the same
+// order.  Storage is the key type used by hxRadixSort<K, V>.  Signed integers
+// add INT_MIN.  Floating point values flip all the bits when the sign bit is
+// set and only the sign bit otherwise.
+
+// Arithmetic right shift i >> 31 can be implemented with a negative unsigned
+// right shift: -(u >> 31).
+HX_STATIC_ASSERT((int32_t)0x80000000u >> 31 == ~(int32_t)0, "arithmetic right shift expected");
+
+template<typename T_> struct hxRadixSortKey;
+
+template<> struct hxRadixSortKey<uint8_t> {
+	typedef uint8_t Key;
+	typedef uint32_t Storage;
+	HX_INLINE Key operator()(uint8_t x_) const { return x_; }
+};
+
+template<> struct hxRadixSortKey<uint16_t> {
+	typedef uint16_t Key;
+	typedef uint32_t Storage;
+	HX_INLINE Key operator()(uint16_t x_) const { return x_; }
+};
+
+template<> struct hxRadixSortKey<uint32_t> {
+	typedef uint32_t Key;
+	typedef uint32_t Storage;
+	HX_INLINE Key operator()(uint32_t x_) const { return x_; }
+};
+
+template<> struct hxRadixSortKey<uint64_t> {
+	typedef uint64_t Key;
+	typedef uint64_t Storage;
+	HX_INLINE Key operator()(uint64_t x_) const { return x_; }
+};
+
+template<> struct hxRadixSortKey<int8_t> {
+	typedef uint8_t Key;
+	typedef uint32_t Storage;
+	HX_INLINE Key operator()(int8_t x_) const { return (Key)((Key)x_ ^ 0x80u); }
+};
+
+template<> struct hxRadixSortKey<int16_t> {
+	typedef uint16_t Key;
+	typedef uint32_t Storage;
+	HX_INLINE Key operator()(int16_t x_) const { return (Key)((Key)x_ ^ 0x8000u); }
+};
+
+template<> struct hxRadixSortKey<int32_t> {
+	typedef uint32_t Key;
+	typedef uint32_t Storage;
+	HX_INLINE Key operator()(int32_t x_) const { return (Key)x_ ^ 0x80000000u; }
+};
+
+template<> struct hxRadixSortKey<int64_t> {
+	typedef uint64_t Key;
+	typedef uint64_t Storage;
+	HX_INLINE Key operator()(int64_t x_) const { return (Key)x_ ^ ((Key)1u << 63); }
+};
+
+template<> struct hxRadixSortKey<float> {
+	typedef uint32_t Key;
+	typedef uint32_t Storage;
+	HX_INLINE Key operator()(float x_) const {
+		// Support strict aliasing.  And expect memcpy to inline fully.
+		int32_t t_;
+		::memcpy(&t_, &x_, 4);
+		return (Key)(t_ ^ ((t_ >> 31) | (int32_t)0x80000000u));
+	}
+};
+
+template<> struct hxRadixSortKey<double> {
+	typedef uint64_t Key;
+	typedef uint64_t Storage;
+	HX_INLINE Key operator()(double x_) const {
+		int64_t t_;
+		::memcpy(&t_, &x_, 8);
+		return (Key)t_ ^ ((Key)(t_ >> 63) | ((Key)1u << 63));
+	}
+};
+
+// ----------------------------------------------------------------------------
+// hxRadixSortScatter
+//
+// Scatters [begin, end) to dst[hist[digit]++].  When lines is non-null each
+// bucket collects its keys in a cache line sized buffer that is written to dst
+// once full.  Full lines are written with non-temporal stores when
+// HX_USE_STREAMING_STORES.  This avoids reading destination lines and keeps
+// the TLB from thrashing when the array is larger than the cache.  lines is
+// HX_CACHE_LINE_SIZE aligned with a line per bucket.  starts has a count per
+// bucket.  sizeof(T) must divide HX_CACHE_LINE_SIZE.
+
+template<typename T_>
+HX_INLINE void hxRadixSortWriteLine(T_* dst_, const T_* line_, bool isAligned_) {
+#if HX_USE_STREAMING_STORES
+	if (isAligned_) {
+		for (uint32_t i_ = 0u; i_ < HX_CACHE_LINE_SIZE; i_ += 16u) {
+			_mm_stream_si128((__m128i*)((char*)dst_ + i_), _mm_load_si128((const __m128i*)((const char*)line_ + i_)));
+		}
+		return;
+	}
+#endif
+	(void)isAligned_;
+	::memcpy((void*)dst_, (const void*)line_, HX_CACHE_LINE_SIZE);
+}
+
+template<typename T_, typename KeyFn_>
+void hxRadixSortScatter(const T_* begin_, const T_* end_, T_* HX_RESTRICT dst_, uint32_t* HX_RESTRICT hist_,
+		uint32_t shift_, const KeyFn_& keyFn_, T_* HX_RESTRICT lines_, uint32_t* HX_RESTRICT starts_) {
+	const uint32_t mask_ = (1u << HX_RADIX_SORT_BITS) - 1u;
+	if (!lines_) {
+		for (const T_* HX_RESTRICT it_ = begin_; it_ != end_; ++it_) {
+			dst_[hist_[(uint32_t)(keyFn_(*it_) >> shift_) & mask_]++] = *it_;
+		}
+		return;
+	}
+
+	// Slots in each line buffer correspond to the destination line.  phase is
+	// the slot of dst[0].
+	const uint32_t perLine_ = HX_CACHE_LINE_SIZE / (uint32_t)sizeof(T_);
+	const uint32_t phase_ = (uint32_t)((uintptr_t)dst_ / sizeof(T_)) & (perLine_ - 1u);
+	const bool isAligned_ = ((uintptr_t)dst_ & (sizeof(T_) - 1u)) == 0u;
+	::memcpy(starts_, hist_, (mask_ + 1u) * sizeof(uint32_t));
+
+	for (const T_* HX_RESTRICT it_ = begin_; it_ != end_; ++it_) {
+		uint32_t bucket_ = (uint32_t)(keyFn_(*it_) >> shift_) & mask_;
+		uint32_t index_ = hist_[bucket_]++;
+		uint32_t slot_ = (index_ + phase_) & (perLine_ - 1u);
+		T_* HX_RESTRICT line_ = lines_ + bucket_ * perLine_;
+		line_[slot_] = *it_;
+		if (slot_ == perLine_ - 1u) {
+			// The first line of a bucket may start in the previous bucket.
+			uint32_t count_ = index_ + 1u - starts_[bucket_];
+			if (count_ >= perLine_) {
+				hxRadixSortWriteLine(dst_ + index_ + 1u - perLine_, line_, isAligned_);
+			}
+			else {
+				::memcpy((void*)(dst_ + starts_[bucket_]), (const void*)(line_ + perLine_ - count_), count_ * sizeof(T_));
+			}
+		}
+	}
+
+	// Write partial lines.
+	for (uint32_t bucket_ = 0u; bucket_ <= mask_; ++bucket_) {
+		uint32_t index_ = hist_[bucket_];
+		uint32_t count_ = hxMin((index_ + phase_) & (perLine_ - 1u), index_ - starts_[bucket_]);
+		if (count_ != 0u) {
+			::memcpy((void*)(dst_ + index_ - count_), (const void*)(lines_ + bucket_ * perLine_
+				+ ((index_ - count_ + phase_) & (perLine_ - 1u))), count_ * sizeof(T_));
+		}
+	}
+#if HX_USE_STREAMING_STORES
+	_mm_sfence(); // Order non-temporal stores before the array is read.
+#endif
+}
+
+// Returns whether hxRadixSortScatter() should buffer writes for size T.
+template<typename T_>
+HX_INLINE bool hxRadixSortIsWriteCombining(uint32_t size_) {
+	return (size_t)size_ * sizeof(T_) >= HX_RADIX_SORT_WRITE_COMBINE_BYTES
+		&& sizeof(T_) * 2u <= HX_CACHE_LINE_SIZE && (HX_CACHE_LINE_SIZE % sizeof(T_)) == 0u;
+}
+
+// ----------------------------------------------------------------------------
+// hxRadixSortLsd
+//
+// Stable least significant digit radix sort of T by the unsigned integer
+// returned by KeyFn, which must declare that type as KeyFn::Key.  Sorts
+// HX_RADIX_SORT_BITS bits per pass and skips passes where every key has the
+// same digit.  Uses hxRadixSortSmall() below HX_RADIX_SORT_MIN_SIZE.  T is
+// moved with memcpy and assignment.  Allocates a histogram and one or two
+// copies of the array from tempMemory.  Uses write combining buffers when
+// hxRadixSortIsWriteCombining().  See hxRadixSortMsd() for an in-place sort.
+
+template<typename T_, typename KeyFn_>
+struct hxRadixSortKeyLess {
+	HX_INLINE hxRadixSortKeyLess(const KeyFn_& keyFn_) : m_keyFn(keyFn_) { }
+	HX_INLINE bool operator()(const T_& lhs_, const T_& rhs_) const { return m_keyFn(lhs_) < m_keyFn(rhs_); }
+	KeyFn_ m_keyFn;
+};
+
+// Sorts ranges smaller than HX_RADIX_SORT_MIN_SIZE.  Keys of uint32_t and
+// float use hxSortNetwork() when it is vectorized.
+template<typename T_, typename KeyFn_>
+HX_INLINE void hxRadixSortSmall(T_* first_, T_* last_, const KeyFn_& keyFn_) {
+	hxInsertionSort(first_, last_, hxRadixSortKeyLess<T_, KeyFn_>(keyFn_));
+}
+
+#if HX_USE_SSE4_1
+HX_STATIC_ASSERT(HX_RADIX_SORT_MIN_SIZE <= HX_SORT_NETWORK_MAX_SIZE, "HX_SORT_NETWORK_MAX_SIZE too small");
+HX_INLINE void hxRadixSortSmall(uint32_t* first_, uint32_t* last_, const hxRadixSortKey<uint32_t>& keyFn_) {
+	(void)keyFn_;
+	hxSortNetwork(first_, last_);
+}
+HX_INLINE void hxRadixSortSmall(float* first_, float* last_, const hxRadixSortKey<float>& keyFn_) {
+	(void)keyFn_;
+	hxSortNetwork(first_, last_);
+}
+#endif
+
+// Counts the digits of a key starting with Digit.  Unrolled with templates
+// because compilers do not reliably unroll the loop.
+template<uint32_t Digit_, uint32_t Digits_>
+struct hxRadixSortCountDigits {
+	template<typename Key_>
+	static HX_INLINE void count(uint32_t* HX_RESTRICT histograms_, Key_ key_) {
+		++histograms_[(Digit_ << HX_RADIX_SORT_BITS) + ((uint32_t)(key_ >> (Digit_ * HX_RADIX_SORT_BITS))
+			& ((1u << HX_RADIX_SORT_BITS) - 1u))];
+		hxRadixSortCountDigits<Digit_ + 1u, Digits_>::count(histograms_, key_);
+	}
+};
+
+template<uint32_t Digits_>
+struct hxRadixSortCountDigits<Digits_, Digits_> {
+	template<typename Key_>
+	static HX_INLINE void count(uint32_t* HX_RESTRICT histograms_, Key_ key_) { (void)histograms_; (void)key_; }
+};
+
+template<typename T_, typename KeyFn_>
+void hxRadixSortLsd(T_* first_, T_* last_, const KeyFn_& keyFn_, hxMemoryManagerId tempMemory_) {
+	typedef typename KeyFn_::Key Key;
+	const uint32_t buckets_ = 1u << HX_RADIX_SORT_BITS;
+	const uint32_t mask_ = buckets_ - 1u;
+	const uint32_t digits_ = ((uint32_t)sizeof(Key) * 8u + HX_RADIX_SORT_BITS - 1u) / HX_RADIX_SORT_BITS;
+
+	uint32_t size_ = (uint32_t)(last_ - first_);
+	if (size_ < HX_RADIX_SORT_MIN_SIZE) {
+		hxRadixSortSmall(first_, last_, keyFn_);
+		return;
+	}
+
+	hxMemoryManagerScope allocatorScope_(tempMemory_);
+
+	// Build all histograms in one read.
+	uint32_t* HX_RESTRICT histograms_ = (uint32_t*)hxMalloc(digits_ * buckets_ * sizeof(uint32_t));
+	::memset(histograms_, 0x00, digits_ * buckets_ * sizeof(uint32_t));
+	for (const T_* HX_RESTRICT it_ = first_; it_ != last_; ++it_) {
+		hxRadixSortCountDigits<0u, ((uint32_t)sizeof(Key) * 8u + HX_RADIX_SORT_BITS - 1u) / HX_RADIX_SORT_BITS>
+			::count(histograms_, keyFn_(*it_));
+	}
+
+	// Convert histograms to start indices.  Skip digits where the first key's
+	// bucket holds every key.
+	uint32_t passes_[(sizeof(Key) * 8u + HX_RADIX_SORT_BITS - 1u) / HX_RADIX_SORT_BITS];
+	uint32_t passCount_ = 0u;
+	Key firstKey_ = keyFn_(*first_);
+	for (uint32_t i_ = 0u; i_ < digits_; ++i_) {
+		uint32_t* HX_RESTRICT hist_ = histograms_ + i_ * buckets_;
+		if (hist_[(uint32_t)(firstKey_ >> (i_ * HX_RADIX_SORT_BITS)) & mask_] != size_) {
+			passes_[passCount_++] = i_;
+			uint32_t sum_ = 0u;
+			for (uint32_t j_ = 0u; j_ < buckets_; ++j_) {
+				uint32_t t_ = hist_[j_] + sum_; hist_[j_] = sum_; sum_ = t_;
+			}
+		}
+	}
+
+	if (passCount_ != 0u) {
+		// An even number of passes ping-pongs between the array and buf1.  An
+		// odd number rotates through buf1 and buf2 back to the array.  A single
+		// pass copies the array to buf1 first.
+		T_* buf1_ = (T_*)hxMalloc(size_ * sizeof(T_) * ((passCount_ & 1u) ? 2u : 1u));
+		T_* buf2_ = buf1_ + size_;
+		T_* src_ = first_;
+		if (passCount_ == 1u) {
+			::memcpy((void*)buf1_, (const void*)first_, size_ * sizeof(T_));
+			src_ = buf1_;
+		}
+
+		// Buffer scattered writes when the array is larger than the cache.
+		T_* lines_ = hxnull;
+		uint32_t* starts_ = hxnull;
+		if (hxRadixSortIsWriteCombining<T_>(size_)) {
+			lines_ = (T_*)hxMallocExt(buckets_ * HX_CACHE_LINE_SIZE, hxMemoryManagerId_Current, HX_CACHE_LINE_SIZE - 1u);
+			starts_ = (uint32_t*)hxMalloc(buckets_ * sizeof(uint32_t));
+		}
+
+		for (uint32_t pass_ = 0u; pass_ < passCount_; ++pass_) {
+			T_* HX_RESTRICT dst_ = (pass_ + 1u == passCount_) ? first_
+				: (passCount_ & 1u) ? ((src_ == buf1_) ? buf2_ : buf1_)
+				: ((src_ == first_) ? buf1_ : first_);
+			hxRadixSortScatter(src_, src_ + size_, dst_, histograms_ + passes_[pass_] * buckets_,
+				passes_[pass_] * HX_RADIX_SORT_BITS, keyFn_, lines_, starts_);
+			src_ = dst_;
+		}
+
+		if (lines_) {
+			hxFree(starts_);
+			hxFree(lines_);
+		}
+		hxFree(buf1_);
+	}
+	hxFree(histograms_);
+}
+
+// ----------------------------------------------------------------------------
+// hxRadixSortKeys
+//
+// Sorts an array of keys in place without values.  Keys may be 8, 16, 32 or
+// 64-bit integers, float or double.  Moves half the memory of hxRadixSort
+// when the keys are all that is needed.
+
+template<typename T_>
+HX_INLINE void hxRadixSortKeys(T_* first_, T_* last_, hxMemoryManagerId tempMemory_) {
+	hxRadixSortLsd(first_, last_, hxRadixSortKey<T_>(), tempMemory_);
+}
+
+// ----------------------------------------------------------------------------
+// hxRadixSortMsd
+//
+// In-place most significant digit radix sort of T by KeyFn (American flag
+// sort.)  Allocates no memory and uses about 1 KB of stack per byte of Key.
+// Sorts 8 bits per level independent of HX_RADIX_SORT_BITS to bound stack
+// use.  Buckets with fewer than HX_RADIX_SORT_MIN_SIZE elements are finished
+// with hxRadixSortSmall().  Not stable.  Use when temporary memory cannot hold
+// a copy of the array, otherwise hxRadixSortLsd() is faster.
+
+// Moves [first, last) into buckets by the 8-bit digit at shift and sets the
+// end index of each bucket.  Returns false without moving anything when the
+// first key's bucket holds every key.
+template<typename T_, typename KeyFn_>
+bool hxRadixSortMsdPermute(T_* first_, T_* last_, const KeyFn_& keyFn_, uint32_t shift_, uint32_t* ends_) {
+	uint32_t size_ = (uint32_t)(last_ - first_);
+	::memset(ends_, 0x00, 256u * sizeof(uint32_t));
+	for (const T_* HX_RESTRICT it_ = first_; it_ != last_; ++it_) {
+		++ends_[(uint32_t)(keyFn_(*it_) >> shift_) & 0xffu];
+	}
+	if (ends_[(uint32_t)(keyFn_(*first_) >> shift_) & 0xffu] == size_) {
+		return false;
+	}
+
+	uint32_t heads_[256];
+	uint32_t sum_ = 0u;
+	for (uint32_t i_ = 0u; i_ < 256u; ++i_) {
+		heads_[i_] = sum_;
+		sum_ += ends_[i_];
+		ends_[i_] = sum_;
+	}
+
+	// Swap each element into the next free slot of its bucket until the element
+	// in hand belongs to the bucket being filled.
+	for (uint32_t i_ = 0u; i_ < 256u; ++i_) {
+		while (heads_[i_] != ends_[i_]) {
+			T_ t_ = first_[heads_[i_]];
+			uint32_t digit_ = (uint32_t)(keyFn_(t_) >> shift_) & 0xffu;
+			while (digit_ != i_) {
+				T_ u_ = first_[heads_[digit_]];
+				first_[heads_[digit_]++] = t_;
+				t_ = u_;
+				digit_ = (uint32_t)(keyFn_(t_) >> shift_) & 0xffu;
+			}
+			first_[heads_[i_]++] = t_;
+		}
+	}
+	return true;
+}
+
+template<typename T_, typename KeyFn_>
+void hxRadixSortMsdDigit(T_* first_, T_* last_, const KeyFn_& keyFn_, uint32_t shift_) {
+	uint32_t size_ = (uint32_t)(last_ - first_);
+	if (size_ < HX_RADIX_SORT_MIN_SIZE) {
+		hxRadixSortSmall(first_, last_, keyFn_);
+		return;
+	}
+
+	// Skip digits where every key is in one bucket.
+	uint32_t ends_[256];
+	while (!hxRadixSortMsdPermute(first_, last_, keyFn_, shift_, ends_)) {
+		if (shift_ == 0u) {
+			return;
+		}
+		shift_ -= 8u;
+	}
+
+	if (shift_ != 0u) {
+		uint32_t begin_ = 0u;
+		for (uint32_t i_ = 0u; i_ < 256u; ++i_) {
+			if (ends_[i_] - begin_ > 1u) {
+				hxRadixSortMsdDigit(first_ + begin_, first_ + ends_[i_], keyFn_, shift_ - 8u);
+			}
+			begin_ = ends_[i_];
+		}
+	}
+}
+
+template<typename T_, typename KeyFn_>
+HX_INLINE void hxRadixSortMsd(T_* first_, T_* last_, const KeyFn_& keyFn_) {
+	hxRadixSortMsdDigit(first_, last_, keyFn_, (uint32_t)sizeof(typename KeyFn_::Key) * 8u - 8u);
+}
+
+// Sorts an array of keys in place with hxRadixSortMsd().  See hxRadixSortKeys.
+template<typename T_>
+HX_INLINE void hxRadixSortKeysInPlace(T_* first_, T_* last_) {
+	hxRadixSortMsd(first_, last_, hxRadixSortKey<T_>());
+}
+
+// ----------------------------------------------------------------------------
+// hxRadixSelect
+//
+// Rearranges [first, last) like hxNthElement() using the buckets of
+// hxRadixSortMsd() and only continuing into the bucket holding nth.  O(n) for
+// every input and allocates no memory.  KeyFn is as for hxRadixSortLsd().
+
+template<typename T_, typename KeyFn_>
+void hxRadixSelect(T_* first_, T_* nth_, T_* last_, const KeyFn_& keyFn_) {
+	if (nth_ == last_) {
+		return;
+	}
+	uint32_t ends_[256];
+	for (uint32_t shift_ = (uint32_t)sizeof(typename KeyFn_::Key) * 8u - 8u;; shift_ -= 8u) {
+		if ((uint32_t)(last_ - first_) < HX_RADIX_SORT_MIN_SIZE) {
+			hxRadixSortSmall(first_, last_, keyFn_);
+			return;
+		}
+		if (hxRadixSortMsdPermute(first_, last_, keyFn_, shift_, ends_)) {
+			uint32_t index_ = (uint32_t)(nth_ - first_);
+			uint32_t bucket_ = 0u;
+			while (ends_[bucket_] <= index_) {
+				++bucket_;
+			}
+			last_ = first_ + ends_[bucket_];
+			first_ += (bucket_ != 0u) ? ends_[bucket_ - 1u] : 0u;
+		}
+		if (shift_ == 0u) {
+			return;
+		}
+	}
+}
+
+// Selects from an array of keys.  See hxRadixSortKeys.
+template<typename T_>
+HX_INLINE void hxRadixSelectKeys(T_* first_, T_* nth_, T_* last_) {
+	hxRadixSelect(first_, nth_, last_, hxRadixSortKey<T_>());
+}
+
+// ----------------------------------------------------------------------------
+// hxRadixSortRecords
+//
+// Stable radix sort of records of type T by a key read from each record.  The
+// records themselves are moved by hxRadixSortLsd(), so the results are
+// sequential in memory instead of behind the pointers of hxRadixSort<K, V>.
+// KeyFn returns a key of any type supported by hxRadixSortKey and must declare
+// that type as KeyFn::Key.  A pointer to a data member of T may be passed
+// instead.  Every pass moves whole records, so for large records
+// hxRadixSortIndices() moves less memory.
+
+// Maps the key returned by KeyFn with hxRadixSortKey.
+template<typename T_, typename KeyFn_>
+struct hxRadixSortRecordKey {
+	typedef typename hxRadixSortKey<typename KeyFn_::Key>::Key Key;
+	HX_INLINE hxRadixSortRecordKey(const KeyFn_& keyFn_) : m_keyFn(keyFn_) { }
+	HX_INLINE Key operator()(const T_& x_) const { return hxRadixSortKey<typename KeyFn_::Key>()(m_keyFn(x_)); }
+	KeyFn_ m_keyFn;
+};
+
+// Reads a data member as the key.
+template<typename T_, typename K_>
+struct hxRadixSortMemberKey {
+	typedef K_ Key;
+	HX_INLINE hxRadixSortMemberKey(K_ T_::* member_) : m_member(member_) { }
+	HX_INLINE K_ operator()(const T_& x_) const { return x_.*m_member; }
+	K_ T_::* m_member;
+};
+
+template<typename T_, typename KeyFn_>
+HX_INLINE void hxRadixSortRecords(T_* first_, T_* last_, const KeyFn_& keyFn_, hxMemoryManagerId tempMemory_) {
+	hxRadixSortLsd(first_, last_, hxRadixSortRecordKey<T_, KeyFn_>(keyFn_), tempMemory_);
+}
+
+template<typename T_, typename K_>
+HX_INLINE void hxRadixSortRecords(T_* first_, T_* last_, K_ T_::* member_, hxMemoryManagerId tempMemory_) {
+	hxRadixSortRecords(first_, last_, hxRadixSortMemberKey<T_, K_>(member_), tempMemory_);
+}
+
+// ----------------------------------------------------------------------------
+// hxRadixSortIndices
+//
+// Stable sort of the array of uint32_t indices [first, last) by the keys of
+// records[index], leaving the records where they are.  Sorts pairs of a key
+// and an index, which are half the size of the key and pointer pairs of
+// hxRadixSort<K, V> for 32-bit keys on 64-bit targets.  Each record is read
+// once.  Allocates the pairs from tempMemory in addition to the memory used by
+// hxRadixSortLsd().  KeyFn is as for hxRadixSortRecords().
+
+template<typename Key_>
+struct hxRadixSortKeyIndex {
+	Key_ m_key;
+	uint32_t m_index;
+};
+
+template<typename Key_>
+struct hxRadixSortKeyIndexKey {
+	typedef Key_ Key;
+	HX_INLINE Key_ operator()(const hxRadixSortKeyIndex<Key_>& x_) const { return x_.m_key; }
+};
+
+template<typename T_, typename KeyFn_>
+void hxRadixSortIndices(const T_* records_, uint32_t* first_, uint32_t* last_, const KeyFn_& keyFn_,
+		hxMemoryManagerId tempMemory_) {
+	typedef hxRadixSortRecordKey<T_, KeyFn_> RecordKey;
+	typedef hxRadixSortKeyIndex<typename RecordKey::Key> KeyIndex;
+	uint32_t size_ = (uint32_t)(last_ - first_);
+	if (size_ <= 1u) {
+		return;
+	}
+	RecordKey recordKey_(keyFn_);
+	hxMemoryManagerScope allocatorScope_(tempMemory_);
+	KeyIndex* pairs_ = (KeyIndex*)hxMalloc(size_ * sizeof(KeyIndex));
+	for (uint32_t i_ = 0u; i_ < size_; ++i_) {
+		pairs_[i_].m_key = recordKey_(records_[first_[i_]]);
+		pairs_[i_].m_index = first_[i_];
+	}
+	hxRadixSortLsd(pairs_, pairs_ + size_, hxRadixSortKeyIndexKey<typename RecordKey::Key>(), tempMemory_);
+	for (uint32_t i_ = 0u; i_ < size_; ++i_) {
+		first_[i_] = pairs_[i_].m_index;
+	}
+	hxFree(pairs_);
+}
+
+template<typename T_, typename K_>
+HX_INLINE void hxRadixSortIndices(const T_* records_, uint32_t* first_, uint32_t* last_, K_ T_::* member_,
+		hxMemoryManagerId tempMemory_) {
+	hxRadixSortIndices(records_, first_, last_, hxRadixSortMemberKey<T_, K_>(member_), tempMemory_);
+}
+
 // ----------------------------------------------------------------------------
 // hxRadixSortBase.  Operations that are independent of hxRadixSort type.
+// Storage is uint32_t or uint64_t.
 //
 // See hxRadixSort<K, V> below.
 
+template<typename Storage_>
 class hxRadixSortBase {
 public:
-	// Arithmetic left shift i >> 31 can be implemented with a negative unsigned
-	// left shift: -(u >> 31). 
-	HX_STATIC_ASSERT((int32_t)0x80000000u >> 31 == ~(int32_t)0, "arithmetic left shift expected");
-
 	HX_INLINE void reserve(uint32_t sz_) { m_array.reserve(sz_); }
 	HX_INLINE void clear() { m_array.clear(); }
-	void sort(hxMemoryManagerId tempMemory_);
+	HX_INLINE void sort(hxMemoryManagerId tempMemory_) {
+		hxRadixSortLsd(m_array.begin(), m_array.end(), KeyFn(), tempMemory_);
+	}
+
+	// Sorts HX_RADIX_SORT_TASKS chunks of the array in parallel.  Each pass
+	// counts digits per chunk, computes start indices for every chunk and then
+	// scatters the chunks in parallel.  Passes where all keys have the same digit
+	// are skipped.  Calls taskQueue->waitForAll() and must not be called from a
+	// task.  Uses sort(tempMemory) when taskQueue is null or there are fewer
+	// than HX_RADIX_SORT_PARALLEL_MIN_SIZE keys.  Temporary memory is only
+	// allocated by the calling thread.
+	void sort(hxMemoryManagerId tempMemory_, hxTaskQueue* taskQueue_);
+
+	// Sorts without temporary memory using hxRadixSortMsd().  Not stable.  For
+	// when the temporary memory budget is smaller than the array.
+	HX_INLINE void sortInPlace() {
+		hxRadixSortMsd(m_array.begin(), m_array.end(), KeyFn());
+	}
 
 protected:
 	struct KeyValuePair {
-		HX_INLINE KeyValuePair(uint8_t key_, void* val_) : m_key(key_), m_val(val_) { }
-		HX_INLINE KeyValuePair(uint16_t key_, void* val_) : m_key(key_), m_val(val_) { }
-		HX_INLINE KeyValuePair(uint32_t key_, void* val_) : m_key(key_), m_val(val_) { }
-		// key_ + INT_MIN. (same as key_ ^ INT_MIN without room to carry.)
-		HX_INLINE KeyValuePair(int32_t key_, void* val_) : m_val(val_) { m_key = (uint32_t)(key_ ^ 0x80000000); }
-		// Flip all the bits if the sign bit is set, flip only the sign otherwise.
-		HX_INLINE KeyValuePair(float key_, void* val_) : m_val(val_) {
-			// Support strict aliasing.  And expect memcpy to inline fully.  
-			int32_t t_;
-			::memcpy(&t_, &key_, 4);
-			m_key = (uint32_t)(t_ ^ ((t_ >> 31) | 0x80000000));
-		}
+		template<typename K_>
+		HX_INLINE KeyValuePair(K_ key_, void* val_) : m_key(hxRadixSortKey<K_>()(key_)), m_val(val_) { }
 
 		HX_INLINE bool operator<(const KeyValuePair& rhs_) const { return m_key < rhs_.m_key; }
 
-		uint32_t m_key;
+		Storage_ m_key;
 		void* m_val;
 	};
 
+	struct KeyFn {
+		typedef Storage_ Key;
+		HX_INLINE Key operator()(const KeyValuePair& x_) const { return x_.m_key; }
+	};
+
 	hxArray<KeyValuePair> m_array;
 };
 
-
 // ----------------------------------------------------------------------------
 // hxRadixSort.  Sorts an array of value* by keys.  K is the key and V the value.
 //
-// Nota bene: Keys of double, int64_t and uint64_t are not supported.  Keys
-// are stored as uint32_t.
+// Keys may be 8, 16, 32 or 64-bit integers, float or double.  Keys of 32 bits
+// or less are stored as uint32_t and 64-bit keys as uint64_t.  See
+// hxRadixSortRecords() and hxRadixSortIndices() to sort without pointers.
 
 template<typename K_, class V_>
-class hxRadixSort : public hxRadixSortBase {
+class hxRadixSort : public hxRadixSortBase<typename hxRadixSortKey<K_>::Storage> {
 public:
 	typedef K_ Key;
 	typedef V_ Value;
+	typedef typename hxRadixSortBase<typename hxRadixSortKey<K_>::Storage>::KeyValuePair KeyValuePair;
 
 	// ForwardIterator over Vales.  Not currently bound to std::iterator_traits
 	// or std::forward_iterator_tag. 
 	class const_iterator
 	{
 	public:
-		HX_INLINE const_iterator(hxArray<KeyValuePair>::const_iterator it_) : m_ptr(it_) { }
+		HX_INLINE const_iterator(typename hxArray<KeyValuePair>::const_iterator it_) : m_ptr(it_) { }
 		HX_INLINE const_iterator() : m_ptr(hxnull) { } // invalid
 		HX_INLINE const_iterator& operator++() { ++m_ptr; return *this; }
 		HX_INLINE const_iterator operator++(int) { const_iterator t(*this); operator++(); return t; }
@@ -119,13 +1466,13 @@ public:
 		HX_INLINE const Value* operator->() const { return (const Value*)m_ptr->m_val; }
 
 	protected:
-		hxArray<KeyValuePair>::const_iterator m_ptr;
+		typename hxArray<KeyValuePair>::const_iterator m_ptr;
 	};
 
 	class iterator : public const_iterator
 	{
 	public:
-		HX_INLINE iterator(hxArray<KeyValuePair>::iterator it_) : const_iterator(it_) { }
+		HX_INLINE iterator(typename hxArray<KeyValuePair>::iterator it_) : const_iterator(it_) { }
 		HX_INLINE iterator() { }
 		HX_INLINE iterator& operator++() { const_iterator::operator++(); return *this; }
 		HX_INLINE iterator operator++(int) { iterator t_(*this); const_iterator::operator++(); return t_; }
@@ -133,26 +1480,26 @@ public:
 		HX_INLINE Value* operator->() const { return (Value*)this->m_ptr->m_val; }
 	};
 
-	HX_INLINE const Value& operator[](uint32_t index_) const { return *(Value*)m_array[index_].m_val; }
-	HX_INLINE       Value& operator[](uint32_t index_) { return *(Value*)m_array[index_].m_val; }
+	HX_INLINE const Value& operator[](uint32_t index_) const { return *(Value*)this->m_array[index_].m_val; }
+	HX_INLINE       Value& operator[](uint32_t index_) { return *(Value*)this->m_array[index_].m_val; }
 
-	HX_INLINE const Value* get(uint32_t index_) const { return (Value*)m_array[index_].m_val; }
-	HX_INLINE       Value* get(uint32_t index_) { return (Value*)m_array[index_].m_val; }
+	HX_INLINE const Value* get(uint32_t index_) const { return (Value*)this->m_array[index_].m_val; }
+	HX_INLINE       Value* get(uint32_t index_) { return (Value*)this->m_array[index_].m_val; }
 
-	HX_INLINE const_iterator begin() const { return const_iterator(m_array.cbegin()); }
-	HX_INLINE iterator begin() { return iterator(m_array.begin()); }
-	HX_INLINE const_iterator cbegin() const { return const_iterator(m_array.cbegin()); }
+	HX_INLINE const_iterator begin() const { return const_iterator(this->m_array.cbegin()); }
+	HX_INLINE iterator begin() { return iterator(this->m_array.begin()); }
+	HX_INLINE const_iterator cbegin() const { return const_iterator(this->m_array.cbegin()); }
 
-	HX_INLINE const_iterator end() const { return const_iterator(m_array.cend()); }
-	HX_INLINE iterator end() { return iterator(m_array.end()); }
-	HX_INLINE const_iterator cend() const { return const_iterator(m_array.cend()); }
+	HX_INLINE const_iterator end() const { return const_iterator(this->m_array.cend()); }
+	HX_INLINE iterator end() { return iterator(this->m_array.end()); }
+	HX_INLINE const_iterator cend() const { return const_iterator(this->m_array.cend()); }
 
-	HX_INLINE uint32_t size() const { return m_array.size(); }
-	HX_INLINE bool empty() const { return m_array.empty(); }
+	HX_INLINE uint32_t size() const { return this->m_array.size(); }
+	HX_INLINE bool empty() const { return this->m_array.empty(); }
 
 	// Adds a key and value pointer.
 	HX_INLINE void insert(Key key_, Value* val_) {
 		// Perform casts safe for -Wcast-qual with a const and volatile Value type.
-		::new(m_array.emplace_back_unconstructed()) KeyValuePair(key_, const_cast<void*>((const volatile void*)val_));
+		::new(this->m_array.emplace_back_unconstructed()) KeyValuePair(key_, const_cast<void*>((const volatile void*)val_));
 	}
 };
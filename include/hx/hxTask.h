@@ -17,13 +17,16 @@ class hxTask {
 public:
 	// Construct task.  staticLabel must be a static string.
 	HX_INLINE explicit hxTask(const char* staticLabel_=hxnull)
-		: m_nextTask(hxnull), m_label(staticLabel_), m_owner(hxnull) {
+		: m_nextTask(hxnull), m_label(staticLabel_), m_owner(hxnull), m_deadline(0u) {
+#if HX_PROFILE
+		m_enqueueTimestamp = 0u;
+#endif
 	}
 
 	// Delete task.  The execute() call may free task _if allocator is thread safe_.
 	HX_INLINE virtual ~hxTask() { hxAssertRelease(!m_owner, "deleting queued task: %s", getLabel()); }
 
-	// Will be wrapped in hxProfileScope(getLabel());
+	// Will be wrapped in hxProfileScopeUncached(getLabel(), 0u);
 	virtual void execute(hxTaskQueue* q_) = 0;
 
 	// Embedded linked list of tasks used by owners.
@@ -39,6 +42,16 @@ public:
 		m_owner = x_;
 	}
 
+	// Time a parked task becomes runnable.  Used by owners to order parked tasks.
+	HX_INLINE hx_timestamp_t getDeadline() const { return m_deadline; }
+	HX_INLINE void setDeadline(hx_timestamp_t x_) { m_deadline = x_; }
+
+#if HX_PROFILE
+	// Time of the last enqueue.  Used by owners to measure wait latency.
+	HX_INLINE hx_timestamp_t getEnqueueTimestamp() const { return m_enqueueTimestamp; }
+	HX_INLINE void setEnqueueTimestamp(hx_timestamp_t x_) { m_enqueueTimestamp = x_; }
+#endif
+
 private:
 	hxTask(const hxTask&); // = delete
 	void operator=(const hxTask&); // = delete
@@ -46,4 +59,8 @@ private:
 	hxTask* m_nextTask;
 	const char* m_label;
 	const void* m_owner;
+	hx_timestamp_t m_deadline;
+#if HX_PROFILE
+	hx_timestamp_t m_enqueueTimestamp;
+#endif
 };
@@ -0,0 +1,190 @@
+#pragma once
+// Copyright 2019 Adrian Johnston
+
+#include <hx/hatchling.h>
+#include <hx/hxDma.h>
+#include <hx/hxTaskQueue.h>
+
+#if HX_USE_CPP20_COROUTINES
+#include <atomic>
+#include <coroutine>
+
+// Time of the next hxTaskPoll check, HX_TASK_POLL_MICROSECONDS from now.
+HX_INLINE static hx_timestamp_t hxTaskPollDeadline() {
+	return hxTimeSampleTimestamp()
+		+ (hx_timestamp_t)((float)HX_TASK_POLL_MICROSECONDS * 1.0e-3f / g_hxTimeMillisecondsPerCycle);
+}
+
+// ----------------------------------------------------------------------------
+// hxCoroutineTask.  An hxTask implemented by a C++20 coroutine.  Awaiting
+// suspends the coroutine and returns its thread to the hxTaskQueue instead of
+// blocking.  The coroutine is resumed later by whichever thread executes the
+// task next.  Requires HX_USE_CPP20_COROUTINES.  E.g.:
+//
+//   hxCoroutineTask load(hxCoroutineTask* decode, hxDmaSyncPoint& sp) {
+//       co_await *decode;
+//       co_await hxTaskAwaitDma(sp, "load");
+//       ...
+//   }
+//   hxCoroutineTask task = load(&decode);
+//   q.enqueue(&task);
+//
+// The coroutine does not run until the task is executed.  The coroutine frame
+// is allocated from hxMemoryManagerId_Heap and is owned by the task.  As with
+// any hxTask, do not destroy the task while it is queued or suspended in an
+// await.
+
+class hxCoroutineTask : public hxTask {
+public:
+	struct promise_type;
+	typedef std::coroutine_handle<promise_type> Handle;
+
+	// Destroys the coroutine frame.
+	~hxCoroutineTask() {
+		if (m_handle) {
+			m_handle.destroy();
+		}
+	}
+
+	// Runs the coroutine until it awaits or returns.  Does not touch this task
+	// after the coroutine suspends as the task may already be running elsewhere.
+	virtual void execute(hxTaskQueue* q_) HX_OVERRIDE {
+		hxAssertMsg(!isDone(), "executing completed coroutine: %s", getLabel());
+		promise_type& p_ = m_handle.promise();
+		p_.m_queue = q_;
+		if (p_.m_isReady) {
+			// Polling await.  Park again until the condition is met.
+			if (!p_.m_isReady(p_.m_isReadyArg)) {
+				q_->enqueueAt(this, hxTaskPollDeadline());
+				return;
+			}
+			p_.m_isReady = hxnull;
+		}
+		m_handle.resume();
+	}
+
+	// Returns true once the coroutine has returned.  Thread safe.
+	bool isDone() const {
+		return m_handle.promise().m_continuation.load(std::memory_order_acquire) == doneMarker_();
+	}
+
+	// Awaiting an hxCoroutineTask suspends until it has returned.  The awaited
+	// task must be enqueued separately.
+	struct Awaiter {
+		bool await_ready() const { return m_awaited->isDone(); }
+		bool await_suspend(Handle h_) {
+			// Returning false resumes immediately because the awaited task finished.
+			hxTask* expected_ = hxnull;
+			return m_awaited->m_handle.promise().m_continuation.compare_exchange_strong(
+				expected_, h_.promise().m_task, std::memory_order_acq_rel);
+		}
+		void await_resume() const { }
+		hxCoroutineTask* m_awaited;
+	};
+	Awaiter operator co_await() { return Awaiter { this }; }
+
+	// Not for direct use.  Implements the C++20 coroutine promise interface.
+	struct promise_type {
+		promise_type() : m_task(hxnull), m_queue(hxnull), m_isReady(hxnull),
+			m_isReadyArg(hxnull), m_continuation(hxnull) { }
+
+		static void* operator new(size_t size_) { return hxMallocExt(size_, hxMemoryManagerId_Heap); }
+		static void operator delete(void* ptr_) { hxFree(ptr_); }
+
+		hxCoroutineTask get_return_object() { return hxCoroutineTask(Handle::from_promise(*this)); }
+		std::suspend_always initial_suspend() noexcept { return std::suspend_always(); }
+		void return_void() { }
+		void unhandled_exception() { hxAssertRelease(0, "coroutine exception"); }
+
+		// Marks completion and reschedules a task awaiting this one.
+		struct FinalAwaiter {
+			bool await_ready() const noexcept { return false; }
+			void await_suspend(Handle h_) noexcept {
+				promise_type& p_ = h_.promise();
+				hxTask* waiting_ = p_.m_continuation.exchange(doneMarker_(), std::memory_order_acq_rel);
+				if (waiting_) {
+					hxAssert(waiting_ != doneMarker_());
+					// The awaiting coroutine last executed on p_.m_queue as well.
+					static_cast<hxCoroutineTask*>(waiting_)->m_handle.promise().m_queue->enqueue(waiting_);
+				}
+			}
+			void await_resume() const noexcept { }
+		};
+		FinalAwaiter final_suspend() noexcept { return FinalAwaiter(); }
+
+		hxCoroutineTask* m_task; // Task owning this coroutine.
+		hxTaskQueue* m_queue; // Queue that is executing the coroutine.
+		bool (*m_isReady)(const void*); // Polled by execute() before resuming.
+		const void* m_isReadyArg;
+		std::atomic<hxTask*> m_continuation; // Awaiting task or doneMarker_().
+	};
+
+private:
+	explicit hxCoroutineTask(Handle h_) : m_handle(h_) { h_.promise().m_task = this; }
+
+	// Marks m_continuation as complete without using a valid task address.
+	static hxTask* doneMarker_() { return reinterpret_cast<hxTask*>(&s_doneMarker_); }
+	static inline char s_doneMarker_ = 0;
+
+	Handle m_handle;
+};
+
+// ----------------------------------------------------------------------------
+// Awaitables for use in an hxCoroutineTask.
+
+// co_await hxTaskYield().  Re-enqueues the current task and suspends so that
+// other tasks may run.
+struct hxTaskYield {
+	bool await_ready() const { return false; }
+	void await_suspend(hxCoroutineTask::Handle h_) const {
+		hxCoroutineTask::promise_type& p_ = h_.promise();
+		p_.m_queue->enqueue(p_.m_task);
+	}
+	void await_resume() const { }
+};
+
+// hxTaskPoll.  Base for awaitables that suspend until isReady() returns true.
+// The task is parked with hxTaskQueue::enqueueAt() and isReady() is checked
+// every HX_TASK_POLL_MICROSECONDS, so a pending wait does not occupy a thread.
+template<typename Derived_>
+struct hxTaskPoll {
+	bool await_ready() const { return static_cast<const Derived_*>(this)->isReady(); }
+	void await_suspend(hxCoroutineTask::Handle h_) const {
+		hxCoroutineTask::promise_type& p_ = h_.promise();
+		p_.m_isReady = &isReady_;
+		p_.m_isReadyArg = this;
+		p_.m_queue->enqueueAt(p_.m_task, hxTaskPollDeadline());
+	}
+	static bool isReady_(const void* this_) { return static_cast<const Derived_*>(this_)->isReady(); }
+};
+
+// co_await hxTaskSleep(cycles).  Suspends until at least cycles have elapsed.
+// The task is parked until then without polling.
+struct hxTaskSleep {
+	explicit hxTaskSleep(hx_timestamp_t cycles_) : m_deadline(hxTimeSampleTimestamp() + cycles_) { }
+	bool await_ready() const { return hxTimeSampleTimestamp() >= m_deadline; }
+	void await_suspend(hxCoroutineTask::Handle h_) const {
+		hxCoroutineTask::promise_type& p_ = h_.promise();
+		p_.m_queue->enqueueAt(p_.m_task, m_deadline);
+	}
+	void await_resume() const { }
+
+	hx_timestamp_t m_deadline;
+};
+
+// co_await hxTaskAwaitDma(syncPoint, labelStringLiteral).  Suspends until DMA
+// preceding syncPoint has completed then performs hxDmaAwaitSyncPoint().
+// Polls with hxDmaIsSyncPointComplete().
+struct hxTaskAwaitDma : public hxTaskPoll<hxTaskAwaitDma> {
+	hxTaskAwaitDma(hxDmaSyncPoint& syncPoint_, const char* labelStringLiteral_)
+		: m_syncPoint(syncPoint_), m_label(labelStringLiteral_) { }
+	bool isReady() const { return hxDmaIsSyncPointComplete(m_syncPoint); }
+	void await_resume() const {
+		hxDmaAwaitSyncPoint(m_syncPoint, m_label); (void)m_label;
+	}
+
+	hxDmaSyncPoint& m_syncPoint;
+	const char* m_label;
+};
+
+#endif // HX_USE_CPP20_COROUTINES
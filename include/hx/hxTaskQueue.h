@@ -5,6 +5,8 @@
 #include <hx/hxTask.h>
 
 #if HX_USE_CPP11_THREADS
+#include <atomic>
+#include <chrono>
 #include <mutex>
 #include <condition_variable>
 #include <thread>
@@ -17,32 +19,139 @@
 class hxTaskQueue {
 public:
 	// threadPoolSize -1 indicates using a hardware_concurrency()-1 size thread
-	// pool.  threadPoolSize 0 does not use threading. 
-	explicit hxTaskQueue(int32_t threadPoolSize_ = -1);
+	// pool.  threadPoolSize 0 does not use threading.  threadCpus, if non-null,
+	// is an array of threadPoolSize CPU indices that pool threads are pinned to.
+	// Negative entries are not pinned.  Ignored unless HX_USE_THREAD_AFFINITY.
+	//
+	// threadNodes, if non-null, is an array of threadPoolSize NUMA node indices
+	// less than HX_NUMA_MAX_NODES.  Ignored unless HX_USE_NUMA.  Each node has
+	// its own task list and pool threads only steal from other nodes when their
+	// own node has no tasks.  Pool threads also prefer their node's memory, so
+	// buffers that tasks first touch from inside execute() are node local.
+	explicit hxTaskQueue(int32_t threadPoolSize_ = -1, const int32_t* threadCpus_ = hxnull,
+		const int32_t* threadNodes_ = hxnull);
 
 	// Calls waitForAll before destructing.
 	~hxTaskQueue();
 
 	// Does not delete task after execution.  Thread safe and callable from
-	// running tasks.
-	void enqueue(hxTask* task_);
+	// running tasks.  Lock-free unless a pool thread is waiting for work.  node
+	// selects the node's task list when HX_USE_NUMA.  -1 uses the node of the
+	// calling pool thread or else node 0.
+	void enqueue(hxTask* task_, int32_t node_ = -1);
 
-	// The thread calling waitForAll() will execute tasks as well.  Do not call
+	// Enqueues count tasks with a single lock-free push of the whole chain and
+	// wakes no more pool threads than there are tasks.  Same requirements as
+	// enqueue().
+	void enqueueBatch(hxTask** tasks_, uint32_t count_, int32_t node_ = -1);
+
+	// Parks task until hxTimeSampleTimestamp() reaches deadline and then
+	// enqueues it.  Idle threads block until the earliest deadline instead of
+	// polling.  Tasks with equal deadlines are released in the order parked.
+	// Takes m_mutex when there is a thread pool.  Same requirements as enqueue().
+	void enqueueAt(hxTask* task_, hx_timestamp_t deadline_);
+
+	// The thread calling waitForAll() will execute tasks as well and returns once
+	// parked tasks have also run.  Without HX_USE_CPP11_THREADS there is nothing
+	// to block on and waiting for a parked task polls the clock.  Do not call
 	// from hxTask::execute().
 	void waitForAll();
 
+#if HX_PROFILE
+	// Statistics gathered while HX_PROFILE is enabled.  Histogram bucket i counts
+	// durations of less than 2^i cycles and at least 2^(i-1) cycles.  Totals are
+	// doubles to avoid overflow.  Workers are the pool threads followed by one
+	// entry shared by threads calling waitForAll() or the destructor.
+	enum { StatsBuckets = 32 };
+	struct StatsLabel {
+		const char* m_label; // hxnull for unused entries.
+		uint32_t m_count;
+		hx_timestamp_t m_maxCycles;
+		double m_totalCycles;
+		uint32_t m_histogram[StatsBuckets];
+	};
+	struct StatsWorker {
+		uint32_t m_count;
+		double m_busyCycles;
+		double m_idleCycles;
+	};
+	struct Stats {
+		uint32_t m_executed;
+		int32_t m_maxDepth; // Sampled when tasks are taken from the queue.
+		hx_timestamp_t m_maxWaitCycles;
+		double m_totalWaitCycles;
+		uint32_t m_waitHistogram[StatsBuckets];
+		StatsLabel m_labels[HX_TASK_QUEUE_STATS_LABELS]; // Last entry combines overflow.
+		int32_t m_workerCount;
+		StatsWorker* m_workers;
+	};
+
+	// Not synchronized with running tasks.  Read after waitForAll().
+	HX_INLINE const Stats& getStats() const { return *m_stats; }
+	void resetStats();
+
+	// Logs a summary of wait latency, per-label run time and worker utilization.
+	void logStats();
+
+	// Calls logStats() on every live queue.  Console command "taskqueuestats".
+	static void logAllStats();
+#endif
+
 private:
 	hxTaskQueue(const hxTaskQueue&); // = delete
 	void operator=(const hxTaskQueue&); // = delete
 
 	static const uint32_t RunningQueueCheck_ = 0xc710b034u;
 
-	hxTask* m_nextTask;
+	// Task lists per NUMA node.  Without a thread pool only node 0 is used.
+	enum { Nodes_ = HX_USE_NUMA ? HX_NUMA_MAX_NODES : 1 };
+
+	bool park_(hxTask* task_);
+	void releaseParked_(int32_t node_);
+
+	hxTask* m_nextTask[Nodes_];
+	hxTask* m_parkedTasks; // Ordered by deadline.
+#if HX_USE_CPP11_THREADS
+	// Read by lock-free enqueues.  Cleared by the stopping thread.
+	std::atomic<uint32_t> m_runningQueueCheck;
+#else
 	uint32_t m_runningQueueCheck;
+#endif
+
+#if HX_PROFILE
+	void statsInit_(int32_t workerCount_);
+	void statsDequeued_(hxTask* task_, int32_t worker_, hx_timestamp_t now_, hx_timestamp_t idleCycles_);
+	void statsExecuted_(const char* label_, int32_t worker_, hx_timestamp_t runCycles_);
+	void statsIdle_(int32_t worker_, hx_timestamp_t idleCycles_);
+	StatsLabel& statsLabel_(const char* label_);
+
+	Stats* m_stats;
+	hxTaskQueue* m_nextQueue; // List of live queues for logAllStats().
+#if HX_USE_CPP11_THREADS
+	std::atomic<int32_t> m_statsDepth { 0 };
+#else
+	int32_t m_statsDepth;
+#endif
+#endif
 
 #if HX_USE_CPP11_THREADS
 	enum class ExecutorMode_ { Pool_, Waiting_, Stopping_ };
-	static void executorThread_(hxTaskQueue* q_, ExecutorMode_ mode_);
+	// Pins the calling thread to cpu first unless cpu is negative.  A negative
+	// node uses node 0 without binding memory.
+	static void executorThread_(hxTaskQueue* q_, ExecutorMode_ mode_, int32_t worker_, int32_t cpu_,
+		int32_t node_);
+	void inject_(hxTask* first_, hxTask* last_, uint32_t count_, int32_t node_);
+	int32_t enqueueNode_(int32_t node_) const;
+	hxTask* takeTask_(int32_t node_);
+	bool hasTasks_() const;
+	std::chrono::microseconds parkedWait_() const;
+	void waitParked_(std::condition_variable& condVar_, std::unique_lock<std::mutex>& lk_);
+#if HX_USE_THREAD_AFFINITY
+	static void setThreadAffinity_(int32_t cpu_);
+#endif
+#if HX_USE_NUMA
+	static void setMemoryNode_(int32_t node_);
+#endif
 
 	int32_t m_threadPoolSize = 0;
 	std::thread* m_threads = hxnull;
@@ -50,5 +159,10 @@ private:
 	std::condition_variable m_condVarTasks;
 	std::condition_variable m_condVarWaiting;
 	int32_t m_executingCount = 0;
+
+	// Tasks enqueued without m_mutex.  Drained into m_nextTask by pool threads.
+	std::atomic<hxTask*> m_injectedTasks[Nodes_];
+	int32_t m_nodeCount = 1;
+	std::atomic<int32_t> m_idleCount { 0 }; // Pool threads waiting on m_condVarTasks.
 #endif
 };
@@ -5,6 +5,7 @@
 #include <hx/hatchling.h>
 #include <hx/hxFile.h>
 #include <hx/hxProfiler.h>
+#include <hx/internal/hxBenchmarkInternal.h>
 
 // ----------------------------------------------------------------------------
 // Enable this to use Google Test instead of hxTestRunner::executeAllTests().
@@ -90,6 +91,32 @@ HX_INLINE void InitGoogleTest() { }
 
 #endif // !HX_USE_GOOGLE_TEST
 
+// ----------------------------------------------------------------------------
+// BENCHMARK.  Declares a test that times a loop with hxBenchmark.  The body
+// has access to "hxBenchmark benchmark" and should look like:
+//
+//   BENCHMARK(Suite, Case) {
+//       ...setup...
+//       benchmark.setBytesPerIteration(bytes);
+//       while (benchmark.keepRunning()) { ...code being timed... }
+//   }
+//
+// Logs ns/op, ops/s, bytes/s and bytes allocated per op.  Fails
+// if slower than the baseline file set with the "benchmarkbaseline" console
+// command or hxBenchmark::setBaselineFile().
+#define BENCHMARK(SuiteName_, CaseName_) \
+	struct HX_CONCATENATE(SuiteName_, CaseName_##Benchmark) { \
+		HX_CONCATENATE(SuiteName_, CaseName_##Benchmark)() : benchmark(#SuiteName_ "." #CaseName_) { } \
+		void Run(); \
+		hxBenchmark benchmark; \
+	}; \
+	TEST(SuiteName_, CaseName_) { \
+		HX_CONCATENATE(SuiteName_, CaseName_##Benchmark) benchmark_; \
+		benchmark_.Run(); \
+		EXPECT_TRUE(benchmark_.benchmark.report()); \
+	} \
+	void HX_CONCATENATE(SuiteName_, CaseName_##Benchmark)::Run()
+
 // ----------------------------------------------------------------------------
 // hxTestRandom.  The linear congruential random number generator from Numerical Recipes.
 struct hxTestRandom {
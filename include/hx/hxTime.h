@@ -3,11 +3,59 @@
 
 #include <hx/hatchling.h>
 
-// Stores at least a seconds worth of CPU cycles.  Used when profiling.
+// Timestamps count cycles from an unspecified epoch.  64-bit timestamps do not
+// wrap in practice.
+#if HX_USE_64_BIT_TYPES
+typedef uint64_t hx_timestamp_t;
+#else
+typedef uint32_t hx_timestamp_t;
+#endif
+
+// Stores at least a seconds worth of CPU cycles.  Used for differences between
+// nearby timestamps.
 typedef uint32_t hx_cycles_t;
 
-// c_hxTimeDefaultTimingCutoff is 1 microsecond.  
-#if HX_USE_CPP11_TIME
+// Converts cycles to milliseconds.  Calibrated by hxInit() when HX_USE_TSC,
+// otherwise c_hxTimeMillisecondsPerCycle.  Use this instead of
+// c_hxTimeMillisecondsPerCycle, which is not accurate with HX_USE_TSC.
+extern float g_hxTimeMillisecondsPerCycle;
+
+// Cutoff for samples that performed little to no processing, about 1
+// microsecond.  Derived from the calibrated rate by hxInit() when HX_USE_TSC,
+// otherwise c_hxTimeDefaultTimingCutoff.  Use this instead of
+// c_hxTimeDefaultTimingCutoff, which is not accurate with HX_USE_TSC.
+extern hx_cycles_t g_hxTimeDefaultTimingCutoff;
+
+// internal use only
+void hxTimeInit();
+
+// c_hxTimeDefaultTimingCutoff is about 1 microsecond.
+#if HX_USE_TSC
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// Deprecated.  The TSC rate is only known at runtime so these assume a 1 GHz
+// counter.  See g_hxTimeMillisecondsPerCycle and g_hxTimeDefaultTimingCutoff.
+static const float c_hxTimeMillisecondsPerCycle = 1.0e-6f;
+static const hx_cycles_t c_hxTimeDefaultTimingCutoff = 1000;
+
+// Read the CPU's timestamp counter.  Invariant across cores and frequency
+// changes on current x86-64 and AArch64 targets.
+HX_INLINE static hx_timestamp_t hxTimeSampleTimestamp() {
+#if defined(_MSC_VER)
+	return (hx_timestamp_t)__rdtsc();
+#elif defined(__aarch64__)
+	uint64_t t_;
+	__asm__ __volatile__("mrs %0, cntvct_el0" : "=r"(t_));
+	return (hx_timestamp_t)t_;
+#else
+	return (hx_timestamp_t)__builtin_ia32_rdtsc();
+#endif
+}
+
+#elif HX_USE_CPP11_TIME
 #include <chrono>
 
 // converts cycles to milliseconds
@@ -22,8 +70,8 @@ constexpr hx_cycles_t c_hxTimeDefaultTimingCutoff = (uint32_t)(std::chrono::high
 extern std::chrono::high_resolution_clock::time_point g_hxTimeStart;
 
 // Read cycle counter register.  This version is a Linux fall-back.
-HX_INLINE static hx_cycles_t hxTimeSampleCycles() {
-	return (hx_cycles_t)(std::chrono::high_resolution_clock::now() - g_hxTimeStart).count();
+HX_INLINE static hx_timestamp_t hxTimeSampleTimestamp() {
+	return (hx_timestamp_t)(std::chrono::high_resolution_clock::now() - g_hxTimeStart).count();
 }
 
 #else
@@ -35,9 +83,15 @@ static const float c_hxTimeMillisecondsPerCycle = 1.0e-6f; // Also 1.e+6 cycles/
 
 static const hx_cycles_t c_hxTimeDefaultTimingCutoff = 1000;
 
-HX_INLINE static hx_cycles_t hxTimeSampleCycles() {
+HX_INLINE static hx_timestamp_t hxTimeSampleTimestamp() {
 	timespec ts_;
 	clock_gettime(CLOCK_MONOTONIC, &ts_);
-	return (uint32_t)ts_.tv_nsec;
+	return (hx_timestamp_t)ts_.tv_sec * (hx_timestamp_t)1000000000u + (hx_timestamp_t)ts_.tv_nsec;
 }
 #endif
+
+// Truncated timestamp for measuring short durations.  Unsigned arithmetic
+// handles wrapping.
+HX_INLINE static hx_cycles_t hxTimeSampleCycles() {
+	return (hx_cycles_t)hxTimeSampleTimestamp();
+}
@@ -0,0 +1,272 @@
+#pragma once
+// Copyright 2019 Adrian Johnston
+
+#include <hx/hatchling.h>
+#include <hx/hxFile.h>
+#include <hx/hxTime.h>
+
+// ----------------------------------------------------------------------------
+// hxBenchmark
+//
+// Times the body of a loop in batches.  Batch sizes double during warmup until
+// a batch takes a fraction of the time budget.  Then batches are timed until
+// c_maxSamples batches are measured, the iteration limit is reached or the time
+// budget runs out.  Batches slower than the median by more than 3 scaled median
+// absolute deviations are rejected as interrupted.  Each batch is run in a
+// temporary stack hxMemoryManagerScope which reports bytes allocated by the
+// loop.  Allocations made in the loop must be freed in the loop, so the
+// scope's allocation count is always zero and is not reported.
+//
+// Usage:
+//   hxBenchmark benchmark("name");
+//   while (benchmark.keepRunning()) { ... }
+//   benchmark.report();
+
+class hxBenchmark {
+public:
+	enum { c_maxSamples = 32 };
+
+	HX_INLINE hxBenchmark(const char* nameStringLiteral_)
+		: m_name(nameStringLiteral_), m_bytesPerIteration(0u), m_remaining(0u), m_batchSize(0u),
+			m_phase(PhaseStart), m_batchStart(0u), m_elapsed(0u), m_iterations(0u),
+			m_sampleCount(0), m_rejectedCount(0), m_bytesAllocated(0u), m_nsPerOp(0.0),
+			m_nsMedian(0.0), m_nsMin(0.0), m_isScopeOpen(false) {
+		setLimits(HX_BENCHMARK_ITERATIONS, HX_BENCHMARK_MILLISECONDS);
+	}
+
+	HX_INLINE ~hxBenchmark() { closeScope_(); }
+
+	// Call before keepRunning().  maxIterations does not include warmup.
+	HX_INLINE void setLimits(uint32_t maxIterations_, uint32_t milliseconds_) {
+		hxAssert(m_phase == PhaseStart && maxIterations_ != 0u);
+		m_maxIterations = maxIterations_;
+		m_budget = (hx_timestamp_t)((double)milliseconds_ / (double)g_hxTimeMillisecondsPerCycle);
+	}
+
+	// Bytes read or written by each iteration.  Used to report bytes/s.
+	HX_INLINE void setBytesPerIteration(size_t bytes_) { m_bytesPerIteration = bytes_; }
+
+	// Returns true while the loop body should be run again.
+	HX_INLINE bool keepRunning() {
+		if (m_remaining != 0u) {
+			--m_remaining;
+			return true;
+		}
+		return nextBatch_();
+	}
+
+	// Results.  Valid after keepRunning() returns false.
+	HX_INLINE const char* name() const { return m_name; }
+	HX_INLINE double nsPerOp() const { return m_nsPerOp; } // Mean of accepted batches.
+	HX_INLINE double nsMedian() const { return m_nsMedian; }
+	HX_INLINE double nsMin() const { return m_nsMin; }
+	HX_INLINE double opsPerSecond() const { return m_nsPerOp > 0.0 ? 1.0e+9 / m_nsPerOp : 0.0; }
+	HX_INLINE double bytesPerSecond() const { return opsPerSecond() * (double)m_bytesPerIteration; }
+	HX_INLINE uint32_t iterations() const { return m_iterations; }
+	HX_INLINE int32_t sampleCount() const { return m_sampleCount; }
+	HX_INLINE int32_t rejectedCount() const { return m_rejectedCount; }
+	HX_INLINE double bytesAllocatedPerOp() const {
+		return m_iterations ? (double)m_bytesAllocated / (double)m_iterations : 0.0;
+	}
+
+	// Logs results and compares them with the baseline file.  Then appends them
+	// to the results file.  Returns false if slower than the baseline by more
+	// than HX_BENCHMARK_REGRESSION_PERCENT.
+	HX_INLINE bool report() {
+		hxAssertMsg(m_phase == PhaseDone, "benchmark not run");
+		hxLogConsole("%s: %.3f ns/op (median %.3f, min %.3f), %.0f ops/s", m_name,
+			m_nsPerOp, m_nsMedian, m_nsMin, opsPerSecond());
+		if (m_bytesPerIteration != 0u) {
+			hxLogHandler(hxLogLevel_Console, ", %.3f MB/s", bytesPerSecond() * 1.0e-6);
+		}
+		hxLogHandler(hxLogLevel_Console, ", %u iterations, %d of %d batches rejected, %.1f bytes allocated/op\n",
+			(unsigned int)m_iterations, (int)m_rejectedCount, (int)m_sampleCount, bytesAllocatedPerOp());
+
+		bool isOk = true;
+		double baseline_ = 0.0;
+		if (readBaseline_(baseline_)) {
+			double change_ = (m_nsPerOp - baseline_) * 100.0 / baseline_;
+			hxLogConsole("%s: baseline %.3f ns/op, %+.1f%%\n", m_name, baseline_, change_);
+			isOk = change_ <= (double)(HX_BENCHMARK_REGRESSION_PERCENT);
+			hxWarnCheck(isOk, "%s: regressed %.1f%%", m_name, change_);
+		}
+
+		hxFile& results_ = resultsFileStorage_();
+		if (results_.is_open()) {
+			results_.print("%s %.3f\n", m_name, m_nsPerOp);
+		}
+		return isOk;
+	}
+
+	// Sets the files used by report().  The baseline file has "name ns/op"
+	// lines.  The results file is written in the same format and may be used as
+	// a new baseline.  Null or "" for none.  The test runner provides the console
+	// commands "benchmarkbaseline" and "benchmarkresults".
+	static HX_INLINE void setBaselineFile(const char* filename_) {
+		hxsnprintf(baselineFilenameStorage_(), HX_MAX_LINE, "%s", filename_ ? filename_ : "");
+	}
+	static HX_INLINE const char* getBaselineFile() { return baselineFilenameStorage_(); }
+
+	static HX_INLINE void setResultsFile(const char* filename_) {
+		hxFile& results_ = resultsFileStorage_();
+		results_.close();
+		if (filename_ && *filename_ != '\0') {
+			results_.open(hxFile::out | hxFile::fallible, "%s", filename_);
+			hxWarnCheck(results_.is_open(), "cannot write benchmark results: %s", filename_);
+		}
+	}
+
+	static HX_INLINE void setFiles(const char* baselineFilename_, const char* resultsFilename_) {
+		setBaselineFile(baselineFilename_);
+		setResultsFile(resultsFilename_);
+	}
+
+private:
+	enum Phase { PhaseStart, PhaseWarmup, PhaseMeasure, PhaseDone };
+
+	hxBenchmark(const hxBenchmark&); // = delete
+	void operator=(const hxBenchmark&); // = delete
+
+	static HX_INLINE char* baselineFilenameStorage_() { static char s_hxFilename[HX_MAX_LINE] = ""; return s_hxFilename; }
+	static HX_INLINE hxFile& resultsFileStorage_() { static hxFile s_hxFile(hxFile::out | hxFile::fallible); return s_hxFile; }
+
+	HX_INLINE void openScope_() {
+		::new(m_scopeStorage) hxMemoryManagerScope(hxMemoryManagerId_TemporaryStack);
+		m_isScopeOpen = true;
+	}
+
+	// Returns bytes allocated by the batch.  The temporary stack does not reuse
+	// memory that is freed before the scope closes.
+	HX_INLINE uintptr_t closeScope_() {
+		uintptr_t bytes_ = 0u;
+		if (m_isScopeOpen) {
+			hxMemoryManagerScope* scope_ = (hxMemoryManagerScope*)m_scopeStorage;
+			bytes_ = scope_->getScopeBytesAllocated();
+			scope_->~hxMemoryManagerScope();
+			m_isScopeOpen = false;
+		}
+		return bytes_;
+	}
+
+	bool nextBatch_() {
+		hx_timestamp_t end_ = hxTimeSampleTimestamp();
+		if (m_phase == PhaseStart) {
+			m_phase = PhaseWarmup;
+			m_batchSize = 1u;
+		}
+		else {
+			hx_timestamp_t cycles_ = end_ - m_batchStart;
+			uintptr_t bytes_ = closeScope_();
+			m_elapsed += cycles_;
+
+			if (m_phase == PhaseWarmup) {
+				// Target batches of 1/(2*c_maxSamples) of the budget and spend at
+				// most 1/4 of the budget calibrating.  Leave enough iterations for
+				// c_maxSamples batches.
+				uint32_t batchLimit_ = hxMax(m_maxIterations / (uint32_t)c_maxSamples, 1u);
+				if (cycles_ * (2u * c_maxSamples) < m_budget && m_elapsed * 4u < m_budget
+						&& m_batchSize < batchLimit_) {
+					m_batchSize = hxMin(m_batchSize * 2u, batchLimit_);
+				}
+				else {
+					m_phase = PhaseMeasure;
+				}
+			}
+			else {
+				m_samples[m_sampleCount++] = (double)cycles_ * (double)g_hxTimeMillisecondsPerCycle
+					* 1.0e+6 / (double)m_batchSize;
+				m_iterations += m_batchSize;
+				m_bytesAllocated += bytes_;
+				if (m_sampleCount == c_maxSamples || m_iterations >= m_maxIterations || m_elapsed >= m_budget) {
+					finish_();
+					return false;
+				}
+				m_batchSize = hxMin(m_batchSize, m_maxIterations - m_iterations);
+			}
+		}
+
+		openScope_();
+		m_remaining = m_batchSize - 1u;
+		m_batchStart = hxTimeSampleTimestamp();
+		return true;
+	}
+
+	void finish_() {
+		m_phase = PhaseDone;
+
+		double sorted_[c_maxSamples] = { 0.0 };
+		double deviations_[c_maxSamples] = { 0.0 };
+		for (int32_t i_ = 0; i_ < m_sampleCount; ++i_) {
+			sorted_[i_] = m_samples[i_];
+		}
+		m_nsMedian = median_(sorted_, m_sampleCount);
+		for (int32_t i_ = 0; i_ < m_sampleCount; ++i_) {
+			deviations_[i_] = hxAbs(m_samples[i_] - m_nsMedian);
+		}
+		// 1.4826 scales the median absolute deviation to a standard deviation.
+		double cutoff_ = m_nsMedian + 3.0 * 1.4826 * median_(deviations_, m_sampleCount);
+
+		double total_ = 0.0;
+		int32_t accepted_ = 0;
+		m_nsMin = sorted_[0];
+		for (int32_t i_ = 0; i_ < m_sampleCount; ++i_) {
+			if (m_samples[i_] <= cutoff_) {
+				total_ += m_samples[i_];
+				++accepted_;
+			}
+		}
+		m_rejectedCount = m_sampleCount - accepted_;
+		m_nsPerOp = total_ / (double)accepted_; // The median is always accepted.
+	}
+
+	// Sorts values and returns the median.
+	static double median_(double* values_, int32_t count_) {
+		for (int32_t i_ = 1; i_ < count_; ++i_) {
+			double t_ = values_[i_];
+			int32_t j_ = i_;
+			for (; j_ > 0 && t_ < values_[j_ - 1]; --j_) {
+				values_[j_] = values_[j_ - 1];
+			}
+			values_[j_] = t_;
+		}
+		return (count_ & 1) ? values_[count_ / 2]
+			: (values_[count_ / 2 - 1] + values_[count_ / 2]) * 0.5;
+	}
+
+	bool readBaseline_(double& baseline_) const {
+		const char* filename_ = baselineFilenameStorage_();
+		if (*filename_ == '\0') {
+			return false;
+		}
+		hxFile file_(hxFile::in | hxFile::fallible, "%s", filename_);
+		size_t length_ = ::strlen(m_name);
+		char line_[HX_MAX_LINE];
+		while (file_.is_open() && file_.getline(line_)) {
+			if (::strncmp(line_, m_name, length_) == 0 && line_[length_] == ' ') {
+				baseline_ = ::strtod(line_ + length_ + 1, hxnull);
+				return baseline_ > 0.0;
+			}
+		}
+		return false;
+	}
+
+	const char* m_name;
+	size_t m_bytesPerIteration;
+	uint32_t m_maxIterations;
+	hx_timestamp_t m_budget;
+	uint32_t m_remaining;
+	uint32_t m_batchSize;
+	Phase m_phase;
+	hx_timestamp_t m_batchStart;
+	hx_timestamp_t m_elapsed;
+	uint32_t m_iterations;
+	int32_t m_sampleCount;
+	int32_t m_rejectedCount;
+	uintptr_t m_bytesAllocated;
+	double m_samples[c_maxSamples];
+	double m_nsPerOp;
+	double m_nsMedian;
+	double m_nsMin;
+	bool m_isScopeOpen;
+	uintptr_t m_scopeStorage[(sizeof(hxMemoryManagerScope) + sizeof(uintptr_t) - 1u) / sizeof(uintptr_t)];
+};
@@ -8,6 +8,29 @@
 #error #include <hx/hxProfiler.h>
 #endif
 
+#if (HX_PROFILE_PERF_COUNTERS) && !defined(__linux__)
+#error HX_PROFILE_PERF_COUNTERS requires Linux
+#endif
+
+#if HX_USE_CPP11_THREADS
+#include <atomic>
+#endif
+
+class hxFile;
+
+// State cached by each call site.  Zero initialized as a function static.
+// The low 32 bits of m_state are the filter generation shifted left by 2 ored
+// with one of hxProfiler::Callsite values and the high 32 bits are the
+// decimation, so a single store publishes both.  Only written when the filters
+// change.  A call site must always use the same label.
+struct hxProfilerCallsite {
+#if HX_USE_CPP11_THREADS
+	std::atomic<uint64_t> m_state;
+#else
+	uint64_t m_state;
+#endif
+};
+
 // Use direct access to an object with static linkage for speed.
 extern class hxProfiler g_hxProfiler;
 
@@ -19,55 +42,404 @@ extern HX_THREAD_LOCAL uint8_t s_hxProfilerThreadIdAddress;
 
 class hxProfiler {
 public:
+	// Hardware counters sampled by scopes when HX_PROFILE_PERF_COUNTERS is set:
+	// instructions, cycles, last level cache misses and branch misses.
+	enum { PerfCounters = 4 };
+	static const char* const c_perfCounterNames[PerfCounters];
+
+	// A scope, a counter sample or an instant marker.  Counters and markers are
+	// sampled at m_begin.  Counters store their value in m_end.
 	struct Record {
-		HX_INLINE Record(hx_cycles_t begin_, hx_cycles_t end_, const char* label_, uint32_t threadId_)
-			: m_label(label_), m_begin(begin_), m_end(end_), m_threadId(threadId_) {
+		enum Kind {
+			KindScope,
+			KindCounter,
+			KindMark,
+			KindCount_
+		};
+		HX_INLINE Record(hx_timestamp_t begin_, hx_timestamp_t end_, const char* label_, uint32_t threadId_,
+				uint32_t kind_)
+			: m_begin(begin_), m_end(end_), m_label(label_), m_threadId(threadId_), m_kind(kind_) {
 		}
+		HX_INLINE hx_timestamp_t endTimestamp() const { return m_kind == KindScope ? m_end : m_begin; }
+		hx_timestamp_t m_begin;
+		hx_timestamp_t m_end;
 		const char* m_label;
-		hx_cycles_t m_begin;
-		hx_cycles_t m_end;
 		uint32_t m_threadId;
+		uint32_t m_kind;
+#if HX_PROFILE_PERF_COUNTERS
+		hx_timestamp_t m_perf[PerfCounters]; // Deltas over the scope.
+#endif
 	};
 
-	hxProfiler() : m_isStarted(false) { };
+	// Each thread writes to a block it claimed on first use.  A new block is
+	// claimed when the current one fills.  Claiming a block is the only atomic
+	// operation on shared state.  Only the owning thread writes m_size.  In
+	// continuous mode blocks that are no longer owned are recycled oldest first.
+	// m_sequence is the claim count when the block was claimed and allows
+	// readers to detect recycling.
+	enum {
+		BlockRecords = HX_PROFILER_BLOCK_RECORDS,
+		BlockCount = HX_PROFILER_MAX_RECORDS / HX_PROFILER_BLOCK_RECORDS
+	};
+	HX_STATIC_ASSERT(BlockCount > 0, "HX_PROFILER_MAX_RECORDS < HX_PROFILER_BLOCK_RECORDS");
+
+	struct Block {
+#if HX_USE_CPP11_THREADS
+		std::atomic<uint32_t> m_size;
+		std::atomic<uint32_t> m_sequence;
+		std::atomic<uint32_t> m_isOwned;
+#else
+		uint32_t m_size;
+		uint32_t m_sequence;
+		uint32_t m_isOwned;
+#endif
+		uint32_t m_flushedSequence; // Used by flush() only.
+		uint32_t m_flushedSize;
+		hxAllocator<Record, BlockRecords> m_records;
+	};
+
+	// Header of each chunk written by flush().  Followed by m_count records each
+	// written as hx_timestamp_t begin and end values, uint32_t thread id, kind and
+	// label length values and then the label characters.
+	struct FileChunk {
+		static const uint32_t c_magic = 0x52507868u; // "hxPR"
+		uint32_t m_magic;
+		uint32_t m_count;
+	};
+
+	// Durations of the records sharing a label.  m_self excludes the time spent
+	// in scopes nested within them on the same thread.  The histogram is
+	// log-linear with 4 buckets for each power of 2 cycles up to 2^32.
+	enum { StatsBuckets = 124 };
+	struct Stats {
+		void clear(const char* label_);
+		void add(hx_timestamp_t duration_, hx_timestamp_t self_);
+		void merge(const Stats& x_);
+
+		// Estimated duration in cycles that fraction of samples do not exceed.
+		// E.g. percentile(0.99) for p99.
+		double percentile(double fraction_) const;
+		HX_INLINE double mean() const { return m_count ? (double)m_total / (double)m_count : 0.0; }
+
+		const char* m_label;
+		uint32_t m_count;
+		hx_timestamp_t m_total;
+		hx_timestamp_t m_self;
+		hx_timestamp_t m_min;
+		hx_timestamp_t m_max;
+		uint32_t m_histogram[StatsBuckets];
+	};
 
-	void start();
+	// Per-thread statistics used instead of records by startAggregating().  The
+	// most recently ended scopes are kept on a stack to find nesting.  The table
+	// is allocated from the heap the first time aggregating starts.
+	enum {
+		AggregateThreads = HX_PROFILER_AGGREGATE_THREADS,
+		AggregateLabels = HX_PROFILER_AGGREGATE_LABELS,
+		AggregateDepth = 32
+	};
+	struct Scope {
+		hx_timestamp_t m_begin;
+		hx_timestamp_t m_duration;
+	};
+	struct Aggregate {
+		uint32_t m_depth;
+		Scope m_scopes[AggregateDepth];
+		Stats m_stats[AggregateLabels]; // Open addressed by label address.
+	};
+
+	// Sampling mode.  Each thread keeps a stack of its active scope labels which
+	// is copied into a ring of samples by a signal handler.  Only the owning
+	// thread and its signal handler access a ShadowStack.  m_depth may exceed
+	// SampleDepth.  m_isUsed is set once the thread has entered a scope while
+	// sampling.  A sample's m_sequence is ~0u while it is being written.  The
+	// ring is allocated from the heap the first time sampling starts.
+	enum {
+		SampleDepth = HX_PROFILER_SAMPLE_DEPTH,
+		SampleCount = HX_PROFILER_MAX_SAMPLES
+	};
+	struct ShadowStack {
+		volatile bool m_isUsed;
+		volatile uint32_t m_depth;
+		const char* volatile m_labels[SampleDepth];
+	};
+	struct Stack {
+		uint32_t m_depth;
+		const char* m_labels[SampleDepth];
+	};
+	struct Sample {
+#if HX_USE_CPP11_THREADS
+		std::atomic<uint32_t> m_sequence;
+#else
+		volatile uint32_t m_sequence;
+#endif
+		Stack m_stack;
+	};
+
+	hxProfiler();
+
+	void start(bool isContinuous_=false);
+
+	// Clears samples and begins updating statistics without keeping records.
+	void startAggregating();
+
+	// Stops sampling and frees the tables allocated for aggregating and
+	// sampling.  Called by hxShutdown().
+	void shutDown();
+
+	// Clears samples and begins sampling active scopes using a SIGPROF timer.
+	void startSampling(float samplesPerSecond);
+	void writeFoldedStacks(const char* filename);
+	uint32_t samplesSize() const;
 	void stop();
 	void log();
 	void writeToChromeTracing(const char* filename);
 
-	// For testing
-	HX_INLINE uint32_t recordsSize() { return m_records.size(); }
-	HX_INLINE void recordsClear() { m_records.clear(); }
+	// Writes records ending in the last seconds without stopping sampling.
+	void writeSnapshotToChromeTracing(const char* filename, float seconds);
+
+	// Writes records added since the last flush as a FileChunk.  Call from a
+	// single thread.  Records recycled before being flushed are lost.
+	void flush(hxFile& file);
+
+	// Writes all records in a compact binary capture format using a single
+	// write.  Does not stop sampling.  The format is the 4 byte c_captureMagic
+	// followed by varints: version, cycles per second, base timestamp, label
+	// count, labels as length and characters, thread count, thread ids, record
+	// count and then records.  Records are the zigzag encoded difference between
+	// begin and the previous begin, the duration or counter value, the label
+	// index times 4 plus the Record::Kind and a thread index.
+	static const uint32_t c_captureMagic = 0x43507868u; // "hxPC"
+	void writeCapture(const char* filename);
+
+	// Converts a capture from writeCapture() to the chrome://tracing format.
+	static bool convertCaptureToChromeTracing(const char* captureFilename, const char* chromeFilename);
+
+	// Writes statistics for at most maxCount labels ordered by total time and
+	// returns the number written.  Combines records and aggregated statistics.
+	// Does not stop sampling.  Not synchronized with threads still recording.
+	uint32_t getStats(Stats* stats, uint32_t maxCount) const;
+
+	// Logs getStats() without stopping sampling.
+	void logStats() const;
+
+	// Opens the calling thread's hardware counters if needed.  Returns false if
+	// they are unavailable or HX_PROFILE_PERF_COUNTERS is not set.
+	static bool perfCountersAvailable();
+
+	// See hxProfileCounter() and hxProfileMark().
+	HX_INLINE void recordCounter(const char* label_, hx_timestamp_t value_, hxProfilerCallsite& callsite_);
+	HX_INLINE void recordMark(const char* label_, hxProfilerCallsite& callsite_);
+
+	// See hxProfilerAddFilter().  Filters may be added while other threads are
+	// profiling.  clearFilters() should not race with addFilter().
+	enum { MaxFilters = HX_PROFILER_MAX_FILTERS, FilterPrefix = 32 };
+	void addFilter(const char* prefix, uint32_t decimation);
+	void clearFilters();
+	HX_INLINE void setMinCycles(hx_timestamp_t minCycles_) { m_minCycles = minCycles_; }
+
+	// Records from all threads.  Not synchronized with threads still recording.
+	HX_INLINE void recordsClear() { clear_(); }
+	uint32_t recordsSize() const;
 
 private:
-	template<hx_cycles_t MinCycles_> friend class hxProfilerScopeInternal;
+	friend class hxProfilerScopeInternal;
+	friend struct hxProfilerThreadExit;
+	friend void hxProfilerSignalHandler(int signal);
+
+	// Values of the low bits of hxProfilerCallsite::m_state.
+	enum Callsite {
+		CallsiteDisabled,
+		CallsiteEnabled,
+		CallsiteDecimated
+	};
+	struct Filter {
+		char m_prefix[FilterPrefix];
+		uint32_t m_decimation;
+	};
+	// callsite_ is null for call sites whose label varies.
+	HX_INLINE bool isEnabled_(const char* label_, hxProfilerCallsite* callsite_);
+	bool checkCallsite_(const char* label, hxProfilerCallsite* callsite);
+	uint32_t filterDecimation_(const char* label) const;
+	void sample_();
+	HX_INLINE void record_(hx_timestamp_t begin_, hx_timestamp_t end_, const char* label_,
+		uint32_t kind_=Record::KindScope, const hx_timestamp_t* perf_=hxnull);
+
+	// Reads the calling thread's hardware counters.  Zeros if unavailable.
+	static void perfRead_(hx_timestamp_t* values);
+	void aggregate_(hx_timestamp_t begin, hx_timestamp_t end, const char* label);
+	Aggregate* claimAggregate_();
+	void clear_();
+	uint32_t blocksClaimed_() const;
+	Block* claimBlock_();
+	void releaseBlock_();
+	uint32_t copyBlock_(const Block& block, uint32_t begin, uint32_t& sequence, Record* records) const;
+	uint32_t copyRecords_(Record* records) const;
+	void writeChromeTracing_(const char* filename, hx_timestamp_t window);
+
 	bool m_isStarted;
-	hxStockpile<Record, HX_PROFILER_MAX_RECORDS> m_records;
+	bool m_isContinuous;
+	bool m_isAggregating;
+	bool m_isSampling;
+	hx_timestamp_t m_startTimestamp;
+	hx_timestamp_t m_minCycles;
+#if HX_USE_CPP11_THREADS
+	std::atomic<uint32_t> m_blocksClaimed;
+	std::atomic<uint32_t> m_aggregatesClaimed;
+	std::atomic<uint32_t> m_samplesWritten;
+	std::atomic<uint32_t> m_filterGeneration; // Invalidates call sites.
+	std::atomic<uint32_t> m_filterCount;
+	std::atomic<uint32_t> m_generation; // Invalidates blocks cached by threads.
+#else
+	uint32_t m_blocksClaimed;
+	uint32_t m_aggregatesClaimed;
+	volatile uint32_t m_samplesWritten;
+	uint32_t m_filterGeneration;
+	uint32_t m_filterCount;
+	uint32_t m_generation;
+#endif
+	Block m_blocks[BlockCount];
+	Aggregate* m_aggregates; // AggregateThreads entries once allocated.
+	Sample* m_samples; // SampleCount entries once allocated.
+	Filter m_filters[MaxFilters];
 };
 
+// Block being written by the current thread, valid while generation matches.
+extern HX_THREAD_LOCAL hxProfiler::Block* s_hxProfilerBlock;
+extern HX_THREAD_LOCAL uint32_t s_hxProfilerGeneration;
+
+// Labels of the scopes active on the current thread while sampling.
+extern HX_THREAD_LOCAL hxProfiler::ShadowStack s_hxProfilerShadowStack;
+
+HX_INLINE void hxProfiler::record_(hx_timestamp_t begin_, hx_timestamp_t end_, const char* label_,
+		uint32_t kind_, const hx_timestamp_t* perf_) {
+	if (m_isAggregating) {
+		if (kind_ == Record::KindScope) {
+			aggregate_(begin_, end_, label_);
+		}
+		return;
+	}
+
+	Block* block_ = s_hxProfilerBlock;
+#if HX_USE_CPP11_THREADS
+	uint32_t generation_ = m_generation.load(std::memory_order_relaxed);
+	uint32_t size_ = block_ ? block_->m_size.load(std::memory_order_relaxed) : 0u;
+#else
+	uint32_t generation_ = m_generation;
+	uint32_t size_ = block_ ? block_->m_size : 0u;
+#endif
+	if (!block_ || generation_ != s_hxProfilerGeneration || size_ == (uint32_t)BlockRecords) {
+		block_ = claimBlock_();
+		if (!block_) {
+			return; // Out of blocks.
+		}
+		size_ = 0u;
+	}
+
+	Record* record_ = ::new (block_->m_records.getStorage() + size_) Record(begin_, end_, label_,
+		(uint32_t)(uintptr_t)&s_hxProfilerThreadIdAddress, kind_);
+#if HX_PROFILE_PERF_COUNTERS
+	for (uint32_t i_ = 0; i_ < (uint32_t)PerfCounters; ++i_) {
+		record_->m_perf[i_] = perf_ ? perf_[i_] : 0u;
+	}
+#else
+	(void)record_;
+	(void)perf_;
+#endif
+
+	// Publishes the record to log() and writeToChromeTracing().
+#if HX_USE_CPP11_THREADS
+	block_->m_size.store(size_ + 1u, std::memory_order_release);
+#else
+	block_->m_size = size_ + 1u;
+#endif
+}
+
+HX_INLINE bool hxProfiler::isEnabled_(const char* label_, hxProfilerCallsite* callsite_) {
+	if (!callsite_) {
+		// Uncached call sites only look at the filters when there are some.
+#if HX_USE_CPP11_THREADS
+		bool isUnfiltered_ = m_filterCount.load(std::memory_order_relaxed) == 0u;
+#else
+		bool isUnfiltered_ = m_filterCount == 0u;
+#endif
+		return isUnfiltered_ || checkCallsite_(label_, hxnull);
+	}
+#if HX_USE_CPP11_THREADS
+	uint32_t state_ = (uint32_t)callsite_->m_state.load(std::memory_order_relaxed);
+	bool isCurrent_ = (state_ >> 2) == m_filterGeneration.load(std::memory_order_relaxed);
+#else
+	uint32_t state_ = (uint32_t)callsite_->m_state;
+	bool isCurrent_ = (state_ >> 2) == m_filterGeneration;
+#endif
+	if (isCurrent_ && (state_ & 3u) != (uint32_t)CallsiteDecimated) {
+		return (state_ & 3u) == (uint32_t)CallsiteEnabled;
+	}
+	return checkCallsite_(label_, callsite_);
+}
+
+HX_INLINE void hxProfiler::recordCounter(const char* label_, hx_timestamp_t value_, hxProfilerCallsite& callsite_) {
+	if (m_isStarted && isEnabled_(label_, &callsite_)) {
+		record_(hxTimeSampleTimestamp(), value_, label_, Record::KindCounter);
+	}
+}
+
+HX_INLINE void hxProfiler::recordMark(const char* label_, hxProfilerCallsite& callsite_) {
+	if (m_isStarted && isEnabled_(label_, &callsite_)) {
+		record_(hxTimeSampleTimestamp(), 0u, label_, Record::KindMark);
+	}
+}
+
 // ----------------------------------------------------------------------------
 // hxProfilerScopeInternal
 
-template<hx_cycles_t MinCycles_=0u>
 class hxProfilerScopeInternal {
 public:
-	// See hxProfileScope() below.
-	HX_INLINE hxProfilerScopeInternal(const char* labelStringLiteral)
-		: m_label(labelStringLiteral)
+	// See hxProfileScope().  minCycles is a runtime value so that it may be
+	// derived from the calibrated clock rate.  callsite_ is null for
+	// hxProfileScopeUncached().
+	HX_INLINE hxProfilerScopeInternal(const char* labelStringLiteral, hxProfilerCallsite* callsite_,
+			hx_cycles_t minCycles_=0u)
+		: m_label(labelStringLiteral), m_minCycles(minCycles_)
 	{
-		m_t0 = g_hxProfiler.m_isStarted ? hxTimeSampleCycles() : ~(hx_cycles_t)0;
+		bool isActive_ = (g_hxProfiler.m_isStarted || g_hxProfiler.m_isSampling)
+			&& g_hxProfiler.isEnabled_(labelStringLiteral, callsite_);
+		m_isSampled = isActive_ && g_hxProfiler.m_isSampling;
+		if (m_isSampled) {
+			hxProfiler::ShadowStack& stack_ = s_hxProfilerShadowStack;
+			stack_.m_isUsed = true;
+			uint32_t depth_ = stack_.m_depth;
+			if (depth_ < (uint32_t)hxProfiler::SampleDepth) {
+				stack_.m_labels[depth_] = labelStringLiteral;
+			}
+			stack_.m_depth = depth_ + 1u;
+		}
+		m_t0 = (isActive_ && g_hxProfiler.m_isStarted) ? hxTimeSampleTimestamp() : ~(hx_timestamp_t)0;
+#if HX_PROFILE_PERF_COUNTERS
+		if (m_t0 != ~(hx_timestamp_t)0) {
+			hxProfiler::perfRead_(m_perf0);
+		}
+#endif
 	}
 
 	HX_INLINE ~hxProfilerScopeInternal() {
-		if (m_t0 != ~(hx_cycles_t)0) {
-			hx_cycles_t t1_ = hxTimeSampleCycles();
-			if ((t1_ - m_t0) >= MinCycles_) {
-				void* rec_ = g_hxProfiler.m_records.emplace_back_atomic();
-				if (rec_) {
-					::new (rec_) hxProfiler::Record(m_t0, t1_, m_label,
-						(uint32_t)(uintptr_t)&s_hxProfilerThreadIdAddress);
-				}
+		if (m_isSampled) {
+			s_hxProfilerShadowStack.m_depth = s_hxProfilerShadowStack.m_depth - 1u;
+		}
+		if (m_t0 != ~(hx_timestamp_t)0) {
+#if HX_PROFILE_PERF_COUNTERS
+			hx_timestamp_t perf_[hxProfiler::PerfCounters];
+			hxProfiler::perfRead_(perf_);
+			for (uint32_t i_ = 0; i_ < (uint32_t)hxProfiler::PerfCounters; ++i_) {
+				perf_[i_] -= m_perf0[i_];
+			}
+#else
+			const hx_timestamp_t* perf_ = hxnull;
+#endif
+			hx_timestamp_t t1_ = hxTimeSampleTimestamp();
+			hx_timestamp_t delta_ = t1_ - m_t0;
+			if (delta_ >= m_minCycles && delta_ >= g_hxProfiler.m_minCycles) {
+				g_hxProfiler.record_(m_t0, t1_, m_label, hxProfiler::Record::KindScope, perf_);
 			}
 		}
 	}
@@ -77,6 +449,10 @@ private:
 	hxProfilerScopeInternal(const hxProfilerScopeInternal&); // = delete
 	void operator=(const hxProfilerScopeInternal&); // = delete
 	const char* m_label;
-	hx_cycles_t m_t0;
+	hx_timestamp_t m_t0;
+	hx_cycles_t m_minCycles;
+	bool m_isSampled;
+#if HX_PROFILE_PERF_COUNTERS
+	hx_timestamp_t m_perf0[hxProfiler::PerfCounters];
+#endif
 };
-
@@ -15,6 +15,12 @@
 #include <stdio.h>
 #endif
 
+#if HX_USE_TSC && HX_USE_CPP11_TIME
+#include <chrono>
+#elif HX_USE_TSC
+#include <time.h>
+#endif
+
 // ----------------------------------------------------------------------------
 // Implements HX_IS_DEBUGGER_PRESENT().  
 
@@ -43,7 +49,7 @@ HX_REGISTER_FILENAME_HASH
 typedef hxHashTable<hxHashTableNodeStringLiteral, 5> hxHashStringLiteral;
 
 struct hxFilenameLess {
-	HX_INLINE bool operator()(const char*& lhs, const char*& rhs) const {
+	HX_INLINE bool operator()(const char* lhs, const char* rhs) const {
 		return hxStringLiteralHashDebug(lhs) < hxStringLiteralHashDebug(rhs);
 	}
 };
@@ -69,7 +75,7 @@ static void hxPrintFileHashes() {
 		filenames.push_back(it->key);
 	}
 
-	hxInsertionSort(filenames.begin(), filenames.end(), hxFilenameLess());
+	hxSort(filenames.begin(), filenames.end(), hxFilenameLess());
 
 	for (Filenames::iterator f = filenames.begin(); f != filenames.end(); ++f) {
 		hxLog("  %08x %s\n", hxStringLiteralHashDebug(*f), *f);
@@ -89,10 +95,56 @@ void hxSettingsConstruct();
 static const char* s_hxInitFile = ""; // For trapping code running before hxMain.
 static uint32_t s_hxInitLine = 0;
 
-#if HX_USE_CPP11_TIME
+#if HX_USE_CPP11_TIME && !HX_USE_TSC
 std::chrono::high_resolution_clock::time_point g_hxTimeStart;
 #endif
 
+// Calibrated by hxTimeInit() when HX_USE_TSC.
+float g_hxTimeMillisecondsPerCycle = c_hxTimeMillisecondsPerCycle;
+hx_cycles_t g_hxTimeDefaultTimingCutoff = c_hxTimeDefaultTimingCutoff;
+
+#if HX_USE_TSC
+static double hxTimeMonotonicNanoseconds() {
+#if HX_USE_CPP11_TIME
+	return (double)std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+#else
+	timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec * 1.0e+9 + (double)ts.tv_nsec;
+#endif
+}
+#endif
+
+void hxTimeInit() {
+#if HX_USE_TSC
+#if defined(__aarch64__)
+	// The generic timer reports its own frequency.
+	uint64_t frequency;
+	__asm__ __volatile__("mrs %0, cntfrq_el0" : "=r"(frequency));
+	if (frequency != 0u) {
+		g_hxTimeMillisecondsPerCycle = (float)(1.0e+3 / (double)frequency);
+		g_hxTimeDefaultTimingCutoff = (hx_cycles_t)(frequency / 1000000u) + 1u;
+		return;
+	}
+#endif
+	// Calibrate the timestamp counter against the monotonic clock for about a
+	// millisecond.
+	double ns0 = hxTimeMonotonicNanoseconds();
+	hx_timestamp_t t0 = hxTimeSampleTimestamp();
+	double ns1 = ns0;
+	hx_timestamp_t t1 = t0;
+	while ((ns1 - ns0) < 1.0e+6 || t1 == t0) {
+		ns1 = hxTimeMonotonicNanoseconds();
+		t1 = hxTimeSampleTimestamp();
+	}
+	g_hxTimeMillisecondsPerCycle = (float)((ns1 - ns0) * 1.0e-6 / (double)(t1 - t0));
+	g_hxTimeDefaultTimingCutoff = (hx_cycles_t)(1.0e-3 / (double)g_hxTimeMillisecondsPerCycle) + 1u;
+#elif HX_USE_CPP11_TIME
+	g_hxTimeStart = std::chrono::high_resolution_clock::now();
+#endif
+}
+
 extern "C"
 void hxInitAt(const char* file, uint32_t line) {
 	hxAssertRelease(!g_hxIsInit, "internal error");
@@ -101,10 +153,7 @@ void hxInitAt(const char* file, uint32_t line) {
 	if (file) { s_hxInitFile = file; }
 	s_hxInitLine = line;
 
-#if HX_USE_CPP11_TIME
-	g_hxTimeStart = std::chrono::high_resolution_clock::now();
-#endif
-
+	hxTimeInit();
 	hxSettingsConstruct();
 	hxMemoryManagerInit();
 	hxDmaInit();
@@ -130,7 +179,7 @@ void hxLogHandler(enum hxLogLevel level, const char* format, ...) {
 extern "C"
 void hxShutdown() {
 	hxPrintFileHashes();
-	hxProfilerStop();
+	hxProfilerShutDown();
 	hxDmaShutDown();
 
 	g_hxSettings.isShuttingDown = true;
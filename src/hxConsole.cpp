@@ -151,7 +151,7 @@ void hxConsoleHelp() {
 			cmds.push_back(&*it);
 		}
 
-		hxInsertionSort(cmds.begin(), cmds.end(), hxConsoleLess());
+		hxSort(cmds.begin(), cmds.end(), hxConsoleLess());
 
 		for (hxArray<const hxConsoleHashTableNode*>::iterator it = cmds.begin();
 				it != cmds.end(); ++it) {
@@ -63,6 +63,15 @@ void hxDmaAddSyncPoint(struct hxDmaSyncPoint& syncPoint) {
 #endif
 }
 
+bool hxDmaIsSyncPointComplete(const struct hxDmaSyncPoint& syncPoint) {
+	(void)syncPoint;
+#if HX_USE_DMA_HARDWARE
+	HX_STATIC_ASSERT(!HX_USE_DMA_HARDWARE, "TODO: Configure for target.");
+#else
+	return true; // Transfers complete on return from hxDmaStart().
+#endif
+}
+
 void hxDmaStartLabeled(void* dst, const void* src, size_t bytes, const char* labelStringLiteral) {
 	hxAssertMsg(src != hxnull && dst != hxnull && bytes != 0, "dma illegal args: %s 0x%x, 0x%x, 0x%x",
 		(labelStringLiteral ? labelStringLiteral : "dma start"), (unsigned int)(uintptr_t)dst,
@@ -84,8 +93,8 @@ void hxDmaStartLabeled(void* dst, const void* src, size_t bytes, const char* lab
 
 void hxDmaAwaitSyncPointLabeled(struct hxDmaSyncPoint& syncPoint, const char* labelStringLiteral) {
 	(void)syncPoint;
-	hxProfileScopeMin((labelStringLiteral ? labelStringLiteral : "dma await"),
-		c_hxTimeDefaultTimingCutoff); (void)labelStringLiteral;
+	hxProfileScopeUncached((labelStringLiteral ? labelStringLiteral : "dma await"),
+		g_hxTimeDefaultTimingCutoff); (void)labelStringLiteral;
 	HX_STATIC_ASSERT(!HX_USE_DMA_HARDWARE, "TODO: Configure for target.");
 
 #if HX_DEBUG_DMA
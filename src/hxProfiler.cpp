@@ -4,9 +4,27 @@
 #include <hx/hxProfiler.h>
 #include <hx/hxConsole.h>
 #include <hx/hxFile.h>
+#include <hx/hxHashTable.h>
+#include <hx/hxSort.h>
 
 #if HX_PROFILE
 
+#if HX_USE_SIGPROF
+#include <signal.h>
+#include <sys/time.h>
+#endif
+
+#if HX_PROFILE_PERF_COUNTERS
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+#endif
+
 HX_REGISTER_FILENAME_HASH
 
 // ----------------------------------------------------------------------------
@@ -27,59 +45,1352 @@ static void hxProfilerWriteToChromeTracingCommand(const char* filename) {
 }
 hxConsoleCommandNamed(hxProfilerWriteToChromeTracingCommand, profiletrace);
 
+static void hxProfileStartContinuousCommand() {
+	hxProfilerStartContinuous();
+}
+hxConsoleCommandNamed(hxProfileStartContinuousCommand, profilecontinuous);
+
+static void hxProfilerSnapshotCommand(float seconds, const char* filename) {
+	hxProfilerWriteSnapshotToChromeTracing(filename, seconds);
+}
+hxConsoleCommandNamed(hxProfilerSnapshotCommand, profilesnapshot);
+
+static void hxProfilerWriteCaptureCommand(const char* filename) {
+	hxProfilerWriteCapture(filename);
+}
+hxConsoleCommandNamed(hxProfilerWriteCaptureCommand, profilecapture);
+
+// Converts a capture to chrome://tracing format as <filename>.json.
+static void hxProfilerConvertCommand(const char* filename) {
+	char chromeFilename[HX_MAX_LINE] = "";
+	hxsnprintf(chromeFilename, HX_MAX_LINE, "%s.json", filename);
+	hxProfiler::convertCaptureToChromeTracing(filename, chromeFilename);
+}
+hxConsoleCommandNamed(hxProfilerConvertCommand, profileconvert);
+
+static void hxProfileStartAggregatingCommand() {
+	hxProfilerStartAggregating();
+}
+hxConsoleCommandNamed(hxProfileStartAggregatingCommand, profileaggregate);
+
+static void hxProfilerLogStatsCommand() {
+	hxProfilerLogStats();
+}
+hxConsoleCommandNamed(hxProfilerLogStatsCommand, profilestats);
+
+static void hxProfilerEnableCommand(const char* prefix) {
+	hxProfilerAddFilter(prefix, 1u);
+}
+hxConsoleCommandNamed(hxProfilerEnableCommand, profileenable);
+
+static void hxProfilerDisableCommand(const char* prefix) {
+	hxProfilerAddFilter(prefix, 0u);
+}
+hxConsoleCommandNamed(hxProfilerDisableCommand, profiledisable);
+
+static void hxProfilerDecimateCommand(uint32_t decimation, const char* prefix) {
+	hxProfilerAddFilter(prefix, decimation);
+}
+hxConsoleCommandNamed(hxProfilerDecimateCommand, profiledecimate);
+
+static void hxProfilerClearFiltersCommand() {
+	hxProfilerClearFilters();
+}
+hxConsoleCommandNamed(hxProfilerClearFiltersCommand, profilefilterclear);
+
+static void hxProfilerMinCommand(float microseconds) {
+	double cycles = (double)microseconds * 1.0e-3 / (double)g_hxTimeMillisecondsPerCycle;
+	hxProfilerSetMinCycles(cycles > 0.0 ? (hx_timestamp_t)cycles : 0u);
+}
+hxConsoleCommandNamed(hxProfilerMinCommand, profilemin);
+
+static void hxProfileStartSamplingCommand(float samplesPerSecond) {
+	hxProfilerStartSampling(samplesPerSecond);
+}
+hxConsoleCommandNamed(hxProfileStartSamplingCommand, profilesample);
+
+static void hxProfilerWriteFoldedStacksCommand(const char* filename) {
+	hxProfilerWriteFoldedStacks(filename);
+}
+hxConsoleCommandNamed(hxProfilerWriteFoldedStacksCommand, profilefolded);
+
+// ----------------------------------------------------------------------------
+// Capture format support
+
+// Maps a label address or a thread id to a capture table index.
+template<typename Key_>
+class hxProfilerIndexNode : public hxHashTableNodeBase<Key_> {
+public:
+	hxProfilerIndexNode(const Key_& k, uint32_t h) : hxHashTableNodeBase<Key_>(k), m_hash(h), m_index(~0u) { }
+	uint32_t hash() const { return m_hash; }
+	static uint32_t hash(const Key_& k) { return (uint32_t)(uintptr_t)k * (uint32_t)0x61C88647u; }
+	static bool keyEqual(const hxProfilerIndexNode& lhs, const Key_& rhs, uint32_t rhsHash) {
+		(void)rhsHash; return lhs.key == rhs;
+	}
+	uint32_t m_hash;
+	uint32_t m_index;
+};
+
+// Version 2 added counters and markers.
+static const uint32_t c_hxProfilerCaptureVersion = 2u;
+
+// Records encode their kind with their label index as label * c_hxProfilerCaptureKinds + kind.
+static const uint32_t c_hxProfilerCaptureKinds = 4u;
+HX_STATIC_ASSERT((uint32_t)hxProfiler::Record::KindCount_ <= 4u, "c_hxProfilerCaptureKinds");
+
+// Maximum size of a varint.
+static const size_t c_hxProfilerVarintMax = (sizeof(hx_timestamp_t) * 8u + 6u) / 7u;
+
+// Little endian base 128.
+static uint8_t* hxProfilerEncodeVarint(uint8_t* out, hx_timestamp_t x) {
+	while (x >= 0x80u) {
+		*out++ = (uint8_t)(x | 0x80u);
+		x >>= 7;
+	}
+	*out++ = (uint8_t)x;
+	return out;
+}
+
+// Zigzag encodes x - previous without requiring a signed type.
+static hx_timestamp_t hxProfilerZigzag(hx_timestamp_t x, hx_timestamp_t previous) {
+	return (x >= previous) ? (hx_timestamp_t)((x - previous) << 1)
+		: (hx_timestamp_t)(((previous - x) << 1) - 1u);
+}
+
+static hx_timestamp_t hxProfilerUnzigzag(hx_timestamp_t z, hx_timestamp_t previous) {
+	return (z & 1u) ? (hx_timestamp_t)(previous - ((z >> 1) + 1u)) : (hx_timestamp_t)(previous + (z >> 1));
+}
+
+// Buffered reading of captures.
+class hxProfilerCaptureReader {
+public:
+	explicit hxProfilerCaptureReader(hxFile& file) : m_file(file), m_position(0u), m_size(0u) { }
+
+	bool readByte(uint8_t& x) {
+		if (m_position == m_size) {
+			m_size = m_file.read(m_buffer, sizeof m_buffer);
+			m_position = 0u;
+			if (m_size == 0u) {
+				return false;
+			}
+		}
+		x = m_buffer[m_position++];
+		return true;
+	}
+
+	bool readVarint(hx_timestamp_t& x) {
+		x = 0u;
+		for (uint32_t shift = 0u; shift < c_hxProfilerVarintMax * 7u; shift += 7u) {
+			uint8_t byte;
+			if (!readByte(byte)) {
+				return false;
+			}
+			x |= (hx_timestamp_t)(byte & 0x7fu) << shift;
+			if ((byte & 0x80u) == 0u) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+	bool readVarint32(uint32_t& x) {
+		hx_timestamp_t t = 0u;
+		bool isOk = readVarint(t) && t <= 0xffffffffu;
+		x = (uint32_t)t;
+		return isOk;
+	}
+
+private:
+	hxFile& m_file;
+	size_t m_position;
+	size_t m_size;
+	uint8_t m_buffer[4096];
+};
+
+// Scopes are written as "B" and "E" events, counters as "C" events and markers
+// as thread scoped "i" events.  end is ignored for counters and markers.
+// args are optional JSON members added to the "E" event of a scope.
+static void hxProfilerPrintChromeEvent(hxFile& f, bool isFirst, const char* label, uint32_t threadId,
+		uint32_t kind, double beginMicroseconds, double endMicroseconds, hx_timestamp_t value,
+		const char* args=hxnull) {
+	if (!isFirst) { f.print(",\n"); }
+	const char* bn = hxBasename(label);
+	if (kind == hxProfiler::Record::KindCounter) {
+		f.print("{\"name\":\"%s\",\"cat\":\"PERF\",\"ph\":\"C\",\"pid\":0,\"tid\":%u,\"ts\":%.3f,"
+			"\"args\":{\"value\":%.0f}}", bn, (unsigned int)threadId, beginMicroseconds, (double)value);
+		return;
+	}
+	if (kind == hxProfiler::Record::KindMark) {
+		f.print("{\"name\":\"%s\",\"cat\":\"PERF\",\"ph\":\"i\",\"s\":\"t\",\"pid\":0,\"tid\":%u,\"ts\":%.3f}",
+			bn, (unsigned int)threadId, beginMicroseconds);
+		return;
+	}
+	f.print("{\"name\":\"%s\",\"cat\":\"PERF\",\"ph\":\"B\",\"pid\":0,\"tid\":%u,\"ts\":%.3f},\n",
+		bn, (unsigned int)threadId, beginMicroseconds);
+	f.print("{\"name\":\"%s\",\"cat\":\"PERF\",\"ph\":\"E\",\"pid\":0,\"tid\":%u,\"ts\":%.3f%s%s%s}",
+		bn, (unsigned int)threadId, endMicroseconds, args ? ",\"args\":{" : "", args ? args : "",
+		args ? "}" : "");
+}
+
+// ----------------------------------------------------------------------------
+// Statistics support
+
+static uint32_t hxProfilerLog2(uint32_t x) {
+	uint32_t log2 = 0u;
+	for (uint32_t shift = 16u; shift != 0u; shift >>= 1) {
+		if (x >= (1u << shift)) {
+			x >>= shift;
+			log2 += shift;
+		}
+	}
+	return log2;
+}
+
+// Buckets 0 to 3 hold exact values.  Above that each power of 2 is divided into
+// 4 buckets using the 2 bits following the leading bit.
+static uint32_t hxProfilerStatsBucket(hx_timestamp_t cycles) {
+	if (((cycles >> 16) >> 16) != 0u) {
+		return (uint32_t)hxProfiler::StatsBuckets - 1u;
+	}
+	uint32_t x = (uint32_t)cycles;
+	if (x < 4u) {
+		return x;
+	}
+	uint32_t log2 = hxProfilerLog2(x);
+	return 4u * (log2 - 1u) + ((x >> (log2 - 2u)) & 3u);
+}
+
+static double hxProfilerStatsBucketMidpoint(uint32_t bucket) {
+	if (bucket < 4u) {
+		return (double)bucket;
+	}
+	uint32_t shift = bucket / 4u - 1u;
+	return (double)((4u + (bucket & 3u)) << shift) + (double)((1u << shift) - 1u) * 0.5;
+}
+
+// Records are written by each thread as scopes end.  The preceding records of
+// the same thread that began no earlier than a record are nested within it.
+// Removes them from the stack and returns their total duration.
+static hx_timestamp_t hxProfilerPopNested(hxProfiler::Scope* scopes, uint32_t& depth, hx_timestamp_t begin) {
+	hx_timestamp_t nested = 0u;
+	while (depth > 0u && scopes[depth - 1u].m_begin >= begin) {
+		nested += scopes[--depth].m_duration;
+	}
+	return nested;
+}
+
+// Hashes label addresses.  The high bits are used for small tables.
+static uint32_t hxProfilerLabelHash(const char* label) {
+	return (uint32_t)(uintptr_t)label * (uint32_t)0x61C88647u;
+}
+
+// Statistics for a label address.
+class hxProfilerStatsNode : public hxHashTableNodeBase<const char*> {
+public:
+	hxProfilerStatsNode(const char* k, uint32_t h) : hxHashTableNodeBase<const char*>(k), m_hash(h) {
+		m_stats.clear(k);
+	}
+	uint32_t hash() const { return m_hash; }
+	static uint32_t hash(const char* k) { return hxProfilerLabelHash(k); }
+	static bool keyEqual(const hxProfilerStatsNode& lhs, const char* rhs, uint32_t rhsHash) {
+		(void)rhsHash; return lhs.key == rhs;
+	}
+	uint32_t m_hash;
+	hxProfiler::Stats m_stats;
+};
+
+// Orders by decreasing total time.
+struct hxProfilerStatsGreater {
+	bool operator()(const hxProfilerStatsNode* lhs, const hxProfilerStatsNode* rhs) const {
+		return lhs->m_stats.m_total > rhs->m_stats.m_total;
+	}
+};
+
+// Counts samples of identical stacks.
+class hxProfilerFoldedNode : public hxHashTableNodeBase<const hxProfiler::Stack*> {
+public:
+	hxProfilerFoldedNode(const hxProfiler::Stack* k, uint32_t h)
+		: hxHashTableNodeBase<const hxProfiler::Stack*>(k), m_hash(h), m_count(0u) {
+	}
+	uint32_t hash() const { return m_hash; }
+	static uint32_t hash(const hxProfiler::Stack* k) {
+		uint32_t h = k->m_depth;
+		for (uint32_t i = 0; i < k->m_depth; ++i) {
+			h = (h ^ (uint32_t)(uintptr_t)k->m_labels[i]) * (uint32_t)0x61C88647u;
+		}
+		return h;
+	}
+	static bool keyEqual(const hxProfilerFoldedNode& lhs, const hxProfiler::Stack* rhs, uint32_t rhsHash) {
+		return lhs.m_hash == rhsHash && lhs.key->m_depth == rhs->m_depth
+			&& ::memcmp(lhs.key->m_labels, rhs->m_labels, rhs->m_depth * sizeof(const char*)) == 0;
+	}
+	uint32_t m_hash;
+	uint32_t m_count;
+};
+
+// Orders blocks by claim sequence.
+struct hxProfilerBlockOrder {
+	bool operator<(const hxProfilerBlockOrder& rhs) const { return m_sequence < rhs.m_sequence; }
+	uint32_t m_sequence;
+	uint32_t m_index;
+};
+
 // ----------------------------------------------------------------------------
 // variables
 
 // Use the address of a thread local variable as a unique thread id.
 HX_THREAD_LOCAL uint8_t s_hxProfilerThreadIdAddress = 0;
 
+HX_THREAD_LOCAL hxProfiler::Block* s_hxProfilerBlock = hxnull;
+HX_THREAD_LOCAL uint32_t s_hxProfilerGeneration = 0u;
+
+HX_THREAD_LOCAL hxProfiler::ShadowStack s_hxProfilerShadowStack;
+
+// SIGPROF handler used by startSampling().
+void hxProfilerSignalHandler(int signal);
+
+// Statistics being updated by the current thread, valid while generation matches.
+static HX_THREAD_LOCAL hxProfiler::Aggregate* s_hxProfilerAggregate = hxnull;
+static HX_THREAD_LOCAL uint32_t s_hxProfilerAggregateGeneration = 0u;
+
+// Per-thread decimation counts.  See hxProfiler::checkCallsite_().
+static const uint32_t hxProfilerDecimationCounters = 16u;
+static HX_THREAD_LOCAL uint32_t s_hxProfilerDecimationCounts[hxProfilerDecimationCounters];
+
+#if HX_PROFILE_PERF_COUNTERS
+// Hardware counters opened by a thread as a group led by the first counter.
+// The pages mapped for each counter allow reading it with rdpmc.
+struct hxProfilerPerfThread {
+	bool m_isOpened;
+	bool m_isAvailable;
+	int m_fds[hxProfiler::PerfCounters];
+	perf_event_mmap_page* m_pages[hxProfiler::PerfCounters];
+};
+static HX_THREAD_LOCAL hxProfilerPerfThread s_hxProfilerPerf;
+static void hxProfilerPerfClose();
+#endif
+
+// Releases the block owned by a thread when it exits so that continuous mode
+// may recycle it.  Also closes hardware counters.
+struct hxProfilerThreadExit {
+	~hxProfilerThreadExit() {
+		g_hxProfiler.releaseBlock_();
+#if HX_PROFILE_PERF_COUNTERS
+		hxProfilerPerfClose();
+#endif
+	}
+	bool m_isUsed;
+};
+static HX_THREAD_LOCAL hxProfilerThreadExit s_hxProfilerThreadExit;
+
 hxProfiler g_hxProfiler;
 
+const char* const hxProfiler::c_perfCounterNames[hxProfiler::PerfCounters] = {
+	"instructions", "cycles", "llc_misses", "branch_misses"
+};
+
+// ----------------------------------------------------------------------------
+// Hardware counters
+
+#if HX_PROFILE_PERF_COUNTERS
+static void hxProfilerPerfOpen() {
+	hxProfilerPerfThread& perf = s_hxProfilerPerf;
+	perf.m_isOpened = true;
+	s_hxProfilerThreadExit.m_isUsed = true;
+
+	static const uint64_t c_configs[hxProfiler::PerfCounters] = {
+		PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CPU_CYCLES,
+		PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES
+	};
+	const size_t pageSize = (size_t)::sysconf(_SC_PAGESIZE);
+	for (uint32_t i = 0; i < (uint32_t)hxProfiler::PerfCounters; ++i) {
+		perf_event_attr attr;
+		::memset(&attr, 0x00, sizeof attr);
+		attr.size = sizeof attr;
+		attr.type = PERF_TYPE_HARDWARE;
+		attr.config = c_configs[i];
+		attr.disabled = (i == 0u) ? 1u : 0u; // The leader enables the group.
+		attr.exclude_kernel = 1u;
+		attr.exclude_hv = 1u;
+		int fd = (int)::syscall(__NR_perf_event_open, &attr, 0, -1, (i == 0u) ? -1 : perf.m_fds[0], 0);
+		if (fd < 0) {
+			hxWarn("perf_event_open %s unavailable", hxProfiler::c_perfCounterNames[i]);
+			for (uint32_t j = i; j--;) {
+				if (perf.m_pages[j]) {
+					::munmap(perf.m_pages[j], pageSize);
+				}
+				::close(perf.m_fds[j]);
+			}
+			return;
+		}
+		perf.m_fds[i] = fd;
+		void* page = ::mmap(hxnull, pageSize, PROT_READ, MAP_SHARED, fd, 0);
+		perf.m_pages[i] = (page != MAP_FAILED) ? (perf_event_mmap_page*)page : hxnull;
+	}
+	::ioctl(perf.m_fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+	perf.m_isAvailable = true;
+}
+
+static void hxProfilerPerfClose() {
+	hxProfilerPerfThread& perf = s_hxProfilerPerf;
+	if (perf.m_isAvailable) {
+		const size_t pageSize = (size_t)::sysconf(_SC_PAGESIZE);
+		for (uint32_t i = (uint32_t)hxProfiler::PerfCounters; i--;) {
+			if (perf.m_pages[i]) {
+				::munmap(perf.m_pages[i], pageSize);
+			}
+			::close(perf.m_fds[i]);
+		}
+	}
+	perf.m_isAvailable = false;
+}
+
+// Uses rdpmc when the kernel has enabled it for the counter and read()
+// otherwise.  The mapped page is protected by a sequence lock.
+static hx_timestamp_t hxProfilerPerfReadCounter(int fd, const volatile perf_event_mmap_page* page) {
+#if defined(__x86_64__) || defined(__i386__)
+	if (page && page->cap_user_rdpmc) {
+		for (;;) {
+			uint32_t sequence = page->lock;
+			__asm__ __volatile__("" ::: "memory");
+			uint32_t index = page->index;
+			if (index == 0u) {
+				break; // Not currently scheduled.
+			}
+			int64_t count = page->offset;
+			uint32_t width = page->pmc_width;
+			count += (int64_t)((uint64_t)__rdpmc((int)index - 1) << (64u - width)) >> (64u - width);
+			__asm__ __volatile__("" ::: "memory");
+			if (page->lock == sequence) {
+				return (hx_timestamp_t)count;
+			}
+		}
+	}
+#else
+	(void)page;
+#endif
+	uint64_t count = 0u;
+	if (::read(fd, &count, sizeof count) != (ssize_t)sizeof count) {
+		count = 0u;
+	}
+	return (hx_timestamp_t)count;
+}
+#endif // HX_PROFILE_PERF_COUNTERS
+
+bool hxProfiler::perfCountersAvailable() {
+#if HX_PROFILE_PERF_COUNTERS
+	if (!s_hxProfilerPerf.m_isOpened) {
+		hxProfilerPerfOpen();
+	}
+	return s_hxProfilerPerf.m_isAvailable;
+#else
+	return false;
+#endif
+}
+
+void hxProfiler::perfRead_(hx_timestamp_t* values) {
+#if HX_PROFILE_PERF_COUNTERS
+	hxProfilerPerfThread& perf = s_hxProfilerPerf;
+	if (!perf.m_isOpened) {
+		hxProfilerPerfOpen();
+	}
+	for (uint32_t i = 0; i < (uint32_t)PerfCounters; ++i) {
+		values[i] = perf.m_isAvailable ? hxProfilerPerfReadCounter(perf.m_fds[i], perf.m_pages[i]) : 0u;
+	}
+#else
+	(void)values;
+#endif
+}
+
 // ----------------------------------------------------------------------------
 // hxProfiler
 
-void hxProfiler::start() {
-	m_records.clear();
+hxProfiler::hxProfiler() : m_isStarted(false), m_isContinuous(false), m_isAggregating(false),
+		m_isSampling(false), m_startTimestamp(0u), m_minCycles(0u), m_aggregates(hxnull),
+		m_samples(hxnull) {
+	m_blocksClaimed = 0u;
+	m_filterGeneration = 1u; // Call sites start with generation 0.
+	m_filterCount = 0u;
+	m_aggregatesClaimed = 0u;
+	m_samplesWritten = 0u;
+	m_generation = 0u;
+	for (uint32_t i = 0; i < (uint32_t)BlockCount; ++i) {
+		Block& block = m_blocks[i];
+		block.m_size = 0u;
+		block.m_sequence = 0u;
+		block.m_isOwned = 0u;
+		block.m_flushedSequence = ~0u;
+		block.m_flushedSize = 0u;
+	}
+}
+
+void hxProfiler::start(bool isContinuous) {
+	stop();
+	clear_();
+	m_isContinuous = isContinuous;
+	m_isAggregating = false;
 	m_isStarted = true;
 }
 
+void hxProfiler::startAggregating() {
+	stop();
+	clear_();
+	if (!m_aggregates) {
+		// Most targets never aggregate.  Keep the table out of g_hxProfiler.
+		m_aggregates = (Aggregate*)hxMallocExt(AggregateThreads * sizeof(Aggregate), hxMemoryManagerId_Heap);
+		::memset((void*)m_aggregates, 0x00, AggregateThreads * sizeof(Aggregate));
+	}
+	m_isContinuous = false;
+	m_isAggregating = true;
+	m_isStarted = true;
+}
+
+void hxProfiler::startSampling(float samplesPerSecond) {
+	stop();
+	clear_();
+#if HX_USE_SIGPROF
+	if (!m_samples) {
+		// Most targets never sample.  Keep the ring out of g_hxProfiler.
+		m_samples = (Sample*)hxMallocExt(SampleCount * sizeof(Sample), hxMemoryManagerId_Heap);
+		for (uint32_t i = 0; i < (uint32_t)SampleCount; ++i) {
+			::new(m_samples + i) Sample();
+			m_samples[i].m_sequence = ~0u;
+		}
+	}
+
+	// ITIMER_PROF is process wide and SIGPROF is delivered to whichever thread
+	// is using CPU time.  sample_() ignores threads that have not entered a
+	// scope while sampling.
+	static bool s_isHandlerInstalled = false;
+	if (!s_isHandlerInstalled) {
+		struct sigaction action;
+		::memset(&action, 0x00, sizeof action);
+		action.sa_handler = hxProfilerSignalHandler;
+		action.sa_flags = SA_RESTART;
+		::sigemptyset(&action.sa_mask);
+		s_isHandlerInstalled = ::sigaction(SIGPROF, &action, hxnull) == 0;
+		hxWarnCheck(s_isHandlerInstalled, "sigaction SIGPROF failed");
+	}
+
+	double microseconds = 1.0e+6 / (double)hxMax(samplesPerSecond, 1.0f);
+	struct itimerval timer;
+	timer.it_interval.tv_sec = (time_t)(microseconds * 1.0e-6);
+	timer.it_interval.tv_usec = (suseconds_t)hxMax(microseconds - (double)timer.it_interval.tv_sec * 1.0e+6, 1.0);
+	timer.it_value = timer.it_interval;
+	m_isSampling = s_isHandlerInstalled;
+	if (m_isSampling && ::setitimer(ITIMER_PROF, &timer, hxnull) != 0) {
+		hxWarn("setitimer failed");
+		m_isSampling = false;
+	}
+#else
+	(void)samplesPerSecond;
+	hxWarn("sampling requires HX_USE_SIGPROF");
+#endif
+}
+
+void hxProfiler::shutDown() {
+	stop();
+	clear_();
+	if (m_aggregates) {
+		hxFree(m_aggregates);
+		m_aggregates = hxnull;
+	}
+	if (m_samples) {
+		for (uint32_t i = 0; i < (uint32_t)SampleCount; ++i) {
+			m_samples[i].~Sample();
+		}
+		hxFree(m_samples);
+		m_samples = hxnull;
+	}
+}
+
+void hxProfiler::addFilter(const char* prefix, uint32_t decimation) {
+	uint32_t count = m_filterCount;
+	if (count == (uint32_t)MaxFilters) {
+		hxWarn("too many profiler filters");
+		return;
+	}
+	Filter& filter = m_filters[count];
+	size_t length = ::strlen(prefix);
+	while (length > 0u && (prefix[length - 1u] == ' ' || prefix[length - 1u] == '\n')) {
+		--length; // Trailing console whitespace.
+	}
+	length = hxMin(length, sizeof filter.m_prefix - 1u);
+	::memcpy(filter.m_prefix, prefix, length);
+	filter.m_prefix[length] = '\0';
+	filter.m_decimation = decimation;
+
+	// Publishes the filter to checkCallsite_() and then invalidates call sites.
+#if HX_USE_CPP11_THREADS
+	m_filterCount.store(count + 1u, std::memory_order_release);
+#else
+	m_filterCount = count + 1u;
+#endif
+	++m_filterGeneration;
+}
+
+void hxProfiler::clearFilters() {
+	m_filterCount = 0u;
+	++m_filterGeneration;
+}
+
 void hxProfiler::stop() {
 	m_isStarted = false;
+#if HX_USE_SIGPROF
+	if (m_isSampling) {
+		struct itimerval timer;
+		::memset(&timer, 0x00, sizeof timer);
+		::setitimer(ITIMER_PROF, &timer, hxnull);
+	}
+#endif
+	m_isSampling = false;
 }
 
 void hxProfiler::log() {
 	m_isStarted = false;
 
-	for (uint32_t i = 0; i < m_records.size(); ++i) {
-		const hxProfiler::Record& rec = m_records[i];
+	for (uint32_t i = 0, claimed = blocksClaimed_(); i < claimed; ++i) {
+		const Block& block = m_blocks[i];
+		const Record* recs = block.m_records.getStorage();
+		for (uint32_t j = 0, size = block.m_size; j < size; ++j) {
+			const hxProfiler::Record& rec = recs[j];
+			if (rec.m_kind == Record::KindCounter) {
+				hxLogRelease("profile %s: counter %.0f thread %x\n", hxBasename(rec.m_label),
+					(double)rec.m_end, (unsigned int)rec.m_threadId);
+				continue;
+			}
+			if (rec.m_kind == Record::KindMark) {
+				hxLogRelease("profile %s: mark thread %x\n", hxBasename(rec.m_label),
+					(unsigned int)rec.m_threadId);
+				continue;
+			}
 
-		uint32_t delta = rec.m_end - rec.m_begin;
-		hxLogRelease("profile %s: %fms cycles %u thread %x\n", hxBasename(rec.m_label),
-			delta * (double)c_hxTimeMillisecondsPerCycle, (unsigned int)delta,
-			(unsigned int)rec.m_threadId);
+			hx_timestamp_t delta = rec.m_end - rec.m_begin;
+			hxLogRelease("profile %s: %fms cycles %.0f thread %x\n", hxBasename(rec.m_label),
+				(double)delta * (double)g_hxTimeMillisecondsPerCycle, (double)delta,
+				(unsigned int)rec.m_threadId);
+		}
 	}
 }
 
 void hxProfiler::writeToChromeTracing(const char* filename) {
 	m_isStarted = false;
+	writeChromeTracing_(filename, ~(hx_timestamp_t)0);
+}
+
+void hxProfiler::writeSnapshotToChromeTracing(const char* filename, float seconds) {
+	double window = (double)seconds * 1.0e+3 / (double)g_hxTimeMillisecondsPerCycle;
+	writeChromeTracing_(filename, window < (double)~(hx_timestamp_t)0 ? (hx_timestamp_t)window : ~(hx_timestamp_t)0);
+}
 
+void hxProfiler::flush(hxFile& file) {
+	hxAllocator<Record, BlockRecords> copy;
+	for (uint32_t i = 0, claimed = blocksClaimed_(); i < claimed; ++i) {
+		Block& block = m_blocks[i];
+		uint32_t sequence = block.m_sequence;
+		uint32_t begin = (block.m_flushedSequence == sequence) ? block.m_flushedSize : 0u;
+		uint32_t count = copyBlock_(block, begin, sequence, copy.getStorage());
+		if (count == 0u) {
+			continue;
+		}
+		block.m_flushedSequence = sequence;
+		block.m_flushedSize = begin + count;
+
+		FileChunk chunk;
+		chunk.m_magic = FileChunk::c_magic;
+		chunk.m_count = count;
+		file.write1(chunk);
+		for (uint32_t j = 0; j < count; ++j) {
+			const Record& rec = copy.getStorage()[j];
+			uint32_t length = (uint32_t)::strlen(rec.m_label);
+			file.write1(rec.m_begin);
+			file.write1(rec.m_end);
+			file.write1(rec.m_threadId);
+			file.write1(rec.m_kind);
+			file.write1(length);
+			file.write(rec.m_label, length);
+		}
+	}
+}
+
+void hxProfiler::writeCapture(const char* filename) {
+	Record* records = (Record*)hxMalloc(HX_PROFILER_MAX_RECORDS * sizeof(Record));
+	uint32_t count = copyRecords_(records);
+
+	// Assign table indices in order of first use.
+	hxHashTable<hxProfilerIndexNode<const char*>, 8> labels;
+	hxHashTable<hxProfilerIndexNode<uint32_t>, 4> threads;
+	const char** labelTable = (const char**)hxMalloc((count + 1u) * sizeof(const char*));
+	uint32_t* threadTable = (uint32_t*)hxMalloc((count + 1u) * sizeof(uint32_t));
+	uint32_t* indices = (uint32_t*)hxMalloc((count + 1u) * 2u * sizeof(uint32_t));
+	size_t labelBytes = 0u;
+	for (uint32_t i = 0; i < count; ++i) {
+		const Record& rec = records[i];
+		hxProfilerIndexNode<const char*>& label = labels.insert_unique(rec.m_label);
+		if (label.m_index == ~0u) {
+			label.m_index = labels.size() - 1u;
+			labelTable[label.m_index] = rec.m_label;
+			labelBytes += ::strlen(rec.m_label);
+		}
+		hxProfilerIndexNode<uint32_t>& thread = threads.insert_unique(rec.m_threadId);
+		if (thread.m_index == ~0u) {
+			thread.m_index = threads.size() - 1u;
+			threadTable[thread.m_index] = rec.m_threadId;
+		}
+		indices[2u * i] = label.m_index;
+		indices[2u * i + 1u] = thread.m_index;
+	}
+
+	size_t capacity = 4u + labelBytes + c_hxProfilerVarintMax
+		* (6u + labels.size() * 2u + threads.size() + count * 4u);
+	uint8_t* buffer = (uint8_t*)hxMalloc(capacity);
+	uint8_t* out = buffer;
+	for (uint32_t i = 0; i < 4u; ++i) {
+		*out++ = (uint8_t)(c_captureMagic >> (i * 8u));
+	}
+	out = hxProfilerEncodeVarint(out, c_hxProfilerCaptureVersion);
+	out = hxProfilerEncodeVarint(out, (hx_timestamp_t)(1.0e+3 / (double)g_hxTimeMillisecondsPerCycle + 0.5));
+	out = hxProfilerEncodeVarint(out, m_startTimestamp);
+
+	out = hxProfilerEncodeVarint(out, labels.size());
+	for (uint32_t i = 0; i < labels.size(); ++i) {
+		size_t length = ::strlen(labelTable[i]);
+		out = hxProfilerEncodeVarint(out, (hx_timestamp_t)length);
+		::memcpy(out, labelTable[i], length);
+		out += length;
+	}
+	out = hxProfilerEncodeVarint(out, threads.size());
+	for (uint32_t i = 0; i < threads.size(); ++i) {
+		out = hxProfilerEncodeVarint(out, threadTable[i]);
+	}
+
+	out = hxProfilerEncodeVarint(out, count);
+	hx_timestamp_t previous = m_startTimestamp;
+	for (uint32_t i = 0; i < count; ++i) {
+		const Record& rec = records[i];
+		out = hxProfilerEncodeVarint(out, hxProfilerZigzag(rec.m_begin, previous));
+		out = hxProfilerEncodeVarint(out, rec.m_kind == Record::KindScope ? rec.m_end - rec.m_begin
+			: rec.m_end);
+		out = hxProfilerEncodeVarint(out, (hx_timestamp_t)indices[2u * i] * c_hxProfilerCaptureKinds + rec.m_kind);
+		out = hxProfilerEncodeVarint(out, indices[2u * i + 1u]);
+		previous = rec.m_begin;
+	}
+	hxAssert((size_t)(out - buffer) <= capacity);
+
+	hxFile f(hxFile::out, "%s", filename);
+	f.write(buffer, (size_t)(out - buffer));
+
+	hxFree(buffer);
+	hxFree(indices);
+	hxFree(threadTable);
+	hxFree(labelTable);
+	hxFree(records);
+
+	hxLogConsole("wrote %s.\n", filename);
+}
+
+bool hxProfiler::convertCaptureToChromeTracing(const char* captureFilename, const char* chromeFilename) {
+	hxFile in(hxFile::in | hxFile::fallible, "%s", captureFilename);
+	if (!in.is_open()) {
+		hxWarn("cannot open %s", captureFilename);
+		return false;
+	}
+	hxProfilerCaptureReader reader(in);
+
+	uint32_t magic = 0u;
+	for (uint32_t i = 0; i < 4u; ++i) {
+		uint8_t byte = 0u;
+		reader.readByte(byte);
+		magic |= (uint32_t)byte << (i * 8u);
+	}
+	uint32_t version = 0u;
+	hx_timestamp_t cyclesPerSecond = 0u;
+	hx_timestamp_t previous = 0u;
+	uint32_t labelCount = 0u;
+	if (magic != c_captureMagic || !reader.readVarint32(version) || version != c_hxProfilerCaptureVersion
+			|| !reader.readVarint(cyclesPerSecond) || cyclesPerSecond == 0u
+			|| !reader.readVarint(previous) || !reader.readVarint32(labelCount)) {
+		hxWarn("not a profiler capture: %s", captureFilename);
+		return false;
+	}
+
+	const double microsecondsPerCycle = 1.0e+6 / (double)cyclesPerSecond;
+	const double start = (double)previous;
+	char** labels = (char**)hxMalloc((labelCount + 1u) * sizeof(char*));
+	::memset(labels, 0x00, (labelCount + 1u) * sizeof(char*));
+	uint32_t* threads = hxnull;
+	bool isOk = true;
+	for (uint32_t i = 0; isOk && i < labelCount; ++i) {
+		uint32_t length = 0u;
+		isOk = reader.readVarint32(length);
+		if (isOk) {
+			labels[i] = (char*)hxMalloc(length + 1u);
+			for (uint32_t j = 0; isOk && j < length; ++j) {
+				isOk = reader.readByte(*(uint8_t*)(labels[i] + j));
+			}
+			labels[i][length] = '\0';
+		}
+	}
+
+	uint32_t threadCount = 0u;
+	isOk = isOk && reader.readVarint32(threadCount);
+	if (isOk) {
+		threads = (uint32_t*)hxMalloc((threadCount + 1u) * sizeof(uint32_t));
+		for (uint32_t i = 0; isOk && i < threadCount; ++i) {
+			isOk = reader.readVarint32(threads[i]);
+		}
+	}
+
+	uint32_t count = 0u;
+	isOk = isOk && reader.readVarint32(count);
+	if (isOk) {
+		hxFile f(hxFile::out, "%s", chromeFilename);
+		f.print("[\n");
+		for (uint32_t i = 0; isOk && i < count; ++i) {
+			hx_timestamp_t begin = 0u;
+			hx_timestamp_t duration = 0u;
+			uint32_t label = 0u;
+			uint32_t thread = 0u;
+			isOk = reader.readVarint(begin) && reader.readVarint(duration)
+				&& reader.readVarint32(label) && reader.readVarint32(thread)
+				&& label / c_hxProfilerCaptureKinds < labelCount && thread < threadCount
+				&& label % c_hxProfilerCaptureKinds < (uint32_t)Record::KindCount_;
+			if (isOk) {
+				begin = hxProfilerUnzigzag(begin, previous);
+				previous = begin;
+				hxProfilerPrintChromeEvent(f, i == 0u, labels[label / c_hxProfilerCaptureKinds],
+					threads[thread], label % c_hxProfilerCaptureKinds,
+					((double)begin - start) * microsecondsPerCycle,
+					((double)(begin + duration) - start) * microsecondsPerCycle, duration);
+			}
+		}
+		f.print("\n]\n");
+	}
+
+	for (uint32_t i = 0; i < labelCount && labels[i]; ++i) {
+		hxFree(labels[i]);
+	}
+	hxFree(labels);
+	if (threads) {
+		hxFree(threads);
+	}
+
+	if (!isOk) {
+		hxWarn("truncated profiler capture: %s", captureFilename);
+		return false;
+	}
+	hxLogConsole("wrote %s.\n", chromeFilename);
+	return true;
+}
+
+uint32_t hxProfiler::getStats(Stats* stats, uint32_t maxCount) const {
+	hxHashTable<hxProfilerStatsNode, 6> table;
+
+	Record* records = (Record*)hxMalloc(HX_PROFILER_MAX_RECORDS * sizeof(Record));
+	uint32_t count = copyRecords_(records);
+
+	// Group records by thread without reordering those of a thread.
+	hxHashTable<hxProfilerIndexNode<uint32_t>, 4> threads;
+	uint32_t* threadIndices = (uint32_t*)hxMalloc((count + 1u) * sizeof(uint32_t));
+	for (uint32_t i = 0; i < count; ++i) {
+		hxProfilerIndexNode<uint32_t>& thread = threads.insert_unique(records[i].m_threadId);
+		if (thread.m_index == ~0u) {
+			thread.m_index = threads.size() - 1u;
+		}
+		threadIndices[i] = thread.m_index;
+	}
+	uint32_t* offsets = (uint32_t*)hxMalloc((threads.size() + 1u) * sizeof(uint32_t));
+	::memset(offsets, 0x00, (threads.size() + 1u) * sizeof(uint32_t));
+	for (uint32_t i = 0; i < count; ++i) {
+		++offsets[threadIndices[i] + 1u];
+	}
+	for (uint32_t i = 1; i < threads.size(); ++i) {
+		offsets[i] += offsets[i - 1u];
+	}
+	uint32_t* order = (uint32_t*)hxMalloc((count + 1u) * sizeof(uint32_t));
+	for (uint32_t i = 0; i < count; ++i) {
+		order[offsets[threadIndices[i]]++] = i;
+	}
+
+	Scope* scopes = (Scope*)hxMalloc((count + 1u) * sizeof(Scope));
+	uint32_t depth = 0u;
+	uint32_t thread = ~0u;
+	for (uint32_t i = 0; i < count; ++i) {
+		const Record& rec = records[order[i]];
+		if (rec.m_kind != Record::KindScope) {
+			continue;
+		}
+		if (threadIndices[order[i]] != thread) {
+			thread = threadIndices[order[i]];
+			depth = 0u;
+		}
+		hx_timestamp_t duration = rec.m_end - rec.m_begin;
+		hx_timestamp_t nested = hxProfilerPopNested(scopes, depth, rec.m_begin);
+		scopes[depth].m_begin = rec.m_begin;
+		scopes[depth++].m_duration = duration;
+		table.insert_unique(rec.m_label).m_stats.add(duration, nested < duration ? duration - nested : 0u);
+	}
+
+	hxFree(scopes);
+	hxFree(order);
+	hxFree(offsets);
+	hxFree(threadIndices);
+	hxFree(records);
+
+	uint32_t claimed = m_aggregatesClaimed;
+	for (uint32_t i = 0; i < claimed && i < (uint32_t)AggregateThreads; ++i) {
+		const Aggregate& aggregate = m_aggregates[i];
+		for (uint32_t j = 0; j < (uint32_t)AggregateLabels; ++j) {
+			if (aggregate.m_stats[j].m_label) {
+				table.insert_unique(aggregate.m_stats[j].m_label).m_stats.merge(aggregate.m_stats[j]);
+			}
+		}
+	}
+
+	uint32_t labels = table.size();
+	const hxProfilerStatsNode** nodes = (const hxProfilerStatsNode**)hxMalloc((labels + 1u) * sizeof(hxProfilerStatsNode*));
+	const hxProfilerStatsNode** it = nodes;
+	for (hxHashTable<hxProfilerStatsNode, 6>::const_iterator n = table.cbegin(); n != table.cend(); ++n) {
+		*it++ = &*n;
+	}
+	hxPartialSort(nodes, nodes + hxMin(labels, maxCount), nodes + labels, hxProfilerStatsGreater());
+	for (uint32_t i = 0; i < labels && i < maxCount; ++i) {
+		stats[i] = nodes[i]->m_stats;
+	}
+	hxFree(nodes);
+	return labels;
+}
+
+void hxProfiler::logStats() const {
+	uint32_t labels = getStats(hxnull, 0u);
+	Stats* stats = (Stats*)hxMalloc((labels + 1u) * sizeof(Stats));
+	labels = hxMin(getStats(stats, labels), labels);
+
+	const double ms = (double)g_hxTimeMillisecondsPerCycle;
+	for (uint32_t i = 0; i < labels; ++i) {
+		const Stats& x = stats[i];
+		hxLogRelease("profile stats %s: count %u total %fms self %fms mean %fms min %fms max %fms"
+			" p50 %fms p90 %fms p99 %fms p999 %fms\n", hxBasename(x.m_label), (unsigned int)x.m_count,
+			(double)x.m_total * ms, (double)x.m_self * ms, x.mean() * ms, (double)x.m_min * ms,
+			(double)x.m_max * ms, x.percentile(0.5) * ms, x.percentile(0.9) * ms,
+			x.percentile(0.99) * ms, x.percentile(0.999) * ms);
+	}
+	hxFree(stats);
+}
+
+void hxProfiler::writeFoldedStacks(const char* filename) {
+	uint32_t written = m_samplesWritten;
+	uint32_t count = hxMin(written, (uint32_t)SampleCount);
+
+	// A seqlock style read of each sample.  Samples being written or that are
+	// overwritten while being copied are skipped.
+	Stack* stacks = (Stack*)hxMalloc((count + 1u) * sizeof(Stack));
+	uint32_t copied = 0u;
+	for (uint32_t i = written - count; i != written; ++i) {
+		const Sample& sample = m_samples[i % (uint32_t)SampleCount];
+		if (sample.m_sequence != i) {
+			continue;
+		}
+#if HX_USE_CPP11_THREADS
+		std::atomic_thread_fence(std::memory_order_acquire);
+#endif
+		stacks[copied] = sample.m_stack;
+#if HX_USE_CPP11_THREADS
+		std::atomic_thread_fence(std::memory_order_acquire);
+#endif
+		if (sample.m_sequence == i) {
+			++copied;
+		}
+	}
+
+	hxHashTable<hxProfilerFoldedNode, 8> folded;
+	for (uint32_t i = 0; i < copied; ++i) {
+		++folded.insert_unique(stacks + i).m_count;
+	}
+
+	hxFile f(hxFile::out, "%s", filename);
+	for (hxHashTable<hxProfilerFoldedNode, 8>::const_iterator it = folded.cbegin(); it != folded.cend(); ++it) {
+		const Stack& stack = *it->key;
+		if (stack.m_depth == 0u) {
+			f.print("[unscoped]");
+		}
+		for (uint32_t i = 0; i < stack.m_depth; ++i) {
+			f.print(i ? ";%s" : "%s", hxBasename(stack.m_labels[i]));
+		}
+		f.print(" %u\n", (unsigned int)it->m_count);
+	}
+	hxFree(stacks);
+
+	hxLogConsole("wrote %s.\n", filename);
+}
+
+uint32_t hxProfiler::samplesSize() const {
+	return hxMin((uint32_t)m_samplesWritten, (uint32_t)SampleCount);
+}
+
+void hxProfilerSignalHandler(int signal) {
+	(void)signal;
+	g_hxProfiler.sample_();
+}
+
+// Called from a signal handler.  Copies the interrupted thread's shadow stack.
+void hxProfiler::sample_() {
+	const ShadowStack& shadow = s_hxProfilerShadowStack;
+	if (!m_isSampling || !shadow.m_isUsed) {
+		return;
+	}
+	uint32_t index = m_samplesWritten++;
+	Sample& sample = m_samples[index % (uint32_t)SampleCount];
+#if HX_USE_CPP11_THREADS
+	sample.m_sequence.store(~0u, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+#else
+	sample.m_sequence = ~0u;
+#endif
+	uint32_t depth = hxMin((uint32_t)shadow.m_depth, (uint32_t)SampleDepth);
+	sample.m_stack.m_depth = depth;
+	for (uint32_t i = 0; i < depth; ++i) {
+		sample.m_stack.m_labels[i] = shadow.m_labels[i];
+	}
+#if HX_USE_CPP11_THREADS
+	sample.m_sequence.store(index, std::memory_order_release);
+#else
+	sample.m_sequence = index;
+#endif
+}
+
+// Reevaluates call sites that are out of date and implements decimation.
+bool hxProfiler::checkCallsite_(const char* label, hxProfilerCallsite* callsite) {
+	uint32_t decimation;
+	if (callsite) {
+		uint32_t generation = m_filterGeneration;
+#if HX_USE_CPP11_THREADS
+		uint64_t state = callsite->m_state.load(std::memory_order_relaxed);
+#else
+		uint64_t state = callsite->m_state;
+#endif
+		if (((uint32_t)state >> 2) != generation) {
+			decimation = filterDecimation_(label);
+			state = ((uint64_t)decimation << 32) | (uint64_t)((generation << 2) | (uint32_t)(decimation == 0u
+				? CallsiteDisabled : decimation == 1u ? CallsiteEnabled : CallsiteDecimated));
+			// Threads racing here store the same value.
+#if HX_USE_CPP11_THREADS
+			callsite->m_state.store(state, std::memory_order_relaxed);
+#else
+			callsite->m_state = state;
+#endif
+		}
+		decimation = (uint32_t)(state >> 32);
+	}
+	else {
+		decimation = filterDecimation_(label);
+	}
+	if (decimation <= 1u) {
+		return decimation == 1u;
+	}
+
+	// Decimation counts are kept per thread in a small table indexed by call
+	// site, or by label when uncached.  Call sites that share an entry are
+	// decimated together.
+	const void* key = callsite ? (const void*)callsite : (const void*)label;
+	uint32_t& count = s_hxProfilerDecimationCounts[((uintptr_t)key >> 3) % hxProfilerDecimationCounters];
+	return (count++ % decimation) == 0u;
+}
+
+uint32_t hxProfiler::filterDecimation_(const char* label) const {
+#if HX_USE_CPP11_THREADS
+	uint32_t count = m_filterCount.load(std::memory_order_acquire);
+#else
+	uint32_t count = m_filterCount;
+#endif
+	for (uint32_t i = count; i--;) {
+		const Filter& filter = m_filters[i];
+		if (::strncmp(label, filter.m_prefix, ::strlen(filter.m_prefix)) == 0) {
+			return filter.m_decimation;
+		}
+	}
+	return 1u;
+}
+
+uint32_t hxProfiler::recordsSize() const {
+	uint32_t size = 0u;
+	for (uint32_t i = blocksClaimed_(); i--;) {
+		size += m_blocks[i].m_size;
+	}
+	return size;
+}
+
+void hxProfiler::clear_() {
+	for (uint32_t i = blocksClaimed_(); i--;) {
+		Block& block = m_blocks[i];
+		block.m_size = 0u;
+		block.m_isOwned = 0u;
+		block.m_flushedSequence = ~0u;
+	}
+	m_blocksClaimed = 0u;
+
+	uint32_t aggregatesClaimed = m_aggregatesClaimed;
+	for (uint32_t i = 0; i < aggregatesClaimed && i < (uint32_t)AggregateThreads; ++i) {
+		Aggregate& aggregate = m_aggregates[i];
+		aggregate.m_depth = 0u;
+		for (uint32_t j = 0; j < (uint32_t)AggregateLabels; ++j) {
+			aggregate.m_stats[j].m_label = hxnull;
+		}
+	}
+	m_aggregatesClaimed = 0u;
+	m_samplesWritten = 0u;
+	m_startTimestamp = hxTimeSampleTimestamp();
+
+	// Threads will claim new blocks instead of continuing with cached ones.
+	++m_generation;
+}
+
+uint32_t hxProfiler::blocksClaimed_() const {
+	uint32_t claimed = m_blocksClaimed;
+	return claimed < (uint32_t)BlockCount ? claimed : (uint32_t)BlockCount;
+}
+
+hxProfiler::Block* hxProfiler::claimBlock_() {
+	// The current block is either full or from a previous generation.
+	releaseBlock_();
+
+	uint32_t generation = m_generation;
+	Block* block = hxnull;
+	if (!m_isContinuous) {
+		// Avoid writing to shared state once all blocks are claimed.
+		if (m_blocksClaimed >= (uint32_t)BlockCount) {
+			return hxnull;
+		}
+		uint32_t sequence = m_blocksClaimed++;
+		if (sequence >= (uint32_t)BlockCount) {
+			return hxnull;
+		}
+		block = m_blocks + sequence;
+		hxAssert(block->m_size == 0u);
+		block->m_isOwned = 1u;
+		block->m_sequence = sequence;
+	}
+	else {
+		// Blocks are visited in claim order which recycles the oldest first.  Skip
+		// blocks still owned by a thread.
+		for (uint32_t attempts = BlockCount; attempts--;) {
+			uint32_t sequence = m_blocksClaimed++;
+			Block* candidate = m_blocks + (sequence % (uint32_t)BlockCount);
+#if HX_USE_CPP11_THREADS
+			uint32_t isOwned = 0u;
+			if (!candidate->m_isOwned.compare_exchange_strong(isOwned, 1u)) {
+				continue;
+			}
+			// Readers check m_sequence after copying records.  See copyBlock_().
+			candidate->m_sequence.store(sequence, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_release);
+#else
+			if (candidate->m_isOwned) {
+				continue;
+			}
+			candidate->m_isOwned = 1u;
+			candidate->m_sequence = sequence;
+#endif
+			candidate->m_size = 0u;
+			block = candidate;
+			break;
+		}
+		if (!block) {
+			return hxnull;
+		}
+	}
+
+	s_hxProfilerThreadExit.m_isUsed = true;
+	s_hxProfilerBlock = block;
+	s_hxProfilerGeneration = generation;
+	return block;
+}
+
+void hxProfiler::releaseBlock_() {
+	Block* block = s_hxProfilerBlock;
+	if (block && s_hxProfilerGeneration == m_generation) {
+		block->m_isOwned = 0u;
+	}
+	s_hxProfilerBlock = hxnull;
+}
+
+void hxProfiler::aggregate_(hx_timestamp_t begin, hx_timestamp_t end, const char* label) {
+	Aggregate* aggregate = s_hxProfilerAggregate;
+	if (!aggregate || s_hxProfilerAggregateGeneration != m_generation) {
+		aggregate = claimAggregate_();
+		if (!aggregate) {
+			return; // Out of tables.
+		}
+	}
+
+	hx_timestamp_t duration = end - begin;
+	hx_timestamp_t nested = hxProfilerPopNested(aggregate->m_scopes, aggregate->m_depth, begin);
+	if (aggregate->m_depth == (uint32_t)AggregateDepth) {
+		// Forget the oldest half.  They are only needed by scopes with many nested
+		// scopes.
+		::memmove(aggregate->m_scopes, aggregate->m_scopes + AggregateDepth / 2,
+			(AggregateDepth / 2) * sizeof(Scope));
+		aggregate->m_depth = AggregateDepth / 2;
+	}
+	Scope& scope = aggregate->m_scopes[aggregate->m_depth++];
+	scope.m_begin = begin;
+	scope.m_duration = duration;
+
+	uint32_t slot = (hxProfilerLabelHash(label) >> 16) % (uint32_t)AggregateLabels;
+	for (uint32_t probes = AggregateLabels; probes--; slot = (slot + 1u) % (uint32_t)AggregateLabels) {
+		Stats& stats = aggregate->m_stats[slot];
+		if (stats.m_label != label) {
+			if (stats.m_label) {
+				continue;
+			}
+			stats.clear(label);
+		}
+		stats.add(duration, nested < duration ? duration - nested : 0u);
+		return;
+	}
+	// Out of labels.
+}
+
+hxProfiler::Aggregate* hxProfiler::claimAggregate_() {
+	uint32_t generation = m_generation;
+	if (m_aggregatesClaimed >= (uint32_t)AggregateThreads) {
+		return hxnull;
+	}
+	uint32_t index = m_aggregatesClaimed++;
+	if (index >= (uint32_t)AggregateThreads) {
+		return hxnull;
+	}
+	Aggregate* aggregate = m_aggregates + index;
+	s_hxProfilerAggregate = aggregate;
+	s_hxProfilerAggregateGeneration = generation;
+	return aggregate;
+}
+
+uint32_t hxProfiler::copyRecords_(Record* records) const {
+	// Continuous mode recycles blocks.  Copy them in claim order so that the
+	// records of each thread stay in the order they were written.
+	hxProfilerBlockOrder order[BlockCount];
+	uint32_t claimed = blocksClaimed_();
+	for (uint32_t i = 0; i < claimed; ++i) {
+		order[i].m_sequence = m_blocks[i].m_sequence;
+		order[i].m_index = i;
+	}
+	if (m_isContinuous) {
+		hxInsertionSort(order, order + claimed);
+	}
+
+	uint32_t count = 0u;
+	for (uint32_t i = 0; i < claimed; ++i) {
+		uint32_t sequence = 0u;
+		count += copyBlock_(m_blocks[order[i].m_index], 0u, sequence, records + count);
+	}
+	return count;
+}
+
+uint32_t hxProfiler::copyBlock_(const Block& block, uint32_t begin, uint32_t& sequence,
+		Record* records) const {
+	// A seqlock style read.  The records are discarded if the block was recycled
+	// while being copied.
+	sequence = block.m_sequence;
+	uint32_t size = block.m_size;
+	if (begin >= size) {
+		return 0u;
+	}
+	::memcpy((void*)records, block.m_records.getStorage() + begin, (size - begin) * sizeof(Record));
+#if HX_USE_CPP11_THREADS
+	std::atomic_thread_fence(std::memory_order_acquire);
+#endif
+	return (block.m_sequence == sequence) ? (size - begin) : 0u;
+}
+
+void hxProfiler::writeChromeTracing_(const char* filename, hx_timestamp_t window) {
+	hx_timestamp_t now = hxTimeSampleTimestamp();
 	hxFile f(hxFile::out, "%s", filename);
 
 	f.print("[\n");
-	// Converting absolute values works better with integer precision.
-	uint32_t cyclesPerMicrosecond = (uint32_t)(1.0e-3f / c_hxTimeMillisecondsPerCycle);
-	for (uint32_t i = 0; i < m_records.size(); ++i) {
-		const hxProfiler::Record& rec = m_records[i];
-		if (i != 0) { f.print(",\n"); }
-		const char* bn = hxBasename(rec.m_label);
-		f.print("{\"name\":\"%s\",\"cat\":\"PERF\",\"ph\":\"B\",\"pid\":0,\"tid\":%u,\"ts\":%u},\n",
-			bn, (unsigned int)rec.m_threadId, (unsigned int)(rec.m_begin / cyclesPerMicrosecond));
-		f.print("{\"name\":\"%s\",\"cat\":\"PERF\",\"ph\":\"E\",\"pid\":0,\"tid\":%u,\"ts\":%u}",
-			bn, (unsigned int)rec.m_threadId, (unsigned int)(rec.m_end / cyclesPerMicrosecond));
+	// Microseconds relative to start().  Doubles hold 64-bit timestamps exactly
+	// up to 2^53.
+	double microsecondsPerCycle = 1.0e+3 * (double)g_hxTimeMillisecondsPerCycle;
+	double start = (double)m_startTimestamp;
+	bool isFirst = true;
+	hxAllocator<Record, BlockRecords> copy;
+	for (uint32_t i = 0, claimed = blocksClaimed_(); i < claimed; ++i) {
+		uint32_t sequence = 0u;
+		uint32_t count = copyBlock_(m_blocks[i], 0u, sequence, copy.getStorage());
+		for (uint32_t j = 0; j < count; ++j) {
+			const hxProfiler::Record& rec = copy.getStorage()[j];
+			if ((hx_timestamp_t)(now - rec.endTimestamp()) > window) {
+				continue;
+			}
+			const char* args = hxnull;
+#if HX_PROFILE_PERF_COUNTERS
+			char perfArgs[HX_MAX_LINE] = "";
+			if (rec.m_kind == Record::KindScope) {
+				int length = 0;
+				for (uint32_t k = 0; k < (uint32_t)PerfCounters; ++k) {
+					length += hxsnprintf(perfArgs + length, sizeof perfArgs - (size_t)length, "%s\"%s\":%.0f",
+						k ? "," : "", c_perfCounterNames[k], (double)rec.m_perf[k]);
+				}
+				args = perfArgs;
+			}
+#endif
+			hxProfilerPrintChromeEvent(f, isFirst, rec.m_label, rec.m_threadId, rec.m_kind,
+				((double)rec.m_begin - start) * microsecondsPerCycle,
+				((double)rec.m_end - start) * microsecondsPerCycle, rec.m_end, args);
+			isFirst = false;
+		}
 	}
 	f.print("\n]\n");
 
 	hxLogConsole("wrote %s.\n", filename);
 }
 
+// ----------------------------------------------------------------------------
+// hxProfiler::Stats
+
+void hxProfiler::Stats::clear(const char* label) {
+	m_label = label;
+	m_count = 0u;
+	m_total = 0u;
+	m_self = 0u;
+	m_min = ~(hx_timestamp_t)0;
+	m_max = 0u;
+	::memset(m_histogram, 0x00, sizeof m_histogram);
+}
+
+void hxProfiler::Stats::add(hx_timestamp_t duration, hx_timestamp_t self) {
+	++m_count;
+	m_total += duration;
+	m_self += self;
+	m_min = hxMin(m_min, duration);
+	m_max = hxMax(m_max, duration);
+	++m_histogram[hxProfilerStatsBucket(duration)];
+}
+
+void hxProfiler::Stats::merge(const Stats& x) {
+	m_count += x.m_count;
+	m_total += x.m_total;
+	m_self += x.m_self;
+	m_min = hxMin(m_min, x.m_min);
+	m_max = hxMax(m_max, x.m_max);
+	for (uint32_t i = 0; i < (uint32_t)StatsBuckets; ++i) {
+		m_histogram[i] += x.m_histogram[i];
+	}
+}
+
+double hxProfiler::Stats::percentile(double fraction) const {
+	if (m_count == 0u) {
+		return 0.0;
+	}
+	double rank = fraction * (double)m_count;
+	uint32_t seen = 0u;
+	for (uint32_t i = 0; i < (uint32_t)StatsBuckets; ++i) {
+		seen += m_histogram[i];
+		if (seen != 0u && (double)seen >= rank) {
+			return hxClamp(hxProfilerStatsBucketMidpoint(i), (double)m_min, (double)m_max);
+		}
+	}
+	return (double)m_max;
+}
+
 #endif // HX_PROFILE
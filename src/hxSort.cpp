@@ -1,125 +1,427 @@
 // Copyright 2017-2019 Adrian Johnston
 
 #include <hx/hxSort.h>
+#include <hx/hxTaskQueue.h>
 
-HX_REGISTER_FILENAME_HASH
+#if HX_USE_SSE4_1
+#include <smmintrin.h>
+#endif
 
-// ----------------------------------------------------------------------------
-// hxRadixSortBase
+HX_REGISTER_FILENAME_HASH
 
 HX_STATIC_ASSERT(HX_RADIX_SORT_BITS == 8 || HX_RADIX_SORT_BITS == 11,
 	"Unsupported HX_RADIX_SORT_BITS");
+HX_STATIC_ASSERT(HX_SORT_NETWORK_MAX_SIZE >= 4u && (HX_SORT_NETWORK_MAX_SIZE & (HX_SORT_NETWORK_MAX_SIZE - 1u)) == 0u,
+	"HX_SORT_NETWORK_MAX_SIZE must be a power of 2");
 
-void hxRadixSortBase::sort(hxMemoryManagerId tempMemory) {
-	if (m_array.size() < HX_RADIX_SORT_MIN_SIZE) {
-		hxInsertionSort(m_array.begin(), m_array.end());
-		return;
+// ----------------------------------------------------------------------------
+// hxSortNetwork.  The SSE4.1 version pads the keys to a power of 2 registers
+// of 4 lanes.  Padding is UINT32_MAX, which is never exchanged because keys
+// only move when they are strictly ordered.  Exchanges within a register
+// shuffle the register and then blend the minimums and maximums.
+
+#if HX_USE_SSE4_1
+
+// Lanes of keys only.
+class hxSortNetworkLanesKeys {
+public:
+	HX_INLINE void load(const uint32_t* keys, const uint32_t* values) {
+		(void)values;
+		m_keys = _mm_loadu_si128((const __m128i*)keys);
+	}
+	HX_INLINE void store(uint32_t* keys, uint32_t* values) const {
+		(void)values;
+		_mm_storeu_si128((__m128i*)keys, m_keys);
+	}
+	HX_INLINE void reverse() {
+		m_keys = _mm_shuffle_epi32(m_keys, _MM_SHUFFLE(0, 1, 2, 3));
 	}
 
-	hxMemoryManagerScope allocatorScope(tempMemory);
+	// Leaves the minimums in a and the maximums in b.
+	static HX_INLINE void exchange(hxSortNetworkLanesKeys& a, hxSortNetworkLanesKeys& b) {
+		__m128i t = _mm_min_epu32(a.m_keys, b.m_keys);
+		b.m_keys = _mm_max_epu32(a.m_keys, b.m_keys);
+		a.m_keys = t;
+	}
 
-	if (HX_RADIX_SORT_BITS == 8) {
-		// 2 Working buffers
-		KeyValuePair* HX_RESTRICT buf0 = m_array.data();
-		KeyValuePair* buf0End = buf0 + m_array.size();
-		KeyValuePair* HX_RESTRICT buf1 = (KeyValuePair*)hxMalloc(m_array.size() * sizeof(KeyValuePair));
-		KeyValuePair* buf1End = buf1 + m_array.size();
-
-		uint32_t* histograms = (uint32_t*)hxMalloc(256u * 4u * sizeof(uint32_t));
-		::memset(histograms, 0x00, 256u * 4u * sizeof(uint32_t)); // 4k
-
-		// Build histograms
-		uint32_t* HX_RESTRICT hist0 = histograms + (256 * 0);
-		uint32_t* HX_RESTRICT hist1 = histograms + (256 * 1);
-		uint32_t* HX_RESTRICT hist2 = histograms + (256 * 2);
-		uint32_t* HX_RESTRICT hist3 = histograms + (256 * 3);
-
-		for (const KeyValuePair* HX_RESTRICT it = buf0; it != buf0End; ++it) {
-			uint32_t x = it->m_key;
-			++hist0[x & 0xffu];
-			++hist1[(x >> 8) & 0xffu];
-			++hist2[(x >> 16) & 0xffu];
-			++hist3[x >> 24];
-		}
+	// Exchanges lanes with the lanes Shuffle puts there.  Upper is a
+	// _mm_blend_epi16 mask of the lanes that get the maximums.
+	template<int Shuffle, int Upper>
+	HX_INLINE void exchangeLanes() {
+		__m128i t = _mm_shuffle_epi32(m_keys, Shuffle);
+		m_keys = _mm_blend_epi16(_mm_min_epu32(m_keys, t), _mm_max_epu32(m_keys, t), Upper);
+	}
 
-		// Convert histograms to start indices
-		uint32_t sum0 = 0u, sum1 = 0u, sum2 = 0u, sum3 = 0u;
-		for (uint32_t i = 0u; i < 256u; ++i) {
-			uint32_t t0 = hist0[i] + sum0; hist0[i] = sum0; sum0 = t0;
-			uint32_t t1 = hist1[i] + sum1; hist1[i] = sum1; sum1 = t1;
-			uint32_t t2 = hist2[i] + sum2; hist2[i] = sum2; sum2 = t2;
-			uint32_t t3 = hist3[i] + sum3; hist3[i] = sum3; sum3 = t3;
-		}
+private:
+	__m128i m_keys;
+};
+
+// Lanes of keys and values.  Values move when their keys are strictly ordered.
+class hxSortNetworkLanesKeyValues {
+public:
+	HX_INLINE void load(const uint32_t* keys, const uint32_t* values) {
+		m_keys = _mm_loadu_si128((const __m128i*)keys);
+		m_values = _mm_loadu_si128((const __m128i*)values);
+	}
+	HX_INLINE void store(uint32_t* keys, uint32_t* values) const {
+		_mm_storeu_si128((__m128i*)keys, m_keys);
+		_mm_storeu_si128((__m128i*)values, m_values);
+	}
+	HX_INLINE void reverse() {
+		m_keys = _mm_shuffle_epi32(m_keys, _MM_SHUFFLE(0, 1, 2, 3));
+		m_values = _mm_shuffle_epi32(m_values, _MM_SHUFFLE(0, 1, 2, 3));
+	}
+
+	static HX_INLINE void exchange(hxSortNetworkLanesKeyValues& a, hxSortNetworkLanesKeyValues& b) {
+		__m128i isSwap = greater(a.m_keys, b.m_keys);
+		__m128i t = _mm_min_epu32(a.m_keys, b.m_keys);
+		b.m_keys = _mm_max_epu32(a.m_keys, b.m_keys);
+		a.m_keys = t;
+		t = _mm_blendv_epi8(a.m_values, b.m_values, isSwap);
+		b.m_values = _mm_blendv_epi8(b.m_values, a.m_values, isSwap);
+		a.m_values = t;
+	}
 
-		// 2 or 4 pass radix sort
-		for (const KeyValuePair* HX_RESTRICT it = buf0; it != buf0End; ++it) {
-			buf1[hist0[it->m_key & 0xffu]++] = *it;
+	// The lower lane of a pair takes the other lane when it is greater and the
+	// upper lane when it is less.
+	template<int Shuffle, int Upper>
+	HX_INLINE void exchangeLanes() {
+		__m128i keys = _mm_shuffle_epi32(m_keys, Shuffle);
+		__m128i values = _mm_shuffle_epi32(m_values, Shuffle);
+		__m128i isSwap = _mm_blend_epi16(greater(m_keys, keys), greater(keys, m_keys), Upper);
+		m_keys = _mm_blendv_epi8(m_keys, keys, isSwap);
+		m_values = _mm_blendv_epi8(m_values, values, isSwap);
+	}
+
+private:
+	static HX_INLINE __m128i greater(__m128i a, __m128i b) {
+		const __m128i sign = _mm_set1_epi32((int)0x80000000u);
+		return _mm_cmpgt_epi32(_mm_xor_si128(a, sign), _mm_xor_si128(b, sign));
+	}
+
+	__m128i m_keys;
+	__m128i m_values;
+};
+
+// Sorts 4 lanes of each register and then merges pairs of sorted blocks of
+// registers.  count is a power of 2.
+template<typename Lanes>
+static void hxSortNetworkRun(Lanes* lanes, uint32_t count) {
+	for (uint32_t i = 0u; i < count; ++i) {
+		lanes[i].template exchangeLanes<_MM_SHUFFLE(2, 3, 0, 1), 0xcc>();
+		lanes[i].template exchangeLanes<_MM_SHUFFLE(0, 1, 2, 3), 0xf0>();
+		lanes[i].template exchangeLanes<_MM_SHUFFLE(2, 3, 0, 1), 0xcc>();
+	}
+	for (uint32_t block = 2u; block <= count; block <<= 1) {
+		// Exchange mirrored lanes of each pair of sorted halves.
+		for (uint32_t first = 0u; first < count; first += block) {
+			for (uint32_t i = 0u; i < block / 2u; ++i) {
+				Lanes& upper = lanes[first + block - 1u - i];
+				upper.reverse();
+				Lanes::exchange(lanes[first + i], upper);
+				upper.reverse();
+			}
+		}
+		for (uint32_t stride = block / 4u; stride != 0u; stride >>= 1) {
+			for (uint32_t i = 0u; i < count; ++i) {
+				if ((i & stride) == 0u) {
+					Lanes::exchange(lanes[i], lanes[i + stride]);
+				}
+			}
 		}
-		for (const KeyValuePair* HX_RESTRICT it = buf1; it != buf1End; ++it) {
-			buf0[hist1[(it->m_key >> 8) & 0xffu]++] = *it;
+		for (uint32_t i = 0u; i < count; ++i) {
+			lanes[i].template exchangeLanes<_MM_SHUFFLE(1, 0, 3, 2), 0xf0>();
+			lanes[i].template exchangeLanes<_MM_SHUFFLE(2, 3, 0, 1), 0xcc>();
 		}
-		if (hist2[1] != m_array.size() || hist3[1] != m_array.size()) {
-			for (const KeyValuePair* HX_RESTRICT it = buf0; it != buf0End; ++it) {
-				buf1[hist2[(it->m_key >> 16) & 0xffu]++] = *it;
+	}
+}
+
+template<typename Lanes>
+static void hxSortNetworkPadded(uint32_t* keys, uint32_t* values, uint32_t size) {
+	uint32_t paddedKeys[HX_SORT_NETWORK_MAX_SIZE];
+	uint32_t paddedValues[HX_SORT_NETWORK_MAX_SIZE];
+	uint32_t count = 1u;
+	while (count * 4u < size) {
+		count <<= 1;
+	}
+	::memcpy(paddedKeys, keys, size * sizeof(uint32_t));
+	::memset(paddedKeys + size, 0xff, (count * 4u - size) * sizeof(uint32_t));
+	if (values) {
+		::memcpy(paddedValues, values, size * sizeof(uint32_t));
+		::memset(paddedValues + size, 0x00, (count * 4u - size) * sizeof(uint32_t));
+	}
+
+	Lanes lanes[HX_SORT_NETWORK_MAX_SIZE / 4u];
+	for (uint32_t i = 0u; i < count; ++i) {
+		lanes[i].load(paddedKeys + i * 4u, paddedValues + i * 4u);
+	}
+	hxSortNetworkRun(lanes, count);
+	for (uint32_t i = 0u; i < count; ++i) {
+		lanes[i].store(paddedKeys + i * 4u, paddedValues + i * 4u);
+	}
+
+	::memcpy(keys, paddedKeys, size * sizeof(uint32_t));
+	if (values) {
+		::memcpy(values, paddedValues, size * sizeof(uint32_t));
+	}
+}
+
+#endif // HX_USE_SSE4_1
+
+void hxSortNetwork(uint32_t* first, uint32_t* last) {
+	uint32_t size = (uint32_t)(last - first);
+	hxAssertMsg(size <= HX_SORT_NETWORK_MAX_SIZE, "hxSortNetwork size %u", (unsigned int)size);
+	if (size < 2u) {
+		return;
+	}
+#if HX_USE_SSE4_1
+	hxSortNetworkPadded<hxSortNetworkLanesKeys>(first, hxnull, size);
+#else
+	hxSortNetwork(first, last, hxLess());
+#endif
+}
+
+// Floats are sorted as the bits of hxRadixSortKey<float> and mapped back.
+static void hxSortNetworkFloatKeys(const float* floats, uint32_t* keys, uint32_t size) {
+	hxRadixSortKey<float> keyFn;
+	for (uint32_t i = 0u; i < size; ++i) {
+		keys[i] = keyFn(floats[i]);
+	}
+}
+
+static void hxSortNetworkFloatsFromKeys(const uint32_t* keys, float* floats, uint32_t size) {
+	for (uint32_t i = 0u; i < size; ++i) {
+		uint32_t x = keys[i] ^ (((keys[i] >> 31) - 1u) | 0x80000000u);
+		::memcpy(floats + i, &x, sizeof(float));
+	}
+}
+
+void hxSortNetwork(float* first, float* last) {
+	uint32_t size = (uint32_t)(last - first);
+	hxAssertMsg(size <= HX_SORT_NETWORK_MAX_SIZE, "hxSortNetwork size %u", (unsigned int)size);
+	uint32_t keys[HX_SORT_NETWORK_MAX_SIZE];
+	hxSortNetworkFloatKeys(first, keys, size);
+	hxSortNetwork(keys, keys + size);
+	hxSortNetworkFloatsFromKeys(keys, first, size);
+}
+
+void hxSortNetworkKeyValues(uint32_t* keys, uint32_t* values, uint32_t size) {
+	hxAssertMsg(size <= HX_SORT_NETWORK_MAX_SIZE, "hxSortNetwork size %u", (unsigned int)size);
+	if (size < 2u) {
+		return;
+	}
+#if HX_USE_SSE4_1
+	hxSortNetworkPadded<hxSortNetworkLanesKeyValues>(keys, values, size);
+#else
+	// Sort keys and values packed into 64 bits.
+	uint64_t pairs[HX_SORT_NETWORK_MAX_SIZE];
+	for (uint32_t i = 0u; i < size; ++i) {
+		pairs[i] = ((uint64_t)keys[i] << 32) | values[i];
+	}
+	hxSortNetwork(pairs, pairs + size, hxLess());
+	for (uint32_t i = 0u; i < size; ++i) {
+		keys[i] = (uint32_t)(pairs[i] >> 32);
+		values[i] = (uint32_t)pairs[i];
+	}
+#endif
+}
+
+void hxSortNetworkKeyValues(float* keys, uint32_t* values, uint32_t size) {
+	hxAssertMsg(size <= HX_SORT_NETWORK_MAX_SIZE, "hxSortNetwork size %u", (unsigned int)size);
+	uint32_t bits[HX_SORT_NETWORK_MAX_SIZE];
+	hxSortNetworkFloatKeys(keys, bits, size);
+	hxSortNetworkKeyValues(bits, values, size);
+	hxSortNetworkFloatsFromKeys(bits, keys, size);
+}
+
+// ----------------------------------------------------------------------------
+// hxRadixSortTask.  Counts or scatters one chunk for the parallel sort.  Each
+// chunk has a histogram of Digits * c_hxRadixSortBuckets counts.
+
+static const uint32_t c_hxRadixSortBuckets = 1u << HX_RADIX_SORT_BITS;
+static const uint32_t c_hxRadixSortMask = c_hxRadixSortBuckets - 1u;
+
+template<typename KeyValuePair, typename KeyFn>
+class hxRadixSortTask : public hxTask {
+public:
+	typedef typename KeyFn::Key Key;
+	static const uint32_t Digits = ((uint32_t)sizeof(Key) * 8u + HX_RADIX_SORT_BITS - 1u) / HX_RADIX_SORT_BITS;
+
+	enum Mode {
+		ModeCountAll,
+		ModeCount,
+		ModeScatter
+	};
+
+	hxRadixSortTask() : hxTask("radixsort") { }
+
+	void set(Mode mode, const KeyValuePair* begin, const KeyValuePair* end, KeyValuePair* dst, uint32_t digit) {
+		m_mode = mode;
+		m_begin = begin;
+		m_end = end;
+		m_dst = dst;
+		m_digit = digit;
+	}
+
+	virtual void execute(hxTaskQueue* q) HX_OVERRIDE {
+		(void)q;
+		KeyFn keyFn;
+		uint32_t shift = m_digit * HX_RADIX_SORT_BITS;
+		uint32_t* HX_RESTRICT hist = m_histogram + m_digit * c_hxRadixSortBuckets;
+		if (m_mode == ModeCountAll) {
+			::memset(m_histogram, 0x00, Digits * c_hxRadixSortBuckets * sizeof(uint32_t));
+			for (const KeyValuePair* HX_RESTRICT it = m_begin; it != m_end; ++it) {
+				Key x = keyFn(*it);
+				for (uint32_t i = 0u; i < Digits; ++i) {
+					++m_histogram[i * c_hxRadixSortBuckets + ((uint32_t)(x >> (i * HX_RADIX_SORT_BITS)) & c_hxRadixSortMask)];
+				}
 			}
-			for (const KeyValuePair* HX_RESTRICT it = buf1; it != buf1End; ++it) {
-				buf0[hist3[it->m_key >> 24]++] = *it;
+		}
+		else if (m_mode == ModeCount) {
+			::memset(hist, 0x00, c_hxRadixSortBuckets * sizeof(uint32_t));
+			for (const KeyValuePair* HX_RESTRICT it = m_begin; it != m_end; ++it) {
+				++hist[(uint32_t)(keyFn(*it) >> shift) & c_hxRadixSortMask];
 			}
 		}
+		else {
+			// hist has been converted to start indices.
+			hxRadixSortScatter(m_begin, m_end, m_dst, hist, shift, keyFn, m_lines, m_starts);
+		}
+	}
 
-		hxFree(histograms);
-		hxFree(buf1);
+	uint32_t* m_histogram;
+	KeyValuePair* m_lines; // Write combining buffers or null.
+	uint32_t* m_starts;
+
+private:
+	Mode m_mode;
+	const KeyValuePair* m_begin;
+	const KeyValuePair* m_end;
+	KeyValuePair* m_dst;
+	uint32_t m_digit;
+};
+
+// Runs all tasks over chunks of src.
+template<typename Task, typename KeyValuePair>
+static void hxRadixSortRun(hxTaskQueue* taskQueue, Task* tasks, typename Task::Mode mode,
+		const KeyValuePair* src, KeyValuePair* dst, uint32_t size, uint32_t digit) {
+	hxTask* taskPointers[HX_RADIX_SORT_TASKS];
+	uint32_t chunk = size / HX_RADIX_SORT_TASKS;
+	for (uint32_t i = 0u; i < HX_RADIX_SORT_TASKS; ++i) {
+		const KeyValuePair* end = (i + 1u < HX_RADIX_SORT_TASKS) ? src + chunk : src + (size - i * chunk);
+		tasks[i].set(mode, src, end, dst, digit);
+		taskPointers[i] = tasks + i;
+		src = end;
 	}
-	else if (HX_RADIX_SORT_BITS == 11) {
-		// 3 Working buffers
-		KeyValuePair* HX_RESTRICT buf0 = m_array.data();
-		KeyValuePair* buf0End = buf0 + m_array.size();
-		KeyValuePair* HX_RESTRICT buf1 = (KeyValuePair*)hxMalloc(m_array.size() * sizeof(KeyValuePair) * 2u);
-		KeyValuePair* buf1End = buf1 + m_array.size();
-		KeyValuePair* buf2 = buf1End;
-		KeyValuePair* buf2End = buf2 + m_array.size();
-
-		uint32_t* histograms = (uint32_t*)hxMalloc(5120u * sizeof(uint32_t)); // 5120: 2048*2.5
-		::memset(histograms, 0x00, 5120u * sizeof(uint32_t));
-
-		uint32_t* HX_RESTRICT hist0 = histograms +    0u; // 2048 values
-		uint32_t* HX_RESTRICT hist1 = histograms + 2048u; // 2048 values
-		uint32_t* HX_RESTRICT hist2 = histograms + 4096u; // 1024 values
-
-		for (const KeyValuePair* HX_RESTRICT it = buf0; it != buf0End; ++it) {
-			uint32_t x = it->m_key;
-			++hist0[x & 0x7ffu];
-			++hist1[(x >> 11) & 0x7ffu];
-			++hist2[x >> 22];
-		}
+	taskQueue->enqueueBatch(taskPointers, HX_RADIX_SORT_TASKS);
+	taskQueue->waitForAll();
+}
 
-		// Convert histograms to start indices
-		uint32_t sum0 = 0u, sum1 = 0u, sum2 = 0u;
-		for (uint32_t i = 0u; i < 1024u; ++i) {
-			uint32_t t0 = hist0[i] + sum0; hist0[i] = sum0; sum0 = t0;
-			uint32_t t1 = hist1[i] + sum1; hist1[i] = sum1; sum1 = t1;
-			uint32_t t2 = hist2[i] + sum2; hist2[i] = sum2; sum2 = t2;
+// ----------------------------------------------------------------------------
+// hxRadixSortBase::sort(tempMemory, taskQueue)
+
+template<typename Storage>
+void hxRadixSortBase<Storage>::sort(hxMemoryManagerId tempMemory, hxTaskQueue* taskQueue) {
+	typedef hxRadixSortTask<KeyValuePair, KeyFn> Task;
+	const uint32_t digits = Task::Digits;
+
+	uint32_t size = m_array.size();
+	if (!taskQueue || size < HX_RADIX_SORT_PARALLEL_MIN_SIZE) {
+		sort(tempMemory);
+		return;
+	}
+	HX_STATIC_ASSERT(HX_RADIX_SORT_PARALLEL_MIN_SIZE >= HX_RADIX_SORT_TASKS, "HX_RADIX_SORT_TASKS chunks required");
+
+	hxMemoryManagerScope allocatorScope(tempMemory);
+
+	const uint32_t histogramSize = digits * c_hxRadixSortBuckets;
+	uint32_t* histograms = (uint32_t*)hxMalloc(HX_RADIX_SORT_TASKS * histogramSize * sizeof(uint32_t));
+	Task tasks[HX_RADIX_SORT_TASKS];
+	for (uint32_t i = 0u; i < HX_RADIX_SORT_TASKS; ++i) {
+		tasks[i].m_histogram = histograms + i * histogramSize;
+	}
+
+	// Each task has its own write combining buffers.
+	KeyValuePair* lines = hxnull;
+	uint32_t* starts = hxnull;
+	if (hxRadixSortIsWriteCombining<KeyValuePair>(size)) {
+		lines = (KeyValuePair*)hxMallocExt(HX_RADIX_SORT_TASKS * c_hxRadixSortBuckets * HX_CACHE_LINE_SIZE,
+			hxMemoryManagerId_Current, HX_CACHE_LINE_SIZE - 1u);
+		starts = (uint32_t*)hxMalloc(HX_RADIX_SORT_TASKS * c_hxRadixSortBuckets * sizeof(uint32_t));
+	}
+	for (uint32_t i = 0u; i < HX_RADIX_SORT_TASKS; ++i) {
+		tasks[i].m_lines = lines ? lines + i * c_hxRadixSortBuckets * (HX_CACHE_LINE_SIZE / sizeof(KeyValuePair)) : hxnull;
+		tasks[i].m_starts = starts ? starts + i * c_hxRadixSortBuckets : hxnull;
+	}
+
+	// Count every digit in parallel.
+	KeyValuePair* buf0 = m_array.data();
+	hxRadixSortRun(taskQueue, tasks, Task::ModeCountAll, buf0, (KeyValuePair*)hxnull, size, 0u);
+
+	// Skip digits where a single bucket holds every key.
+	uint32_t passes[Task::Digits];
+	uint32_t passCount = 0u;
+	for (uint32_t digit = 0u; digit < digits; ++digit) {
+		bool isTrivial = false;
+		for (uint32_t bucket = 0u; bucket < c_hxRadixSortBuckets && !isTrivial; ++bucket) {
+			uint32_t total = 0u;
+			for (uint32_t i = 0u; i < HX_RADIX_SORT_TASKS; ++i) {
+				total += tasks[i].m_histogram[digit * c_hxRadixSortBuckets + bucket];
+			}
+			isTrivial = total == size;
 		}
-		for (uint32_t i = 1024u; i < 2048u; ++i) {
-			uint32_t t0 = hist0[i] + sum0; hist0[i] = sum0; sum0 = t0;
-			uint32_t t1 = hist1[i] + sum1; hist1[i] = sum1; sum1 = t1;
+		if (!isTrivial) {
+			passes[passCount++] = digit;
 		}
+	}
 
-		// 2 or 3 pass radix sort
-		for (const KeyValuePair* HX_RESTRICT it = buf0; it != buf0End; ++it) {
-			buf1[hist0[it->m_key & 0x7ffu]++] = *it;
+	if (passCount != 0u) {
+		// An even number of passes ping-pongs between buf0 and buf1.  An odd
+		// number rotates through buf1 and buf2 back to buf0.  A single pass
+		// copies buf0 to buf1 first.
+		KeyValuePair* buf1 = (KeyValuePair*)hxMalloc(size * sizeof(KeyValuePair) * ((passCount & 1u) ? 2u : 1u));
+		KeyValuePair* buf2 = buf1 + size;
+		KeyValuePair* src = buf0;
+		if (passCount == 1u) {
+			::memcpy((void*)buf1, (const void*)buf0, size * sizeof(KeyValuePair));
+			src = buf1;
 		}
-		KeyValuePair* HX_RESTRICT buf20 = (hist2[1] != m_array.size()) ? buf2 : buf0;
-		for (const KeyValuePair* HX_RESTRICT it = buf1; it != buf1End; ++it) {
-			buf20[hist1[(it->m_key >> 11) & 0x7ffu]++] = *it;
-		}
-		if (hist2[1] != m_array.size()) {
-			for (const KeyValuePair* HX_RESTRICT it = buf2; it != buf2End; ++it) {
-				buf0[hist2[it->m_key >> 22]++] = *it;
+
+		for (uint32_t pass = 0u; pass < passCount; ++pass) {
+			KeyValuePair* dst = (pass + 1u == passCount) ? buf0
+				: (passCount & 1u) ? ((src == buf1) ? buf2 : buf1)
+				: ((src == buf0) ? buf1 : buf0);
+
+			// The first pass uses the counts from ModeCountAll.
+			if (pass != 0u) {
+				hxRadixSortRun(taskQueue, tasks, Task::ModeCount, src, (KeyValuePair*)hxnull, size, passes[pass]);
 			}
+
+			// Convert chunk histograms to start indices.  Chunks are kept in order
+			// within each bucket so the sort is stable.
+			uint32_t sum = 0u;
+			for (uint32_t bucket = 0u; bucket < c_hxRadixSortBuckets; ++bucket) {
+				for (uint32_t i = 0u; i < HX_RADIX_SORT_TASKS; ++i) {
+					uint32_t* count = tasks[i].m_histogram + passes[pass] * c_hxRadixSortBuckets + bucket;
+					uint32_t t = *count + sum;
+					*count = sum;
+					sum = t;
+				}
+			}
+
+			hxRadixSortRun(taskQueue, tasks, Task::ModeScatter, src, dst, size, passes[pass]);
+			src = dst;
 		}
 
-		hxFree(histograms);
 		hxFree(buf1);
 	}
+
+	if (lines) {
+		hxFree(starts);
+		hxFree(lines);
+	}
+	hxFree(histograms);
 }
+
+template void hxRadixSortBase<uint32_t>::sort(hxMemoryManagerId tempMemory, hxTaskQueue* taskQueue);
+template void hxRadixSortBase<uint64_t>::sort(hxMemoryManagerId tempMemory, hxTaskQueue* taskQueue);
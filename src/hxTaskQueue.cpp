@@ -2,27 +2,118 @@
 
 #include <hx/hxTaskQueue.h>
 #include <hx/hxProfiler.h>
+#include <hx/hxConsole.h>
+
+#if HX_USE_THREAD_AFFINITY
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+#endif
+
+#if HX_USE_NUMA && defined(__linux__)
+#include <errno.h>
+#include <linux/mempolicy.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
 
 HX_REGISTER_FILENAME_HASH
 
+#if HX_USE_NUMA
+HX_STATIC_ASSERT(HX_USE_CPP11_THREADS, "HX_USE_NUMA requires HX_USE_CPP11_THREADS");
+HX_STATIC_ASSERT(HX_NUMA_MAX_NODES >= 1 && HX_NUMA_MAX_NODES <= 64, "HX_NUMA_MAX_NODES");
+
+// The queue and node of the calling pool thread.  Used by enqueues from
+// running tasks.
+static HX_THREAD_LOCAL const hxTaskQueue* s_hxTaskQueueCurrent = hxnull;
+static HX_THREAD_LOCAL int32_t s_hxTaskQueueCurrentNode = 0;
+#endif
+
+#if HX_PROFILE
+HX_STATIC_ASSERT(HX_TASK_QUEUE_STATS_LABELS >= 2, "HX_TASK_QUEUE_STATS_LABELS");
+
+// Live queues for hxTaskQueue::logAllStats().
+static hxTaskQueue* s_hxTaskQueues = hxnull;
+#if HX_USE_CPP11_THREADS
+static std::mutex s_hxTaskQueuesMutex;
+#endif
+
+static void hxTaskQueueStatsCommand() {
+	hxTaskQueue::logAllStats();
+}
+hxConsoleCommandNamed(hxTaskQueueStatsCommand, taskqueuestats);
+
+// Index of the highest set bit plus one.  Zero for zero.
+static uint32_t hxTaskQueueStatsBucket(hx_timestamp_t cycles) {
+	uint32_t bucket = 0u;
+	while (cycles) {
+		++bucket;
+		cycles >>= 1;
+	}
+	return bucket < (uint32_t)hxTaskQueue::StatsBuckets ? bucket : (uint32_t)hxTaskQueue::StatsBuckets - 1u;
+}
+
+static void hxTaskQueueStatsLogHistogram(const uint32_t* histogram) {
+	for (uint32_t i = 0u; i < (uint32_t)hxTaskQueue::StatsBuckets; ++i) {
+		if (histogram[i] != 0u) {
+			hxLogRelease("    < %fms: %u\n", (double)(1u << i) * (double)g_hxTimeMillisecondsPerCycle,
+				(unsigned int)histogram[i]);
+		}
+	}
+}
+#endif
+
 // ----------------------------------------------------------------------------
 // hxTaskQueue
 
-hxTaskQueue::hxTaskQueue(int32_t threadPoolSize)
-	: m_nextTask(hxnull)
+hxTaskQueue::hxTaskQueue(int32_t threadPoolSize, const int32_t* threadCpus, const int32_t* threadNodes)
+	: m_parkedTasks(hxnull)
 	, m_runningQueueCheck(RunningQueueCheck_)
 
 {
-	(void)threadPoolSize;
+	(void)threadPoolSize; (void)threadCpus; (void)threadNodes;
+	hxAssertMsg(!threadCpus || threadPoolSize >= 0, "threadCpus requires threadPoolSize");
+	hxAssertMsg(!threadNodes || threadPoolSize >= 0, "threadNodes requires threadPoolSize");
+	for (int32_t i = 0; i < (int32_t)Nodes_; ++i) {
+		m_nextTask[i] = hxnull;
+	}
 #if HX_USE_CPP11_THREADS
 	m_threadPoolSize = (threadPoolSize >= 0) ? threadPoolSize
 		: ((int32_t)std::thread::hardware_concurrency() - 1);
+	for (int32_t i = 0; i < (int32_t)Nodes_; ++i) {
+		m_injectedTasks[i].store(hxnull, std::memory_order_relaxed);
+	}
+#if HX_USE_NUMA
+	if (threadNodes) {
+		for (int32_t i = 0; i < m_threadPoolSize; ++i) {
+			hxAssertRelease(threadNodes[i] >= 0 && threadNodes[i] < HX_NUMA_MAX_NODES,
+				"node out of range: %d", (int)threadNodes[i]);
+			m_nodeCount = hxMax(m_nodeCount, threadNodes[i] + 1);
+		}
+	}
+#else
+	threadNodes = hxnull;
+#endif
+#if HX_PROFILE
+	// Pool threads record statistics as soon as they start.
+	statsInit_(m_threadPoolSize + 1);
+#endif
 	if (m_threadPoolSize > 0) {
 		m_threads = (std::thread*)hxMalloc(m_threadPoolSize * sizeof(std::thread));
 		for (int32_t i = m_threadPoolSize; i--;) {
-			::new (m_threads + i) std::thread(executorThread_, this, ExecutorMode_::Pool_);
+			// Threads pin themselves before running any task.
+			int32_t cpu = threadCpus ? threadCpus[i] : -1;
+			int32_t node = threadNodes ? threadNodes[i] : -1;
+			::new (m_threads + i) std::thread(executorThread_, this, ExecutorMode_::Pool_, i, cpu, node);
 		}
 	}
+#elif HX_PROFILE
+	m_statsDepth = 0;
+	statsInit_(1);
 #endif
 }
 
@@ -30,7 +121,7 @@ hxTaskQueue::~hxTaskQueue() {
 #if HX_USE_CPP11_THREADS
 	if (m_threadPoolSize > 0) {
 		// Contribute current thread, request waiting until completion and signal stopping.
-		executorThread_(this, ExecutorMode_::Stopping_);
+		executorThread_(this, ExecutorMode_::Stopping_, m_threadPoolSize, -1, -1);
 		hxAssertRelease(m_runningQueueCheck == 0u, "Q");
 
 		for (int32_t i = m_threadPoolSize; i--;) {
@@ -46,25 +137,99 @@ hxTaskQueue::~hxTaskQueue() {
 		waitForAll();
 		m_runningQueueCheck = 0u;
 	}
+
+#if HX_PROFILE
+	{
+#if HX_USE_CPP11_THREADS
+		std::unique_lock<std::mutex> lk(s_hxTaskQueuesMutex);
+#endif
+		hxTaskQueue** it = &s_hxTaskQueues;
+		while (*it != this) {
+			it = &(*it)->m_nextQueue;
+		}
+		*it = m_nextQueue;
+	}
+	hxFree(m_stats);
+	m_stats = hxnull;
+#endif
 }
 
-void hxTaskQueue::enqueue(hxTask* task) {
+void hxTaskQueue::enqueue(hxTask* task, int32_t node) {
+	(void)node;
 	hxAssert(task);
 	task->setOwner(this);
+#if HX_PROFILE
+	task->setEnqueueTimestamp(hxTimeSampleTimestamp());
+	++m_statsDepth;
+#endif
+
+#if HX_USE_CPP11_THREADS
+	if (m_threadPoolSize > 0) {
+		inject_(task, task, 1u, enqueueNode_(node));
+	}
+	else
+#endif
+	{
+		task->setNextTask(m_nextTask[0]);
+		m_nextTask[0] = task;
+	}
+}
+
+void hxTaskQueue::enqueueBatch(hxTask** tasks, uint32_t count, int32_t node) {
+	(void)node;
+	hxAssert(tasks || count == 0u);
+	if (count == 0u) {
+		return;
+	}
+
+	// Link the tasks in order so they are published together.
+#if HX_PROFILE
+	hx_timestamp_t now = hxTimeSampleTimestamp();
+	m_statsDepth += (int32_t)count;
+#endif
+	for (uint32_t i = 0u; i < count; ++i) {
+		hxAssert(tasks[i]);
+		tasks[i]->setOwner(this);
+#if HX_PROFILE
+		tasks[i]->setEnqueueTimestamp(now);
+#endif
+	}
+	for (uint32_t i = 1u; i < count; ++i) {
+		tasks[i - 1u]->setNextTask(tasks[i]);
+	}
+	hxTask* last = tasks[count - 1u];
+
+#if HX_USE_CPP11_THREADS
+	if (m_threadPoolSize > 0) {
+		inject_(tasks[0], last, count, enqueueNode_(node));
+	}
+	else
+#endif
+	{
+		last->setNextTask(m_nextTask[0]);
+		m_nextTask[0] = tasks[0];
+	}
+}
+
+void hxTaskQueue::enqueueAt(hxTask* task, hx_timestamp_t deadline) {
+	hxAssert(task);
+	task->setOwner(this);
+	task->setDeadline(deadline);
 
 #if HX_USE_CPP11_THREADS
 	if (m_threadPoolSize > 0) {
 		std::unique_lock<std::mutex> lk(m_mutex);
 		hxAssertRelease(m_runningQueueCheck == RunningQueueCheck_, "enqueue to stopped queue");
-		task->setNextTask(m_nextTask);
-		m_nextTask = task;
-		m_condVarTasks.notify_one();
+		if (park_(task)) {
+			// Waiting threads recompute how long to sleep.
+			m_condVarTasks.notify_all();
+			m_condVarWaiting.notify_all();
+		}
 	}
 	else
 #endif
 	{
-		task->setNextTask(m_nextTask);
-		m_nextTask = task;
+		park_(task);
 	}
 }
 
@@ -72,76 +237,453 @@ void hxTaskQueue::waitForAll() {
 #if HX_USE_CPP11_THREADS
 	if (m_threadPoolSize > 0) {
 		// Contribute current thread and request waiting until completion.
-		executorThread_(this, ExecutorMode_::Waiting_);
+		executorThread_(this, ExecutorMode_::Waiting_, m_threadPoolSize, -1, -1);
 	}
 	else
 #endif
 	{
-		while (m_nextTask) {
-			hxTask* task = m_nextTask;
-			m_nextTask = task->getNextTask();
+		for (;;) {
+			releaseParked_(0);
+			if (!m_nextTask[0]) {
+				if (!m_parkedTasks) {
+					break;
+				}
+#if HX_USE_CPP11_THREADS
+				std::this_thread::sleep_for(parkedWait_());
+#endif
+				continue;
+			}
+
+			hxTask* task = m_nextTask[0];
+			m_nextTask[0] = task->getNextTask();
 			task->setNextTask(hxnull);
 			task->setOwner(hxnull);
 
-			// Last time this object is touched.  It may delete or re-enqueue itself, we
-			// don't care.
-			hxProfileScope(task->getLabel());
-			task->execute(this);
+#if HX_PROFILE
+			const char* label = task->getLabel();
+			hx_timestamp_t start = hxTimeSampleTimestamp();
+			statsDequeued_(task, 0, start, 0u);
+#endif
+			{
+				// Last time this object is touched.  It may delete or re-enqueue itself, we
+				// don't care.
+				hxProfileScopeUncached(task->getLabel(), 0u);
+				task->execute(this);
+			}
+#if HX_PROFILE
+			statsExecuted_(label, 0, hxTimeSampleTimestamp() - start);
+#endif
+		}
+	}
+}
+
+bool hxTaskQueue::park_(hxTask* task) {
+	// Called with m_mutex held when there is a thread pool.  Inserted after
+	// tasks with the same deadline.  Returns true if task is now first.
+	hxTask* prev = hxnull;
+	hxTask* next = m_parkedTasks;
+	while (next && next->getDeadline() <= task->getDeadline()) {
+		prev = next;
+		next = next->getNextTask();
+	}
+	task->setNextTask(next);
+	if (prev) {
+		prev->setNextTask(task);
+		return false;
+	}
+	m_parkedTasks = task;
+	return true;
+}
+
+void hxTaskQueue::releaseParked_(int32_t node) {
+	// Called with m_mutex held when there is a thread pool.  Moves the parked
+	// tasks that are due to the front of the releasing thread's node.
+	if (!m_parkedTasks) {
+		return;
+	}
+	hx_timestamp_t now = hxTimeSampleTimestamp();
+	if (m_parkedTasks->getDeadline() > now) {
+		return;
+	}
+	hxTask* last = m_parkedTasks;
+	for (;;) {
+#if HX_PROFILE
+		// Wait latency is measured from the deadline being reached.
+		last->setEnqueueTimestamp(now);
+		++m_statsDepth;
+#endif
+		hxTask* next = last->getNextTask();
+		if (!next || next->getDeadline() > now) {
+			break;
 		}
+		last = next;
 	}
+	hxTask* first = m_parkedTasks;
+	m_parkedTasks = last->getNextTask();
+	last->setNextTask(m_nextTask[node]);
+	m_nextTask[node] = first;
 }
 
+#if HX_USE_THREAD_AFFINITY
+void hxTaskQueue::setThreadAffinity_(int32_t cpu) {
+#if defined(_WIN32)
+	hxAssertMsg(cpu < (int32_t)(sizeof(DWORD_PTR) * 8u), "cpu out of range: %d", (int)cpu);
+	DWORD_PTR previous = ::SetThreadAffinityMask(::GetCurrentThread(), (DWORD_PTR)1 << cpu);
+	hxWarnCheck(previous != 0, "SetThreadAffinityMask cpu %d error %u", (int)cpu,
+		(unsigned int)::GetLastError()); (void)previous;
+#else
+	hxAssertMsg(cpu < CPU_SETSIZE, "cpu out of range: %d", (int)cpu);
+	cpu_set_t cpus;
+	CPU_ZERO(&cpus);
+	CPU_SET((size_t)cpu, &cpus);
+	int err = ::pthread_setaffinity_np(::pthread_self(), sizeof cpus, &cpus);
+	hxWarnCheck(err == 0, "pthread_setaffinity_np cpu %d error %d", (int)cpu, err); (void)err;
+#endif
+}
+#endif
+
+#if HX_USE_NUMA
+void hxTaskQueue::setMemoryNode_(int32_t node) {
+#if defined(__linux__)
+	// Pages are placed on node when first touched and come from other nodes
+	// once it is full.  EINVAL is returned for nodes without memory, which keep
+	// the default policy.
+	unsigned long mask = 1ul << node;
+	long err = ::syscall(SYS_set_mempolicy, MPOL_PREFERRED, &mask, (unsigned long)(sizeof mask * 8u));
+	hxWarnCheck(err == 0 || errno == EINVAL, "set_mempolicy node %d error %d", (int)node, errno); (void)err;
+#else
+	// Windows allocates from the node of the thread's processor by default.
+	(void)node;
+#endif
+}
+#endif
+
 #if HX_USE_CPP11_THREADS
-void hxTaskQueue::executorThread_(hxTaskQueue* q, ExecutorMode_ mode) {
+void hxTaskQueue::inject_(hxTask* first, hxTask* last, uint32_t count, int32_t node) {
+	// Lock-free push of the chain [first..last] onto m_injectedTasks.  Only pushes
+	// and whole list exchanges are performed, so ABA is not a concern.
+	hxAssertRelease(m_runningQueueCheck.load(std::memory_order_relaxed) == RunningQueueCheck_,
+		"enqueue to stopped queue");
+	std::atomic<hxTask*>& injected = m_injectedTasks[node];
+	hxTask* head = injected.load(std::memory_order_relaxed);
+	do {
+		last->setNextTask(head);
+	} while (!injected.compare_exchange_weak(head, first,
+		std::memory_order_seq_cst, std::memory_order_relaxed));
+
+	// Re-checked after the push.  The stopping thread clears m_runningQueueCheck
+	// and then checks m_injectedTasks is empty, so one of the two catches a push
+	// that races stopping.
+	hxAssertRelease(m_runningQueueCheck.load(std::memory_order_seq_cst) == RunningQueueCheck_,
+		"enqueue to stopped queue");
+
+	// Pairs with the increment of m_idleCount before a pool thread checks
+	// m_injectedTasks.  Either the pool thread sees the tasks or the tasks are
+	// followed by a notification.  Only then is m_mutex required.
+	int32_t idle = m_idleCount.load(std::memory_order_seq_cst);
+	if (idle > 0) {
+		std::unique_lock<std::mutex> lk(m_mutex);
+		if (count >= (uint32_t)idle) {
+			m_condVarTasks.notify_all();
+		}
+		else {
+			while (count--) {
+				m_condVarTasks.notify_one();
+			}
+		}
+	}
+}
+
+void hxTaskQueue::executorThread_(hxTaskQueue* q, ExecutorMode_ mode, int32_t worker, int32_t cpu,
+		int32_t node) {
 	hxTask* task = hxnull;
+	(void)worker; (void)cpu;
+#if HX_USE_THREAD_AFFINITY
+	if (cpu >= 0) {
+		setThreadAffinity_(cpu);
+	}
+#endif
+	if (node < 0) {
+		node = 0;
+	}
+#if HX_USE_NUMA
+	else {
+		setMemoryNode_(node);
+	}
+	if (mode == ExecutorMode_::Pool_) {
+		s_hxTaskQueueCurrent = q;
+		s_hxTaskQueueCurrentNode = node;
+	}
+#endif
+#if HX_PROFILE
+	const char* label = hxnull;
+	hx_timestamp_t busyStart = 0u;
+#endif
 	for (;;) {
 		{
+#if HX_PROFILE
+			// Time spent outside of execute() is counted as idle.
+			hx_timestamp_t idleStart = hxTimeSampleTimestamp();
+#endif
 			std::unique_lock<std::mutex> lk(q->m_mutex);
 
 			if (task) {
+#if HX_PROFILE
+				q->statsExecuted_(label, worker, idleStart - busyStart);
+#endif
 				// Waited to reacquire critical section to decrement counter for previous task.
 				task = hxnull;
 				hxAssert(q->m_executingCount > 0);
-				if (--q->m_executingCount == 0 && !q->m_nextTask) {
+				if (--q->m_executingCount == 0 && !q->hasTasks_()) {
 					q->m_condVarWaiting.notify_all();
 				}
 			}
 
 			// Either aquire a next task or meet stopping criteria.
+			q->releaseParked_(node);
+			task = q->takeTask_(node);
 			if (mode == ExecutorMode_::Pool_) {
-				q->m_condVarTasks.wait(lk, [q] {
-					return q->m_nextTask || q->m_runningQueueCheck != RunningQueueCheck_;
-				});
+				while (!task && q->m_runningQueueCheck == RunningQueueCheck_) {
+					q->m_idleCount.fetch_add(1, std::memory_order_seq_cst);
+					task = q->takeTask_(node);
+					if (!task) {
+						q->waitParked_(q->m_condVarTasks, lk);
+						q->releaseParked_(node);
+						task = q->takeTask_(node);
+					}
+					q->m_idleCount.fetch_sub(1, std::memory_order_relaxed);
+				}
 			}
 
-			if (q->m_nextTask) {
+			if (task) {
 				hxAssertRelease(q->m_runningQueueCheck == RunningQueueCheck_, "Q");
-				task = q->m_nextTask;
-				q->m_nextTask = task->getNextTask();
 				++q->m_executingCount;
+#if HX_PROFILE
+				label = task->getLabel();
+				busyStart = hxTimeSampleTimestamp();
+				q->statsDequeued_(task, worker, busyStart, busyStart - idleStart);
+#endif
 			}
 			else {
 				if (mode != ExecutorMode_::Pool_) {
-					q->m_condVarWaiting.wait(lk, [q] {
-						return q->m_executingCount == 0 && !q->m_nextTask;
-					});
+					if (q->m_executingCount != 0 || q->m_parkedTasks || q->hasTasks_()) {
+						// Wake for completion or to run a parked task that is due.
+						q->waitParked_(q->m_condVarWaiting, lk);
+#if HX_PROFILE
+						q->statsIdle_(worker, hxTimeSampleTimestamp() - idleStart);
+#endif
+						continue;
+					}
 
 					if (mode == ExecutorMode_::Stopping_) {
 						hxAssertRelease(q->m_runningQueueCheck == RunningQueueCheck_, "Q");
-						q->m_runningQueueCheck = 0u;
+						q->m_runningQueueCheck.store(0u, std::memory_order_seq_cst);
+						hxAssertRelease(!q->hasTasks_(), "enqueue to stopped queue");
 						q->m_condVarTasks.notify_all();
 					}
 				}
 
+#if HX_PROFILE
+				q->statsIdle_(worker, hxTimeSampleTimestamp() - idleStart);
+#endif
 				return;
 			}
 		}
 
 		task->setNextTask(hxnull);
 		task->setOwner(hxnull);
-		hxProfileScope(task->getLabel());
+		hxProfileScopeUncached(task->getLabel(), 0u);
 		// Last time this object is touched.  It may delete or re-enqueue itself.
 		task->execute(q);
 	}
 }
+
+int32_t hxTaskQueue::enqueueNode_(int32_t node) const {
+#if HX_USE_NUMA
+	if (node < 0) {
+		return (s_hxTaskQueueCurrent == this) ? s_hxTaskQueueCurrentNode : 0;
+	}
+	hxAssertMsg(node < m_nodeCount, "node out of range: %d", (int)node);
+	return (node < m_nodeCount) ? node : 0;
+#else
+	(void)node;
+	return 0;
+#endif
+}
+
+hxTask* hxTaskQueue::takeTask_(int32_t node) {
+	// Called with m_mutex held.  Takes from node's list, then from the tasks
+	// injected to node and only then from the other nodes in turn.  Injected
+	// tasks are only taken once a node's list runs out.
+	for (int32_t i = 0; i < m_nodeCount; ++i) {
+		int32_t n = (node + i) % m_nodeCount;
+		hxTask*& next = m_nextTask[n];
+		if (!next) {
+			next = m_injectedTasks[n].exchange(hxnull, std::memory_order_seq_cst);
+		}
+		if (next) {
+			hxTask* task = next;
+			next = task->getNextTask();
+			return task;
+		}
+	}
+	return hxnull;
+}
+
+bool hxTaskQueue::hasTasks_() const {
+	// Called with m_mutex held.
+	for (int32_t i = 0; i < m_nodeCount; ++i) {
+		if (m_nextTask[i] || m_injectedTasks[i].load(std::memory_order_seq_cst)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+std::chrono::microseconds hxTaskQueue::parkedWait_() const {
+	hx_timestamp_t now = hxTimeSampleTimestamp();
+	hx_timestamp_t deadline = m_parkedTasks->getDeadline();
+	double cycles = deadline > now ? (double)(deadline - now) : 0.0;
+	// Rounded up so the first deadline has been reached on waking.
+	return std::chrono::microseconds((int64_t)(cycles * (double)g_hxTimeMillisecondsPerCycle * 1.0e+3) + 1);
+}
+
+void hxTaskQueue::waitParked_(std::condition_variable& condVar, std::unique_lock<std::mutex>& lk) {
+	// Every idle thread wakes for the earliest deadline.  enqueueAt() notifies
+	// when that changes.
+	if (m_parkedTasks) {
+		condVar.wait_for(lk, parkedWait_());
+	}
+	else {
+		condVar.wait(lk);
+	}
+}
+#endif
+
+#if HX_PROFILE
+void hxTaskQueue::statsInit_(int32_t workerCount) {
+	// Queues are often constructed within a temporary stack scope.  Keep the
+	// statistics out of it.
+	m_stats = (Stats*)hxMallocExt(sizeof(Stats) + workerCount * sizeof(StatsWorker),
+		hxMemoryManagerId_Heap, HX_ALIGNMENT_MASK);
+	m_stats->m_workerCount = workerCount;
+	m_stats->m_workers = (StatsWorker*)(m_stats + 1);
+	resetStats();
+
+#if HX_USE_CPP11_THREADS
+	std::unique_lock<std::mutex> lk(s_hxTaskQueuesMutex);
+#endif
+	m_nextQueue = s_hxTaskQueues;
+	s_hxTaskQueues = this;
+}
+
+void hxTaskQueue::resetStats() {
+	m_stats->m_executed = 0u;
+	m_stats->m_maxDepth = 0;
+	m_stats->m_maxWaitCycles = 0u;
+	m_stats->m_totalWaitCycles = 0.0;
+	::memset(m_stats->m_waitHistogram, 0x00, sizeof m_stats->m_waitHistogram);
+	::memset(m_stats->m_labels, 0x00, sizeof m_stats->m_labels);
+	::memset(m_stats->m_workers, 0x00, m_stats->m_workerCount * sizeof(StatsWorker));
+}
+
+void hxTaskQueue::logStats() {
+#if HX_USE_CPP11_THREADS
+	std::unique_lock<std::mutex> lk(m_mutex);
+#endif
+	const double msPerCycle = (double)g_hxTimeMillisecondsPerCycle;
+	const Stats& stats = *m_stats;
+
+	hxLogRelease("taskqueue %p: executed %u max depth %d\n", (void*)this,
+		(unsigned int)stats.m_executed, (int)stats.m_maxDepth);
+	for (int32_t i = 0; i < stats.m_workerCount; ++i) {
+		const StatsWorker& w = stats.m_workers[i];
+		double total = w.m_busyCycles + w.m_idleCycles;
+		hxLogRelease("  worker %d: tasks %u busy %fms idle %fms utilization %f%%\n", (int)i,
+			(unsigned int)w.m_count, w.m_busyCycles * msPerCycle, w.m_idleCycles * msPerCycle,
+			total > 0.0 ? 100.0 * w.m_busyCycles / total : 0.0);
+	}
+	if (stats.m_executed != 0u) {
+		hxLogRelease("  wait: mean %fms max %fms\n",
+			stats.m_totalWaitCycles * msPerCycle / stats.m_executed,
+			stats.m_maxWaitCycles * msPerCycle);
+		hxTaskQueueStatsLogHistogram(stats.m_waitHistogram);
+	}
+	for (uint32_t i = 0u; i < HX_TASK_QUEUE_STATS_LABELS; ++i) {
+		const StatsLabel& l = stats.m_labels[i];
+		if (l.m_label) {
+			hxLogRelease("  %s: count %u mean %fms max %fms total %fms\n", l.m_label,
+				(unsigned int)l.m_count, l.m_totalCycles * msPerCycle / l.m_count,
+				l.m_maxCycles * msPerCycle, l.m_totalCycles * msPerCycle);
+			hxTaskQueueStatsLogHistogram(l.m_histogram);
+		}
+	}
+}
+
+void hxTaskQueue::logAllStats() {
+#if HX_USE_CPP11_THREADS
+	std::unique_lock<std::mutex> lk(s_hxTaskQueuesMutex);
 #endif
+	for (hxTaskQueue* q = s_hxTaskQueues; q; q = q->m_nextQueue) {
+		q->logStats();
+	}
+}
+
+// The following are called with m_mutex held when there is a thread pool.
+
+void hxTaskQueue::statsDequeued_(hxTask* task, int32_t worker, hx_timestamp_t now, hx_timestamp_t idleCycles) {
+	Stats& stats = *m_stats;
+	int32_t depth = m_statsDepth--;
+	if (depth > stats.m_maxDepth) {
+		stats.m_maxDepth = depth;
+	}
+
+	hx_timestamp_t wait = now - task->getEnqueueTimestamp();
+	stats.m_totalWaitCycles += wait;
+	if (wait > stats.m_maxWaitCycles) {
+		stats.m_maxWaitCycles = wait;
+	}
+	++stats.m_waitHistogram[hxTaskQueueStatsBucket(wait)];
+
+	stats.m_workers[worker].m_idleCycles += idleCycles;
+}
+
+void hxTaskQueue::statsExecuted_(const char* label, int32_t worker, hx_timestamp_t runCycles) {
+	++m_stats->m_executed;
+
+	StatsLabel& l = statsLabel_(label);
+	++l.m_count;
+	l.m_totalCycles += runCycles;
+	if (runCycles > l.m_maxCycles) {
+		l.m_maxCycles = runCycles;
+	}
+	++l.m_histogram[hxTaskQueueStatsBucket(runCycles)];
+
+	StatsWorker& w = m_stats->m_workers[worker];
+	++w.m_count;
+	w.m_busyCycles += runCycles;
+}
+
+void hxTaskQueue::statsIdle_(int32_t worker, hx_timestamp_t idleCycles) {
+	m_stats->m_workers[worker].m_idleCycles += idleCycles;
+}
+
+hxTaskQueue::StatsLabel& hxTaskQueue::statsLabel_(const char* label) {
+	// Open addressing on the address of the static label string.
+	const uint32_t size = HX_TASK_QUEUE_STATS_LABELS - 1u;
+	uint32_t hash = (uint32_t)(((uintptr_t)label >> 2) * 2654435761u);
+	for (uint32_t i = 0u; i < size; ++i) {
+		StatsLabel& l = m_stats->m_labels[(hash + i) % size];
+		if (l.m_label == label) {
+			return l;
+		}
+		if (!l.m_label) {
+			l.m_label = label;
+			return l;
+		}
+	}
+	StatsLabel& other = m_stats->m_labels[size];
+	other.m_label = "other";
+	return other;
+}
+#endif // HX_PROFILE
@@ -286,3 +286,30 @@ TEST_F(hxHashTableTest, Strings) {
 	ASSERT_EQ(m_constructed, sz);
 	ASSERT_EQ(m_destructed, sz);
 }
+
+// ----------------------------------------------------------------------------
+
+BENCHMARK(hxHashTableBenchmark, InsertFindUint32) {
+	const uint32_t size = 1000u;
+	hxTestRandom prng;
+	uint32_t keys[size];
+	for (uint32_t i = 0u; i < size; ++i) {
+		keys[i] = prng();
+	}
+
+	uint32_t found = 0u;
+	benchmark.setBytesPerIteration(sizeof keys);
+	while (benchmark.keepRunning()) {
+		// Nodes are allocated from the benchmark's temporary stack scope and
+		// freed by the destructor.
+		hxHashTable<hxHashTableNodeInteger<uint32_t>, 10> table;
+		for (uint32_t i = 0u; i < size; ++i) {
+			table.insert_unique(keys[i]);
+		}
+		for (uint32_t i = 0u; i < size; ++i) {
+			found += table.find(keys[i]) ? 1u : 0u;
+		}
+	}
+	// Warmup iterations are not counted.
+	ASSERT_TRUE(found % size == 0u && found >= benchmark.iterations() * size);
+}
@@ -179,3 +179,33 @@ TEST(hxMemoryManagerTest, ScratchOverflow) {
 #endif // HX_USE_MEMORY_SCRATCH
 
 #endif // HX_MEM_DIAGNOSTIC_LEVEL == -1
+
+// ----------------------------------------------------------------------------
+
+BENCHMARK(hxMemoryManagerBenchmark, HeapMallocFree) {
+	void* ptrs[16];
+	while (benchmark.keepRunning()) {
+		for (uint32_t i = 0u; i < 16u; ++i) {
+			ptrs[i] = hxMallocExt(16u << (i & 3u), hxMemoryManagerId_Heap);
+		}
+		for (uint32_t i = 16u; i--;) {
+			hxFree(ptrs[i]);
+		}
+	}
+	SUCCEED();
+}
+
+BENCHMARK(hxMemoryManagerBenchmark, TemporaryStackScope) {
+	// The temporary stack only reclaims memory when a scope closes.
+	void* ptrs[16];
+	while (benchmark.keepRunning()) {
+		hxMemoryManagerScope temporaryStack(hxMemoryManagerId_TemporaryStack);
+		for (uint32_t i = 0u; i < 16u; ++i) {
+			ptrs[i] = hxMalloc(16u << (i & 3u));
+		}
+		for (uint32_t i = 16u; i--;) {
+			hxFree(ptrs[i]);
+		}
+	}
+	SUCCEED();
+}
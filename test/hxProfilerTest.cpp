@@ -4,11 +4,37 @@
 #include <hx/hxProfiler.h>
 #include <hx/hxTaskQueue.h>
 #include <hx/hxConsole.h>
+#include <hx/hxFile.h>
 
 #include <hx/hxTest.h>
 
+#if HX_USE_CPP11_TIME
+#include <chrono>
+#endif
+
 HX_REGISTER_FILENAME_HASH
 
+// ----------------------------------------------------------------------------
+
+TEST(hxTimeTest, Timestamp) {
+#if HX_USE_CPP11_TIME
+	std::chrono::steady_clock::time_point real0 = std::chrono::steady_clock::now();
+#endif
+	hx_timestamp_t t0 = hxTimeSampleTimestamp();
+	hx_timestamp_t t1 = t0;
+	while ((double)(t1 - t0) * g_hxTimeMillisecondsPerCycle < 2.0) {
+		hx_timestamp_t t = hxTimeSampleTimestamp();
+		ASSERT_TRUE(t >= t1);
+		t1 = t;
+	}
+#if HX_USE_CPP11_TIME
+	// The calibration is expected to be much better than this.
+	double realMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - real0).count();
+	ASSERT_TRUE(realMs > 1.0);
+#endif
+	ASSERT_TRUE(sizeof(hx_timestamp_t) == 8u || !(HX_USE_64_BIT_TYPES));
+}
+
 // ----------------------------------------------------------------------------
 #if HX_PROFILE
 
@@ -50,11 +76,11 @@ public:
 			if (targetMs >= 2.0f) {
 				float subtarget = targetMs / 2.0f;
 				const char* subLabel = s_hxTestLabels[(int32_t)subtarget];
-				hxProfileScope(subLabel);
+				hxProfileScopeUncached(subLabel, 0u);
 				generateScopes(subtarget);
 			}
 
-			while ((float)delta * c_hxTimeMillisecondsPerCycle < targetMs) {
+			while ((float)delta * g_hxTimeMillisecondsPerCycle < targetMs) {
 				// Perform work that might not be optimized away by the compiler.
 				int32_t ops = (m_accumulator & 0xf) + 1;
 				for (int32_t i = 0; i < ops; ++i) {
@@ -70,6 +96,39 @@ public:
 		int32_t m_accumulator;
 		hxTestRandom m_testPrng;
 	};
+
+	enum { OUTER = 10, INNER = 3 };
+
+	void generateNestedScopes() {
+		for (int32_t i = 0; i < OUTER; ++i) {
+			hxProfileScope("outer");
+			for (int32_t j = 0; j < INNER; ++j) {
+				hxProfileScope("inner");
+				hxProfilerTaskTest task;
+				task.construct("inner", 0.01f);
+				task.execute(hxnull);
+			}
+		}
+	}
+
+	void checkNestedStats() {
+		hxProfiler::Stats stats[4];
+		ASSERT_EQ(g_hxProfiler.getStats(stats, 4u), 2u);
+		const hxProfiler::Stats& outer = ::strcmp(stats[0].m_label, "outer") == 0 ? stats[0] : stats[1];
+		const hxProfiler::Stats& inner = ::strcmp(stats[0].m_label, "outer") == 0 ? stats[1] : stats[0];
+		ASSERT_TRUE(::strcmp(inner.m_label, "inner") == 0);
+		ASSERT_EQ(outer.m_count, (uint32_t)OUTER);
+		ASSERT_EQ(inner.m_count, (uint32_t)(OUTER * INNER));
+
+		// Self time excludes nested scopes.
+		ASSERT_TRUE(inner.m_self == inner.m_total);
+		ASSERT_TRUE(outer.m_self + inner.m_total == outer.m_total);
+
+		ASSERT_TRUE(inner.m_min <= inner.m_max);
+		ASSERT_TRUE((double)inner.m_min <= inner.percentile(0.5));
+		ASSERT_TRUE(inner.percentile(0.5) <= inner.percentile(0.99));
+		ASSERT_TRUE(inner.percentile(0.999) <= (double)inner.m_max);
+	}
 };
 
 // ----------------------------------------------------------------------------
@@ -110,4 +169,362 @@ TEST_F(hxProfilerTest, writeToChromeTracing) {
 	hxProfilerLog();
 }
 
+TEST_F(hxProfilerTest, Threads) {
+	enum { POOL = 4, SCOPES = 10 };
+	struct ScopesTask : public hxTask {
+		ScopesTask() : hxTask("scopes") { }
+		virtual void execute(hxTaskQueue* q) HX_OVERRIDE {
+			(void)q;
+			for (int32_t i = 0; i < SCOPES; ++i) {
+				hxProfileScope("scope");
+			}
+		}
+	};
+
+	hxProfilerStart();
+	{
+		hxTaskQueue q(POOL);
+		ScopesTask tasks[POOL];
+		for (int32_t i = 0; i < POOL; ++i) {
+			q.enqueue(tasks + i);
+		}
+		q.waitForAll();
+	}
+
+	// Includes the scope hxTaskQueue places around execute().
+	ASSERT_EQ(g_hxProfiler.recordsSize(), (uint32_t)(POOL * (SCOPES + 1)));
+	hxProfilerStop();
+}
+
+TEST_F(hxProfilerTest, Overflow) {
+	hxProfilerStart();
+	for (int32_t i = 0; i < HX_PROFILER_MAX_RECORDS + 10; ++i) {
+		hxProfileScope("overflow");
+	}
+	ASSERT_EQ(g_hxProfiler.recordsSize(), (uint32_t)HX_PROFILER_MAX_RECORDS);
+
+	g_hxProfiler.recordsClear();
+	ASSERT_EQ(g_hxProfiler.recordsSize(), 0u);
+	{
+		hxProfileScope("after clear");
+	}
+	ASSERT_EQ(g_hxProfiler.recordsSize(), 1u);
+	hxProfilerStop();
+}
+
+TEST_F(hxProfilerTest, Continuous) {
+	hxConsoleExecLine("profilecontinuous");
+	for (int32_t i = 0; i < HX_PROFILER_MAX_RECORDS + 2 * HX_PROFILER_BLOCK_RECORDS + 10; ++i) {
+		hxProfileScope("continuous");
+	}
+
+	// The oldest blocks were recycled instead of dropping the newest records.
+	uint32_t size = g_hxProfiler.recordsSize();
+	ASSERT_TRUE(size <= (uint32_t)HX_PROFILER_MAX_RECORDS);
+	ASSERT_TRUE(size > (uint32_t)(HX_PROFILER_MAX_RECORDS - HX_PROFILER_BLOCK_RECORDS));
+
+	{
+		hxProfileScope("latest");
+	}
+	bool isok = hxConsoleExecLine("profilesnapshot 1.0 profile_snapshot.json");
+	ASSERT_TRUE(isok);
+
+	hxFile f(hxFile::in, "profile_snapshot.json");
+	char line[HX_MAX_LINE] = "";
+	bool isLatestFound = false;
+	while (f.getline(line)) {
+		isLatestFound = isLatestFound || ::strstr(line, "\"latest\"") != hxnull;
+	}
+	ASSERT_TRUE(isLatestFound);
+	hxProfilerStop();
+}
+
+TEST_F(hxProfilerTest, Flush) {
+	enum { FIRST = 10, SECOND = 5 };
+	hxProfilerStart();
+	{
+		hxFile f(hxFile::out, "profile_flush.bin");
+		for (int32_t i = 0; i < FIRST; ++i) {
+			hxProfileScope("first");
+		}
+		hxProfilerFlush(f);
+		for (int32_t i = 0; i < SECOND; ++i) {
+			hxProfileScope("second");
+		}
+		hxProfilerFlush(f);
+
+		// Nothing new to write.
+		hxProfilerFlush(f);
+	}
+	hxProfilerStop();
+
+	hxFile f(hxFile::in | hxFile::fallible, "profile_flush.bin");
+	const char* labels[2] = { "first", "second" };
+	uint32_t counts[2] = { FIRST, SECOND };
+	for (int32_t i = 0; i < 2; ++i) {
+		hxProfiler::FileChunk chunk;
+		ASSERT_TRUE(f.read1(chunk));
+		ASSERT_EQ(chunk.m_magic, hxProfiler::FileChunk::c_magic);
+		ASSERT_EQ(chunk.m_count, counts[i]);
+		for (uint32_t j = 0; j < chunk.m_count; ++j) {
+			hx_timestamp_t begin = 0u;
+			hx_timestamp_t end = 0u;
+			uint32_t threadId = 0u;
+			uint32_t kind = ~0u;
+			uint32_t length = 0u;
+			char label[16] = "";
+			ASSERT_TRUE(f.read1(begin) && f.read1(end) && f.read1(threadId) && f.read1(kind) && f.read1(length));
+			ASSERT_EQ(kind, (uint32_t)hxProfiler::Record::KindScope);
+			ASSERT_TRUE(begin <= end);
+			ASSERT_TRUE(length < sizeof label);
+			ASSERT_EQ(f.read(label, length), (size_t)length);
+			ASSERT_TRUE(::strcmp(label, labels[i]) == 0);
+		}
+	}
+	char extra;
+	f.read(&extra, 1);
+	ASSERT_TRUE(f.eof());
+}
+
+TEST_F(hxProfilerTest, Capture) {
+	hxProfilerStart();
+	{
+		hxTaskQueue q(2);
+		hxProfilerTaskTest tasks[3];
+		for (int32_t i = 0; i < 3; ++i) {
+			tasks[i].construct(s_hxTestLabels[i], 2.0f);
+			q.enqueue(tasks + i);
+		}
+		q.waitForAll();
+	}
+	uint32_t records = g_hxProfiler.recordsSize();
+	ASSERT_TRUE(records >= 6u);
+
+	// Sampling continues while capturing.
+	hxProfilerWriteCapture("profile.hxpc");
+	hxProfilerStop();
+
+	uint8_t bytes[1024];
+	size_t captureSize = 0u;
+	{
+		hxFile f(hxFile::in | hxFile::fallible, "profile.hxpc");
+		captureSize = f.read(bytes, sizeof bytes);
+	}
+	ASSERT_TRUE(captureSize > 4u && captureSize < sizeof bytes);
+	ASSERT_TRUE(::memcmp(bytes, "hxPC", 4) == 0);
+
+	bool isok = hxConsoleExecLine("profileconvert profile.hxpc");
+	ASSERT_TRUE(isok);
+
+	uint32_t events = 0u;
+	size_t jsonSize = 0u;
+	hxFile f(hxFile::in, "profile.hxpc.json");
+	char line[HX_MAX_LINE] = "";
+	while (f.getline(line)) {
+		jsonSize += ::strlen(line);
+		events += ::strstr(line, "\"ph\":\"B\"") != hxnull ? 1u : 0u;
+		events += ::strstr(line, "\"ph\":\"E\"") != hxnull ? 1u : 0u;
+	}
+	ASSERT_EQ(events, 2u * records);
+	ASSERT_TRUE(captureSize * 4u < jsonSize);
+
+	// Not a capture.
+	ASSERT_FALSE(hxProfiler::convertCaptureToChromeTracing("profile.hxpc.json", "profile_bad.json"));
+}
+
+TEST_F(hxProfilerTest, Stats) {
+	hxProfiler::Stats stats;
+	stats.clear("uniform");
+	for (uint32_t i = 1; i <= 1000u; ++i) {
+		stats.add(i, i);
+	}
+	ASSERT_EQ(stats.m_count, 1000u);
+	ASSERT_TRUE(stats.m_min == 1u && stats.m_max == 1000u);
+	ASSERT_NEAR(stats.mean(), 500.5, 0.001);
+	ASSERT_NEAR(stats.percentile(0.5), 500.0, 500.0 * 0.125);
+	ASSERT_NEAR(stats.percentile(0.9), 900.0, 900.0 * 0.125);
+	ASSERT_NEAR(stats.percentile(0.99), 990.0, 990.0 * 0.125);
+	ASSERT_TRUE(stats.percentile(1.0) <= 1000.0);
+
+	hxProfilerStart();
+	generateNestedScopes();
+	checkNestedStats();
+	ASSERT_TRUE(hxConsoleExecLine("profilestats"));
+
+	// The same statistics without keeping records.
+	ASSERT_TRUE(hxConsoleExecLine("profileaggregate"));
+	generateNestedScopes();
+	ASSERT_EQ(g_hxProfiler.recordsSize(), 0u);
+	checkNestedStats();
+	hxProfilerLogStats();
+	hxProfilerStop();
+}
+
+TEST_F(hxProfilerTest, CounterMark) {
+	enum { COUNTERS = 5 };
+	hxProfilerStart();
+	hxProfileMark("begin");
+	for (int32_t i = 0; i < COUNTERS; ++i) {
+		hxProfileScope("scope");
+		hxProfileCounter("depth", i * 10);
+	}
+	hxProfileMark("end");
+	ASSERT_EQ(g_hxProfiler.recordsSize(), (uint32_t)(2 * COUNTERS + 2));
+
+	// Only scopes have statistics.
+	hxProfiler::Stats stats[2];
+	ASSERT_EQ(g_hxProfiler.getStats(stats, 2u), 1u);
+	ASSERT_EQ(stats[0].m_count, (uint32_t)COUNTERS);
+
+	hxProfilerWriteCapture("profile_counters.hxpc");
+	hxProfilerWriteToChromeTracing("profile_counters.json");
+	ASSERT_TRUE(hxProfiler::convertCaptureToChromeTracing("profile_counters.hxpc", "profile_counters2.json"));
+
+	const char* filenames[2] = { "profile_counters.json", "profile_counters2.json" };
+	for (int32_t i = 0; i < 2; ++i) {
+		uint32_t counters = 0u;
+		uint32_t marks = 0u;
+		uint32_t scopes = 0u;
+		bool isValueFound = false;
+		hxFile f(hxFile::in, "%s", filenames[i]);
+		char line[HX_MAX_LINE] = "";
+		while (f.getline(line)) {
+			counters += ::strstr(line, "\"ph\":\"C\"") != hxnull ? 1u : 0u;
+			marks += ::strstr(line, "\"ph\":\"i\"") != hxnull ? 1u : 0u;
+			scopes += ::strstr(line, "\"ph\":\"B\"") != hxnull ? 1u : 0u;
+			isValueFound = isValueFound || ::strstr(line, "\"args\":{\"value\":40}") != hxnull;
+		}
+		ASSERT_EQ(counters, (uint32_t)COUNTERS);
+		ASSERT_EQ(marks, 2u);
+		ASSERT_EQ(scopes, (uint32_t)COUNTERS);
+		ASSERT_TRUE(isValueFound);
+	}
+}
+
+TEST_F(hxProfilerTest, Filters) {
+	enum { SCOPES = 16, DECIMATION = 4 };
+	hxProfilerStart();
+	ASSERT_TRUE(hxConsoleExecLine("profiledisable"));
+	ASSERT_TRUE(hxConsoleExecLine("profileenable net."));
+	ASSERT_TRUE(hxConsoleExecLine("profiledecimate 4 net.poll"));
+	for (int32_t i = 0; i < SCOPES; ++i) {
+		{
+			hxProfileScope("net.send");
+		}
+		{
+			hxProfileScope("net.poll");
+		}
+		{
+			hxProfileScope("render");
+		}
+		hxProfileMark("render.mark");
+		hxProfileCounter("net.bytes", i);
+	}
+	ASSERT_EQ(g_hxProfiler.recordsSize(), (uint32_t)(SCOPES + SCOPES / DECIMATION + SCOPES));
+
+	// A call site with a varying label.
+	hxProfilerStart();
+	hxProfilerClearFilters();
+	hxProfilerAddFilter("Beta", 0u);
+	for (int32_t i = 0; i < SCOPES; ++i) {
+		hxProfileScopeUncached(s_hxTestLabels[i & 1], 0u);
+	}
+	ASSERT_EQ(g_hxProfiler.recordsSize(), (uint32_t)(SCOPES / 2));
+
+	// Uncached call sites are decimated as well.
+	hxProfilerStart();
+	hxProfilerAddFilter("Alpha", (uint32_t)DECIMATION);
+	for (int32_t i = 0; i < SCOPES; ++i) {
+		hxProfileScopeUncached(s_hxTestLabels[0], 0u);
+	}
+	ASSERT_EQ(g_hxProfiler.recordsSize(), (uint32_t)(SCOPES / DECIMATION));
+
+	// A runtime minimum duration.
+	hxProfilerStart();
+	ASSERT_TRUE(hxConsoleExecLine("profilefilterclear"));
+	ASSERT_TRUE(hxConsoleExecLine("profilemin 1000000"));
+	for (int32_t i = 0; i < SCOPES; ++i) {
+		hxProfileScope("short");
+	}
+	ASSERT_EQ(g_hxProfiler.recordsSize(), 0u);
+	ASSERT_TRUE(hxConsoleExecLine("profilemin 0"));
+	{
+		hxProfileScope("short");
+	}
+	ASSERT_EQ(g_hxProfiler.recordsSize(), 1u);
+	hxProfilerStop();
+}
+
+#if HX_USE_SIGPROF
+TEST_F(hxProfilerTest, Sampling) {
+	enum { SAMPLES = 20 };
+	hxConsoleExecLine("profilesample 1000");
+
+	// The timer measures CPU time.  Give up after 5 seconds.
+	hx_timestamp_t t0 = hxTimeSampleTimestamp();
+	while (g_hxProfiler.samplesSize() < (uint32_t)SAMPLES
+			&& (double)(hxTimeSampleTimestamp() - t0) * g_hxTimeMillisecondsPerCycle < 5000.0) {
+		hxProfileScope("outer");
+		{
+			hxProfileScope("inner");
+			hxProfilerTaskTest task;
+			task.construct("inner", 1.0f);
+			task.execute(hxnull);
+		}
+	}
+	hxProfilerStop();
+	uint32_t samples = g_hxProfiler.samplesSize();
+	ASSERT_TRUE(samples >= (uint32_t)SAMPLES);
+
+	// Scopes are not recorded while sampling.
+	ASSERT_EQ(g_hxProfiler.recordsSize(), 0u);
+	ASSERT_EQ(s_hxProfilerShadowStack.m_depth, 0u);
+
+	bool isok = hxConsoleExecLine("profilefolded profile.folded");
+	ASSERT_TRUE(isok);
+
+	uint32_t total = 0u;
+	uint32_t nested = 0u;
+	hxFile f(hxFile::in, "profile.folded");
+	char line[HX_MAX_LINE] = "";
+	while (f.getline(line)) {
+		const char* count = ::strrchr(line, ' ');
+		ASSERT_TRUE(count != hxnull);
+		if (count) {
+			total += (uint32_t)::strtoul(count + 1, hxnull, 10);
+			nested += ::strncmp(line, "outer;inner ", 12) == 0 ? (uint32_t)::strtoul(count + 1, hxnull, 10) : 0u;
+		}
+	}
+	ASSERT_EQ(total, samples);
+#if !defined(__SANITIZE_THREAD__) // ThreadSanitizer defers signals to its interceptors.
+	ASSERT_TRUE(nested > 0u);
+#endif
+}
+#endif
+
+TEST_F(hxProfilerTest, PerfCounters) {
+	if (!hxProfiler::perfCountersAvailable()) {
+		hxLog("perf counters unavailable, skipping.\n");
+		SUCCEED();
+		return;
+	}
+	hxProfilerStart();
+	{
+		hxProfileScope("perf");
+		hxProfilerTaskTest task;
+		task.construct("perf", 0.1f);
+		task.execute(hxnull);
+	}
+	hxProfilerWriteToChromeTracing("profile_perf.json");
+
+	bool isFound = false;
+	hxFile f(hxFile::in, "profile_perf.json");
+	char line[HX_MAX_LINE] = "";
+	while (f.getline(line)) {
+		isFound = isFound || (::strstr(line, "\"ph\":\"E\"") && ::strstr(line, "\"instructions\":")
+			&& !::strstr(line, "\"instructions\":0,"));
+	}
+	ASSERT_TRUE(isFound);
+}
+
 #endif // HX_PROFILE
@@ -0,0 +1,129 @@
+// Copyright 2017-2019 Adrian Johnston
+
+#include <hx/hatchling.h>
+#include <hx/hxSearch.h>
+#include <hx/hxTest.h>
+
+HX_REGISTER_FILENAME_HASH
+
+// ----------------------------------------------------------------------------
+
+class hxSearchTest :
+	public testing::Test
+{
+public:
+	struct TestObject {
+		uint32_t key;
+		uint32_t index;
+	};
+
+	// Compares objects by key and to keys directly.
+	struct KeyLess {
+		bool operator()(const TestObject& lhs, const TestObject& rhs) const { return lhs.key < rhs.key; }
+		bool operator()(const TestObject& lhs, uint32_t rhs) const { return lhs.key < rhs; }
+		bool operator()(uint32_t lhs, const TestObject& rhs) const { return lhs < rhs.key; }
+	};
+
+	// Sorted keys with runs of equal keys and gaps between them.
+	void generate(uint32_t* a, uint32_t size) {
+		uint32_t key = 1u;
+		for (uint32_t i = 0u; i < size; ++i) {
+			key += (m_prng() % 4u == 0u) ? 2u : 0u;
+			a[i] = key;
+		}
+	}
+
+	hxTestRandom m_prng;
+};
+
+TEST_F(hxSearchTest, Bounds) {
+	hxMemoryManagerScope temporaryStack(hxMemoryManagerId_TemporaryStack);
+	const uint32_t sizes[] = { 0u, 1u, 2u, 3u, 7u, 8u, 9u, 100u, HX_SEARCH_PREFETCH_MIN_SIZE + 100u };
+	for (uint32_t s = 0u; s < sizeof sizes / sizeof *sizes; ++s) {
+		const uint32_t size = sizes[s];
+		uint32_t* a = (uint32_t*)hxMalloc(size * sizeof(uint32_t) + 1u);
+		generate(a, size);
+		uint32_t maxKey = size ? a[size - 1u] + 1u : 1u;
+		for (uint32_t key = 0u; key <= maxKey; ++key) {
+			uint32_t lower = 0u;
+			while (lower < size && a[lower] < key) {
+				++lower;
+			}
+			uint32_t upper = lower;
+			while (upper < size && a[upper] == key) {
+				++upper;
+			}
+			ASSERT_EQ(hxLowerBound(a, a + size, key), a + lower);
+			ASSERT_EQ(hxUpperBound(a, a + size, key), a + upper);
+			uint32_t* equalUpper = hxnull;
+			ASSERT_EQ(hxEqualRange(a, a + size, key, equalUpper), a + lower);
+			ASSERT_EQ(equalUpper, a + upper);
+		}
+		hxFree(a);
+	}
+
+	// Keys of a different type than the elements.
+	TestObject objects[10];
+	for (uint32_t i = 0u; i < 10u; ++i) {
+		objects[i].key = i / 2u;
+		objects[i].index = i;
+	}
+	ASSERT_EQ(hxLowerBound(objects, objects + 10, 3u, KeyLess())->index, 6u);
+	ASSERT_EQ(hxUpperBound(objects, objects + 10, 3u, KeyLess())->index, 8u);
+	ASSERT_EQ(hxUpperBound(objects, objects + 10, 4u, KeyLess()), objects + 10);
+}
+
+TEST_F(hxSearchTest, Eytzinger) {
+	hxMemoryManagerScope heap(hxMemoryManagerId_Heap);
+	const uint32_t sizes[] = { 0u, 1u, 2u, 3u, 4u, 5u, 6u, 7u, 8u, 15u, 16u, 17u, 100u, 10000u };
+	for (uint32_t s = 0u; s < sizeof sizes / sizeof *sizes; ++s) {
+		const uint32_t size = sizes[s];
+		uint32_t* a = (uint32_t*)hxMalloc(size * sizeof(uint32_t) + 1u);
+		generate(a, size);
+		hxEytzinger<uint32_t> table(a, a + size);
+		ASSERT_EQ(table.size(), size);
+		ASSERT_EQ((uint32_t)(table.end() - table.begin()), size);
+
+		uint32_t maxKey = size ? a[size - 1u] + 1u : 1u;
+		uint32_t* keys = (uint32_t*)hxMalloc((maxKey + 1u) * sizeof(uint32_t));
+		const uint32_t** results = (const uint32_t**)hxMalloc((maxKey + 1u) * sizeof(const uint32_t*));
+		for (uint32_t key = 0u; key <= maxKey; ++key) {
+			keys[key] = key;
+		}
+		table.lowerBounds(keys, keys + maxKey + 1u, results);
+
+		for (uint32_t key = 0u; key <= maxKey; ++key) {
+			const uint32_t* lower = hxLowerBound(a, a + size, key);
+			const uint32_t* upper = hxUpperBound(a, a + size, key);
+			const uint32_t* e = table.lowerBound(key);
+			ASSERT_EQ(e == hxnull, lower == a + size);
+			if (e) {
+				ASSERT_EQ(*e, *lower);
+			}
+			ASSERT_EQ(results[key], e);
+			e = table.upperBound(key);
+			ASSERT_EQ(e == hxnull, upper == a + size);
+			if (e) {
+				ASSERT_EQ(*e, *upper);
+			}
+		}
+		hxFree(results);
+		hxFree(keys);
+		hxFree(a);
+	}
+
+	// Keys of a different type than the elements.
+	TestObject objects[10];
+	for (uint32_t i = 0u; i < 10u; ++i) {
+		objects[i].key = i * 10u;
+		objects[i].index = i;
+	}
+	hxEytzinger<TestObject> table;
+	table.assign(objects, objects + 10);
+	ASSERT_EQ(table.lowerBound(35u, KeyLess())->index, 4u);
+	ASSERT_EQ(table.upperBound(40u, KeyLess())->index, 5u);
+	ASSERT_TRUE(table.lowerBound(91u, KeyLess()) == hxnull);
+	table.clear();
+	ASSERT_TRUE(table.empty());
+	ASSERT_TRUE(table.lowerBound(0u, KeyLess()) == hxnull);
+}
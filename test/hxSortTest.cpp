@@ -2,6 +2,7 @@
 
 #include <hx/hatchling.h>
 #include <hx/hxSort.h>
+#include <hx/hxTaskQueue.h>
 #include <hx/hxTest.h>
 
 HX_REGISTER_FILENAME_HASH
@@ -12,6 +13,8 @@ class hxRadixSortTest :
 	public testing::Test
 {
 public:
+	hxRadixSortTest() : m_isInPlace(false) { }
+
 	template<typename Key>
 	struct TestObject {
 		TestObject(Key k) : id(k) { }
@@ -37,8 +40,9 @@ public:
 	}
 
 	template<typename Key>
-	void test(uint32_t size, uint32_t mask, Key offset) {
-		hxMemoryManagerScope temporaryStack(hxMemoryManagerId_TemporaryStack);
+	void test(uint32_t size, uint32_t mask, Key offset, hxTaskQueue* taskQueue=hxnull,
+			hxMemoryManagerId memoryId=hxMemoryManagerId_TemporaryStack) {
+		hxMemoryManagerScope temporaryStack(memoryId);
 
 		// Generate test data
 		hxArray<TestObject<Key> > a;
@@ -54,7 +58,15 @@ public:
 			rs.insert(a[i].id, &a[i]);
 		}
 
-		rs.sort(hxMemoryManagerId_TemporaryStack);
+		if (taskQueue) {
+			rs.sort(hxMemoryManagerId_Heap, taskQueue);
+		}
+		else if (m_isInPlace) {
+			rs.sortInPlace();
+		}
+		else {
+			rs.sort(memoryId);
+		}
 
 		ASSERT_EQ(b.size(), size);
 		ASSERT_EQ(rs.size(), size);
@@ -72,7 +84,59 @@ public:
 		ASSERT_EQ(cit, rs.cend());
 	}
 
+	template<typename Key>
+	static int qSortCompareKeys(const void* a, const void* b) {
+		if (*(const Key*)a < *(const Key*)b) { return -1; }
+		if (*(const Key*)b < *(const Key*)a) { return 1; }
+		return 0;
+	}
+
+	template<typename Key>
+	void testKeys(uint32_t size, uint32_t mask, Key offset,
+			hxMemoryManagerId memoryId=hxMemoryManagerId_TemporaryStack) {
+		hxMemoryManagerScope temporaryStack(memoryId);
+
+		hxArray<Key> a;
+		a.reserve(size);
+		for (uint32_t i = size; i--;) {
+			a.push_back((Key)(m_prng() & mask) - offset);
+		}
+
+		hxArray<Key> b(a);
+		::qsort(b.data(), b.size(), sizeof(Key), qSortCompareKeys<Key>);
+
+		if (m_isInPlace) {
+			hxRadixSortKeysInPlace(a.data(), a.data() + a.size());
+		}
+		else {
+			hxRadixSortKeys(a.data(), a.data() + a.size(), memoryId);
+		}
+		ASSERT_TRUE(::memcmp(a.data(), b.data(), size * sizeof(Key)) == 0);
+	}
+
+	// A record sorted by its fields.  order is its index before sorting.
+	struct Record {
+		int32_t key;
+		float weight;
+		uint32_t order;
+	};
+
+	struct RecordWeight {
+		typedef float Key;
+		float operator()(const Record& r) const { return r.weight; }
+	};
+
+	// Checks that the records are in key order and then in index order.
+	template<typename KeyFn>
+	static bool isStable(const Record* a, uint32_t index0, uint32_t index1, const KeyFn& keyFn) {
+		if (keyFn(a[index0]) != keyFn(a[index1])) {
+			return keyFn(a[index0]) < keyFn(a[index1]);
+		}
+		return a[index0].order < a[index1].order;
+	}
+
 	hxTestRandom m_prng;
+	bool m_isInPlace;
 };
 
 // ----------------------------------------------------------------------------
@@ -122,10 +186,164 @@ TEST_F(hxRadixSortTest, Types) {
 	test<int16_t>(100u, 0x7fu, 0x3f);
 }
 
+TEST_F(hxRadixSortTest, Keys64) {
+	test<uint64_t>(20u, 0x7fu, 0u); // check insertion sort
+	test<uint64_t>(1000u, ~(uint32_t)0, 0u);
+	test<uint64_t>(1000u, ~(uint32_t)0, (uint64_t)1u << 40); // wraps
+	test<int64_t>(1000u, 0x7fffu, 0x3fff);
+	test<int64_t>(1000u, ~(uint32_t)0, (int64_t)1 << 40);
+	test<double>(1000u, 0x7fffu, 16383.5);
+	test<double>(1000u, ~(uint32_t)0, 1.0e+12);
+}
+
+TEST_F(hxRadixSortTest, Keys) {
+	testKeys<uint8_t>(1000u, 0xffu, 0u);
+	testKeys<int8_t>(1000u, 0xffu, 0x7f);
+	testKeys<uint16_t>(1000u, 0xffffu, 0u);
+	testKeys<int16_t>(1000u, 0xffffu, 0x7fff);
+	testKeys<uint32_t>(20u, 0x7fu, 0u); // check insertion sort
+	testKeys<uint32_t>(1000u, ~(uint32_t)0, 0u);
+	testKeys<uint32_t>(1000u, 0xff00u, 0u); // check skipping passes
+	testKeys<int32_t>(1000u, 0x7fffu, 0x3fff);
+	testKeys<uint64_t>(1000u, ~(uint32_t)0, (uint64_t)1u << 40);
+	testKeys<int64_t>(1000u, ~(uint32_t)0, (int64_t)1 << 40);
+	testKeys<float>(1000u, 0x7fffu, 16383.5f);
+	testKeys<double>(1000u, ~(uint32_t)0, 1.0e+12);
+}
+
+TEST_F(hxRadixSortTest, Parallel) {
+	hxTaskQueue q(3);
+	const uint32_t size = HX_RADIX_SORT_PARALLEL_MIN_SIZE + 1001u;
+	test<uint32_t>(100u, 0x7fu, 0u, &q); // check single threaded
+	test<uint32_t>(size, ~(uint32_t)0, 0u, &q);
+	test<uint32_t>(size, 0xff00u, 0u, &q); // check skipping passes
+	test<uint32_t>(size, 0x00ffff00u, 0u, &q);
+	test<uint32_t>(size, 0u, 0u, &q);
+	test<int32_t>(size, 0x7fffu, 0x3fff, &q);
+	test<float>(size, ~(uint32_t)0, 0.0f, &q);
+	test<uint8_t>(size, 0x7fu, 0x3fu, &q);
+	test<uint64_t>(size, ~(uint32_t)0, (uint64_t)1u << 40, &q);
+	test<double>(size, ~(uint32_t)0, 1.0e+12, &q);
+}
+
+TEST_F(hxRadixSortTest, RadixSelect) {
+	hxMemoryManagerScope temporaryStack(hxMemoryManagerId_TemporaryStack);
+	const uint32_t size = 10000u;
+	const uint32_t masks[] = { ~(uint32_t)0, 0xffu, 0x00ff0000u, 0u };
+	for (uint32_t m = 0u; m < sizeof masks / sizeof *masks; ++m) {
+		hxArray<int64_t> a;
+		a.reserve(size);
+		for (uint32_t i = 0u; i < size; ++i) {
+			a.push_back((int64_t)(m_prng() & masks[m]) - ((int64_t)1 << 31));
+		}
+		hxArray<int64_t> b(a);
+		hxSort(b.begin(), b.end());
+		hxArray<double> d;
+		d.reserve(size);
+		for (uint32_t i = 0u; i < size; ++i) {
+			d.push_back((double)a[i] * 0.5);
+		}
+
+		const uint32_t nths[] = { 0u, 1u, size / 2u, size - 1u };
+		for (uint32_t n = 0u; n < sizeof nths / sizeof *nths; ++n) {
+			const uint32_t nth = nths[n];
+			hxRadixSelectKeys(a.begin(), a.begin() + nth, a.end());
+			ASSERT_EQ(a[nth], b[nth]);
+			for (uint32_t i = 0u; i < size; ++i) {
+				ASSERT_TRUE(i < nth ? a[i] <= a[nth] : a[nth] <= a[i]);
+			}
+			hxRadixSelectKeys(d.begin(), d.begin() + nth, d.end());
+			ASSERT_EQ(d[nth], (double)b[nth] * 0.5);
+		}
+	}
+}
+
+TEST_F(hxRadixSortTest, WriteCombining) {
+	// Sizes above HX_RADIX_SORT_WRITE_COMBINE_BYTES do not fit the temporary stack.
+	hxTaskQueue q(3);
+	const uint32_t size = HX_RADIX_SORT_WRITE_COMBINE_BYTES / 4u + 1001u;
+	testKeys<uint32_t>(size, ~(uint32_t)0, 0u, hxMemoryManagerId_Heap);
+	testKeys<uint64_t>(size, ~(uint32_t)0, (uint64_t)1u << 40, hxMemoryManagerId_Heap);
+	test<uint32_t>(size, ~(uint32_t)0, 0u, hxnull, hxMemoryManagerId_Heap);
+	test<uint32_t>(size, 0x00ffff00u, 0u, hxnull, hxMemoryManagerId_Heap);
+	test<uint32_t>(size, ~(uint32_t)0, 0u, &q, hxMemoryManagerId_Heap);
+	test<double>(size, ~(uint32_t)0, 1.0e+12, &q, hxMemoryManagerId_Heap);
+}
+
+TEST_F(hxRadixSortTest, InPlace) {
+	m_isInPlace = true;
+	test<uint32_t>(20u, 0x7fu, 0u); // check insertion sort
+	test<uint32_t>(1000u, 0x7fu, 0u); // check small buckets
+	test<uint32_t>(10000u, ~(uint32_t)0, 0u);
+	test<uint32_t>(10000u, 0x00ffff00u, 0u); // check skipping digits
+	test<int32_t>(10000u, 0x7fffu, 0x3fff);
+	test<float>(10000u, ~(uint32_t)0, 0.0f);
+	test<uint64_t>(10000u, ~(uint32_t)0, (uint64_t)1u << 40);
+	testKeys<uint8_t>(1000u, 0xffu, 0u);
+	testKeys<int16_t>(10000u, 0xffffu, 0x7fff);
+	testKeys<uint32_t>(10000u, 0u, 0u);
+	testKeys<uint64_t>(10000u, ~(uint32_t)0, (uint64_t)1u << 40);
+	testKeys<double>(10000u, ~(uint32_t)0, 1.0e+12);
+}
+
+TEST_F(hxRadixSortTest, Records) {
+	hxMemoryManagerScope temporaryStack(hxMemoryManagerId_TemporaryStack);
+	const hxRadixSortMemberKey<Record, int32_t> byKey(&Record::key);
+	const uint32_t sizes[] = { 0u, 1u, 20u, 10000u };
+	for (uint32_t s = 0u; s < sizeof sizes / sizeof *sizes; ++s) {
+		const uint32_t size = sizes[s];
+		hxArray<Record> a;
+		a.resize(size);
+		for (uint32_t i = 0u; i < size; ++i) {
+			a[i].key = (int32_t)(m_prng() & 0xffu) - 0x80;
+			a[i].weight = (float)(m_prng() & 0xffu) * -0.5f;
+			a[i].order = i;
+		}
+
+		// By a data member and then by a function object.
+		hxArray<Record> b(a);
+		hxRadixSortRecords(b.begin(), b.end(), &Record::key, hxMemoryManagerId_TemporaryStack);
+		for (uint32_t i = 1u; i < size; ++i) {
+			ASSERT_TRUE(isStable(b.data(), i - 1u, i, byKey));
+		}
+		for (uint32_t i = 0u; i < size; ++i) {
+			b[i].order = i;
+		}
+		hxRadixSortRecords(b.begin(), b.end(), RecordWeight(), hxMemoryManagerId_TemporaryStack);
+		for (uint32_t i = 1u; i < size; ++i) {
+			ASSERT_TRUE(isStable(b.data(), i - 1u, i, RecordWeight()));
+		}
+
+		// Indices of two thirds of the records, leaving the records in place.
+		hxArray<uint32_t> indices;
+		indices.reserve(size);
+		for (uint32_t i = 0u; i < size; ++i) {
+			if (i % 3u != 0u) {
+				indices.push_back(i);
+			}
+		}
+		hxRadixSortIndices(a.data(), indices.begin(), indices.end(), &Record::key, hxMemoryManagerId_TemporaryStack);
+		for (uint32_t i = 1u; i < indices.size(); ++i) {
+			ASSERT_TRUE(isStable(a.data(), indices[i - 1u], indices[i], byKey));
+		}
+		hxRadixSortIndices(a.data(), indices.begin(), indices.end(), RecordWeight(), hxMemoryManagerId_TemporaryStack);
+		for (uint32_t i = 1u; i < indices.size(); ++i) {
+			ASSERT_TRUE(a[indices[i - 1u]].weight <= a[indices[i]].weight);
+		}
+		for (uint32_t i = 0u; i < size; ++i) {
+			ASSERT_EQ(a[i].order, i);
+		}
+	}
+}
+
 static int hxSortCompareTest(const int a, const int b) {
 	return a < b;
 }
 
+static int hxSortCompareGreaterTest(const int a, const int b) {
+	return a > b;
+}
+
 TEST(hxInsertionSortTest, SortCompareCCase) {
 	int ints[3] = { 2, 1, 0 };
 
@@ -144,3 +362,313 @@ TEST(hxInsertionSortTest, SortCompareCCase) {
 	const int ints3[3] = { 0, 1, 2 };
 	ASSERT_TRUE(::memcmp(ints, ints3, sizeof ints) == 0); // sorted
 }
+
+// ----------------------------------------------------------------------------
+
+class hxComparisonSortTest :
+	public testing::Test
+{
+public:
+	enum Pattern {
+		PatternRandom,
+		PatternSorted,
+		PatternReversed,
+		PatternEqual,
+		PatternFewUnique,
+		PatternOrganPipe,
+		PatternSawtooth,
+		PatternCount
+	};
+
+	struct TestObject {
+		bool operator<(const TestObject& rhs) const { return key < rhs.key; }
+		uint32_t key;
+		uint32_t index;
+	};
+
+	void generate(TestObject* a, uint32_t size, Pattern pattern) {
+		for (uint32_t i = 0u; i < size; ++i) {
+			uint32_t x = m_prng();
+			switch (pattern) {
+			case PatternSorted: x = i; break;
+			case PatternReversed: x = size - i; break;
+			case PatternEqual: x = 7u; break;
+			case PatternFewUnique: x &= 7u; break;
+			case PatternOrganPipe: x = (i < size / 2u) ? i : size - i; break;
+			case PatternSawtooth: x = i % 64u; break;
+			default: break;
+			}
+			a[i].key = x;
+			a[i].index = i;
+		}
+	}
+
+	static int qSortCompare(const void* a, const void* b) {
+		const TestObject& x = *(const TestObject*)a;
+		const TestObject& y = *(const TestObject*)b;
+		// Stable with respect to index.
+		if (x.key != y.key) { return x.key < y.key ? -1 : 1; }
+		return x.index < y.index ? -1 : (y.index < x.index ? 1 : 0);
+	}
+
+	// Sorts every pattern with each algorithm.  Only hxMergeSort is expected to
+	// preserve index order.
+	void test(uint32_t size) {
+		hxMemoryManagerScope temporaryStack(hxMemoryManagerId_TemporaryStack);
+		TestObject* a = (TestObject*)hxMalloc(size * sizeof(TestObject) + 1u);
+		TestObject* b = (TestObject*)hxMalloc(size * sizeof(TestObject) + 1u);
+		TestObject* c = (TestObject*)hxMalloc(size * sizeof(TestObject) + 1u);
+		for (int pattern = 0; pattern < PatternCount; ++pattern) {
+			generate(c, size, (Pattern)pattern);
+			::memcpy(b, c, size * sizeof(TestObject));
+			::qsort(b, size, sizeof(TestObject), qSortCompare);
+
+			::memcpy(a, c, size * sizeof(TestObject));
+			hxSort(a, a + size);
+			for (uint32_t i = 0u; i < size; ++i) {
+				ASSERT_EQ(a[i].key, b[i].key);
+			}
+
+			::memcpy(a, c, size * sizeof(TestObject));
+			hxHeapSort(a, a + size, hxLess());
+			for (uint32_t i = 0u; i < size; ++i) {
+				ASSERT_EQ(a[i].key, b[i].key);
+			}
+
+			::memcpy(a, c, size * sizeof(TestObject));
+			hxMergeSort(a, a + size, hxMemoryManagerId_TemporaryStack);
+			ASSERT_TRUE(::memcmp(a, b, size * sizeof(TestObject)) == 0);
+		}
+		hxFree(c);
+		hxFree(b);
+		hxFree(a);
+	}
+
+	hxTestRandom m_prng;
+};
+
+TEST_F(hxComparisonSortTest, Small) {
+	for (uint32_t size = 0u; size < 2u * HX_SORT_MIN_SIZE; ++size) {
+		test(size);
+	}
+}
+
+TEST_F(hxComparisonSortTest, Large) {
+	test(1000u);
+	test(10000u);
+}
+
+TEST_F(hxComparisonSortTest, Select) {
+	hxMemoryManagerScope temporaryStack(hxMemoryManagerId_TemporaryStack);
+	const uint32_t sizes[] = { 0u, 1u, 2u, 20u, 100u, 1000u, 10000u };
+	for (uint32_t s = 0u; s < sizeof sizes / sizeof *sizes; ++s) {
+		const uint32_t size = sizes[s];
+		TestObject* a = (TestObject*)hxMalloc(size * sizeof(TestObject) + 1u);
+		TestObject* b = (TestObject*)hxMalloc(size * sizeof(TestObject) + 1u);
+		TestObject* c = (TestObject*)hxMalloc(size * sizeof(TestObject) + 1u);
+		for (int pattern = 0; pattern < PatternCount; ++pattern) {
+			generate(c, size, (Pattern)pattern);
+			::memcpy(b, c, size * sizeof(TestObject));
+			::qsort(b, size, sizeof(TestObject), qSortCompare);
+
+			const uint32_t nths[] = { 0u, size / 3u, size / 2u, size - (size != 0u) };
+			for (uint32_t n = 0u; n < sizeof nths / sizeof *nths; ++n) {
+				const uint32_t nth = nths[n];
+				::memcpy(a, c, size * sizeof(TestObject));
+				hxNthElement(a, a + nth, a + size);
+				for (uint32_t i = 0u; i < size; ++i) {
+					ASSERT_TRUE(i < nth ? !(a[nth] < a[i]) : !(a[i] < a[nth]));
+				}
+				if (nth < size) {
+					ASSERT_EQ(a[nth].key, b[nth].key);
+				}
+
+				::memcpy(a, c, size * sizeof(TestObject));
+				hxPartialSort(a, a + nth, a + size);
+				for (uint32_t i = 0u; i < nth; ++i) {
+					ASSERT_EQ(a[i].key, b[i].key);
+				}
+
+				// Smallest and largest nth keys.
+				hxTopK<uint32_t> smallest(nth);
+				hxTopK<uint32_t, hxGreater> largest(nth);
+				for (uint32_t i = 0u; i < size; ++i) {
+					smallest.push(c[i].key);
+					largest.push(c[i].key);
+				}
+				ASSERT_EQ(smallest.size(), nth);
+				smallest.sort();
+				largest.sort();
+				for (uint32_t i = 0u; i < nth; ++i) {
+					ASSERT_EQ(smallest.begin()[i], b[i].key);
+					ASSERT_EQ(largest.begin()[i], b[size - 1u - i].key);
+				}
+			}
+		}
+		hxFree(c);
+		hxFree(b);
+		hxFree(a);
+	}
+
+	// Fixed capacity.
+	hxTopK<int, hxLess, 3u> top(3u);
+	const int ints[] = { 5, 1, 4, 2, 3, 0 };
+	top.push(ints, ints + 6);
+	ASSERT_EQ(top.top(), 2);
+	top.clear();
+	ASSERT_TRUE(top.empty());
+}
+
+TEST_F(hxComparisonSortTest, Merge) {
+	hxMemoryManagerScope heap(hxMemoryManagerId_Heap);
+	const uint32_t counts[] = { 0u, 1u, 2u, 3u, 5u, 16u };
+	for (uint32_t n = 0u; n < sizeof counts / sizeof *counts; ++n) {
+		const uint32_t count = counts[n];
+		for (int pattern = 0; pattern < PatternCount; ++pattern) {
+			// Sorted runs with increasing indices.  The second run is empty.
+			hxArray<TestObject> runs[16];
+			hxArray<TestObject> expected;
+			expected.reserve(count * 400u);
+			uint32_t index = 0u;
+			for (uint32_t r = 0u; r < count; ++r) {
+				uint32_t size = r == 1u ? 0u : 50u + m_prng() % 350u;
+				runs[r].resize(size);
+				generate(runs[r].data(), size, (Pattern)pattern);
+				for (uint32_t i = 0u; i < size; ++i) {
+					runs[r][i].index = index++;
+					expected.push_back(runs[r][i]);
+				}
+				hxMergeSort(runs[r].begin(), runs[r].end(), hxMemoryManagerId_TemporaryStack);
+			}
+			hxArray<TestObject> merged;
+			merged.reserve(index);
+			hxMergeArrays(runs, count, merged, hxMemoryManagerId_TemporaryStack);
+			ASSERT_EQ(merged.size(), index);
+			if (index != 0u) {
+				// Empty arrays have no storage to pass to qsort or memcmp.
+				::qsort(expected.data(), expected.size(), sizeof(TestObject), qSortCompare);
+				ASSERT_TRUE(::memcmp(merged.data(), expected.data(), index * sizeof(TestObject)) == 0);
+			}
+		}
+	}
+
+	// Two runs that gallop through each other.
+	int a[100];
+	int b[100];
+	int c[200];
+	for (int i = 0; i < 100; ++i) {
+		a[i] = i < 50 ? i : i + 100;
+		b[i] = i + 49;
+	}
+	int* end = hxMerge(a + 0, a + 100, b + 0, b + 100, c);
+	ASSERT_EQ(end, c + 200);
+	for (int i = 1; i < 200; ++i) {
+		ASSERT_TRUE(c[i - 1] <= c[i]);
+	}
+}
+
+TEST_F(hxComparisonSortTest, Network) {
+	for (uint32_t size = 0u; size <= HX_SORT_NETWORK_MAX_SIZE; ++size) {
+		uint32_t keys[HX_SORT_NETWORK_MAX_SIZE];
+		uint32_t sorted[HX_SORT_NETWORK_MAX_SIZE];
+		uint32_t values[HX_SORT_NETWORK_MAX_SIZE];
+		float floats[HX_SORT_NETWORK_MAX_SIZE];
+		for (uint32_t i = 0u; i < size; ++i) {
+			// Include duplicates and the padding value.
+			keys[i] = (size & 1u) ? m_prng() : ((m_prng() & 15u) | (uint32_t)-(int32_t)(i & 1u));
+			sorted[i] = keys[i];
+			values[i] = i;
+			floats[i] = (float)(int32_t)(m_prng() & 0xffu) - 127.5f;
+		}
+		hxInsertionSort(sorted, sorted + size);
+
+		// Values are the original index of each key.
+		uint32_t original[HX_SORT_NETWORK_MAX_SIZE];
+		::memcpy(original, keys, size * sizeof(uint32_t));
+		hxSortNetworkKeyValues(keys, values, size);
+		for (uint32_t i = 0u; i < size; ++i) {
+			ASSERT_EQ(keys[i], sorted[i]);
+			ASSERT_EQ(original[values[i]], keys[i]);
+		}
+		hxInsertionSort(values, values + size);
+		for (uint32_t i = 0u; i < size; ++i) {
+			ASSERT_EQ(values[i], i);
+		}
+
+		::memcpy(keys, original, size * sizeof(uint32_t));
+		hxSortNetwork(keys, keys + size);
+		ASSERT_TRUE(::memcmp(keys, sorted, size * sizeof(uint32_t)) == 0);
+
+		float originalFloats[HX_SORT_NETWORK_MAX_SIZE];
+		::memcpy(originalFloats, floats, size * sizeof(float));
+		for (uint32_t i = 0u; i < size; ++i) {
+			values[i] = i;
+		}
+		hxSortNetworkKeyValues(floats, values, size);
+		for (uint32_t i = 0u; i < size; ++i) {
+			ASSERT_TRUE(i == 0u || floats[i - 1u] <= floats[i]);
+			ASSERT_EQ(originalFloats[values[i]], floats[i]);
+		}
+
+		::memcpy(floats, originalFloats, size * sizeof(float));
+		hxSortNetwork(floats, floats + size);
+		for (uint32_t i = 1u; i < size; ++i) {
+			ASSERT_TRUE(floats[i - 1u] <= floats[i]);
+		}
+	}
+
+	// Signed zeros are ordered and infinities are kept.
+	float floats[4] = { 0.0f, -0.0f, 1.0e+38f * 10.0f, -1.0e+38f * 10.0f };
+	hxSortNetwork(floats, floats + 4);
+	ASSERT_TRUE(floats[0] < -1.0e+38f && floats[3] > 1.0e+38f);
+	uint32_t zeros[2];
+	::memcpy(zeros, floats + 1, sizeof zeros);
+	ASSERT_EQ(zeros[0], 0x80000000u);
+	ASSERT_EQ(zeros[1], 0u);
+
+	// Generic version with a compare function.
+	for (uint32_t size = 0u; size < 100u; size += 7u) {
+		TestObject a[100];
+		TestObject b[100];
+		generate(a, size, PatternFewUnique);
+		::memcpy(b, a, size * sizeof(TestObject));
+		::qsort(b, size, sizeof(TestObject), qSortCompare);
+		hxSortNetwork(a, a + size, hxLess());
+		for (uint32_t i = 0u; i < size; ++i) {
+			ASSERT_EQ(a[i].key, b[i].key);
+		}
+	}
+}
+
+TEST_F(hxComparisonSortTest, Compare) {
+	// Sort descending by a function pointer.
+	int ints[100];
+	for (int i = 0; i < 100; ++i) {
+		ints[i] = (int)(m_prng() % 50u);
+	}
+	hxSort<int, int(*)(int a, int b)>(ints, ints + 100, hxSortCompareGreaterTest);
+	for (int i = 1; i < 100; ++i) {
+		ASSERT_TRUE(ints[i] <= ints[i - 1]);
+	}
+}
+
+BENCHMARK(hxSortBenchmark, RadixSortUint32) {
+	const uint32_t size = 1000u;
+	hxTestRandom prng;
+	uint32_t keys[size];
+	for (uint32_t i = 0u; i < size; ++i) {
+		keys[i] = prng();
+	}
+
+	hxRadixSort<uint32_t, uint32_t> rs;
+	rs.reserve(size);
+	benchmark.setBytesPerIteration(sizeof keys);
+	while (benchmark.keepRunning()) {
+		rs.clear();
+		for (uint32_t i = 0u; i < size; ++i) {
+			rs.insert(keys[i], keys + i);
+		}
+		rs.sort(hxMemoryManagerId_TemporaryStack);
+	}
+	ASSERT_TRUE(rs.size() == size && !(*rs.get(1) < *rs.get(0)));
+}
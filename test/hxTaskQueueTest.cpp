@@ -1,8 +1,13 @@
 // Copyright 2017-2019 Adrian Johnston
 
 #include <hx/hxTaskQueue.h>
+#include <hx/hxTaskCoroutine.h>
 #include <hx/hxTest.h>
 
+#if HX_USE_THREAD_AFFINITY && defined(__linux__)
+#include <pthread.h>
+#endif
+
 HX_REGISTER_FILENAME_HASH
 
 // ----------------------------------------------------------------------------
@@ -36,6 +41,45 @@ public:
 		int32_t m_execCount;
 		int32_t m_reenqueueCount;
 	};
+
+	// Records when it last ran and parks itself again m_reparkCount times.
+	struct ParkedTask : public hxTask {
+		ParkedTask() : m_execCount(0), m_reparkCount(0), m_executed(0u) { }
+
+		virtual void execute(hxTaskQueue* q) HX_OVERRIDE {
+			++m_execCount;
+			m_executed = hxTimeSampleTimestamp();
+			if (m_reparkCount > 0) {
+				--m_reparkCount;
+				q->enqueueAt(this, m_executed + g_hxTimeDefaultTimingCutoff);
+			}
+		}
+
+		int32_t m_execCount;
+		int32_t m_reparkCount;
+		hx_timestamp_t m_executed;
+	};
+
+#if HX_USE_THREAD_AFFINITY && defined(__linux__)
+	// Records the thread it ran on and whether that thread is pinned to m_cpu.
+	struct AffinityTask : public hxTask {
+		AffinityTask() : m_cpu(0), m_isPinned(false) { }
+
+		virtual void execute(hxTaskQueue* q) HX_OVERRIDE {
+			(void)q;
+			m_thread = std::this_thread::get_id();
+			cpu_set_t cpus;
+			CPU_ZERO(&cpus);
+			int err = ::pthread_getaffinity_np(::pthread_self(), sizeof cpus, &cpus);
+			m_isPinned = err == 0 && CPU_COUNT(&cpus) == 1 && CPU_ISSET(m_cpu, &cpus);
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+
+		std::thread::id m_thread;
+		int32_t m_cpu;
+		bool m_isPinned;
+	};
+#endif
 };
 
 // ----------------------------------------------------------------------------
@@ -188,3 +232,330 @@ TEST_F(hxTaskQueueTest, MultipleReenqueuing) {
 		}
 	}
 }
+
+TEST_F(hxTaskQueueTest, ThreadAffinity) {
+	// Pins every pool thread to CPU 0 which is always present.  Negative
+	// entries are left unpinned.
+	int32_t cpus[MAX_POOL];
+	for (int32_t i = 0; i < MAX_POOL; ++i) {
+		cpus[i] = (i & 1) ? -1 : 0;
+	}
+	for (int32_t i = 0; i <= MAX_POOL; ++i) {
+		TaskTest tasks[MAX_TASKS];
+		{
+			hxTaskQueue q(i, cpus);
+			for (int32_t k = 0; k < MAX_TASKS; ++k) {
+				tasks[k].m_reenqueueCount = k;
+				q.enqueue(&tasks[k]);
+			}
+			q.waitForAll();
+		}
+		for (int32_t k = 0; k < MAX_TASKS; ++k) {
+			ASSERT_TRUE(tasks[k].m_execCount == (k + 1));
+		}
+	}
+
+#if HX_USE_THREAD_AFFINITY && defined(__linux__)
+	// Every task run by a pool thread sees that thread pinned already.  Uses the
+	// highest CPU this thread may run on, which differs from the unpinned mask
+	// when there is more than one.
+	cpu_set_t available;
+	CPU_ZERO(&available);
+	ASSERT_EQ(::pthread_getaffinity_np(::pthread_self(), sizeof available, &available), 0);
+	int32_t cpu = CPU_SETSIZE;
+	while (cpu-- > 0 && !CPU_ISSET(cpu, &available)) { }
+	ASSERT_TRUE(cpu >= 0);
+	for (int32_t i = 0; i < MAX_POOL; ++i) {
+		cpus[i] = cpu;
+	}
+	for (int32_t i = 1; i <= MAX_POOL; ++i) {
+		AffinityTask tasks[MAX_TASKS];
+		{
+			hxTaskQueue q(i, cpus);
+			for (int32_t k = 0; k < MAX_TASKS; ++k) {
+				tasks[k].m_cpu = cpu;
+				q.enqueue(&tasks[k]);
+			}
+			// Give the pool a head start on the calling thread.
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+			q.waitForAll();
+		}
+		int32_t poolCount = 0;
+		for (int32_t k = 0; k < MAX_TASKS; ++k) {
+			if (tasks[k].m_thread != std::this_thread::get_id()) {
+				ASSERT_TRUE(tasks[k].m_isPinned);
+				++poolCount;
+			}
+		}
+		ASSERT_TRUE(poolCount > 0);
+	}
+#endif
+}
+
+TEST_F(hxTaskQueueTest, Batch) {
+	for (int32_t i = 0; i <= MAX_POOL; ++i) {
+		for (int32_t j = 0; j < MAX_TASKS; ++j) {
+			TaskTest tasks0[MAX_TASKS];
+			hxTask* batch[MAX_TASKS];
+			for (int32_t k = 0; k < j; ++k) {
+				tasks0[k].m_reenqueueCount = k;
+				batch[k] = &tasks0[k];
+			}
+			{
+				hxTaskQueue q(i);
+				q.enqueueBatch(batch, (uint32_t)j);
+				q.waitForAll();
+				for (int32_t k = 0; k < j; ++k) {
+					ASSERT_TRUE(tasks0[k].m_execCount == (k + 1));
+				}
+
+				// Batches are resubmittable and are executed by the destructor.
+				q.enqueueBatch(batch, (uint32_t)j);
+			}
+			for (int32_t k = 0; k < j; ++k) {
+				ASSERT_TRUE(tasks0[k].m_execCount == (k + 2));
+			}
+		}
+	}
+}
+
+TEST_F(hxTaskQueueTest, EnqueueAt) {
+	for (int32_t i = 0; i <= MAX_POOL; ++i) {
+		ParkedTask tasks[MAX_TASKS];
+		{
+			hxTaskQueue q(i);
+			// Parked in the reverse order of their deadlines.
+			hx_timestamp_t start = hxTimeSampleTimestamp();
+			for (int32_t k = MAX_TASKS; k--;) {
+				tasks[k].m_reparkCount = k % 3;
+				q.enqueueAt(&tasks[k], start + (hx_timestamp_t)k * g_hxTimeDefaultTimingCutoff * 10u);
+			}
+			q.waitForAll();
+			for (int32_t k = 0; k < MAX_TASKS; ++k) {
+				ASSERT_EQ(tasks[k].m_execCount, k % 3 + 1);
+				ASSERT_TRUE(tasks[k].m_executed >= start + (hx_timestamp_t)k * g_hxTimeDefaultTimingCutoff * 10u);
+			}
+
+			// Parked tasks are executed by the destructor.
+			q.enqueueAt(&tasks[0], hxTimeSampleTimestamp() + g_hxTimeDefaultTimingCutoff);
+		}
+		ASSERT_EQ(tasks[0].m_execCount, 2);
+	}
+}
+
+#if HX_PROFILE
+TEST_F(hxTaskQueueTest, Stats) {
+	for (int32_t i = 0; i <= MAX_POOL; ++i) {
+		TaskTest tasks[MAX_TASKS];
+		hxTaskQueue q(i);
+		for (int32_t j = 0; j < MAX_TASKS; ++j) {
+			tasks[j].m_reenqueueCount = 1;
+			tasks[j].setLabel((j & 1) ? "odd" : "even");
+			q.enqueue(&tasks[j]);
+		}
+		q.waitForAll();
+
+		const hxTaskQueue::Stats& stats = q.getStats();
+		ASSERT_EQ(stats.m_executed, 2u * MAX_TASKS);
+		ASSERT_TRUE(stats.m_maxDepth >= 1 && stats.m_maxDepth <= MAX_TASKS);
+
+		uint32_t waits = 0u;
+		for (int32_t j = 0; j < hxTaskQueue::StatsBuckets; ++j) {
+			waits += stats.m_waitHistogram[j];
+		}
+		ASSERT_EQ(waits, 2u * MAX_TASKS);
+
+		uint32_t labeled = 0u;
+		for (int32_t j = 0; j < HX_TASK_QUEUE_STATS_LABELS; ++j) {
+			if (stats.m_labels[j].m_label) {
+				ASSERT_EQ(stats.m_labels[j].m_count, (uint32_t)MAX_TASKS);
+				labeled += stats.m_labels[j].m_count;
+			}
+		}
+		ASSERT_EQ(labeled, 2u * MAX_TASKS);
+
+		uint32_t executed = 0u;
+		for (int32_t j = 0; j < stats.m_workerCount; ++j) {
+			executed += stats.m_workers[j].m_count;
+		}
+		ASSERT_EQ(executed, 2u * MAX_TASKS);
+
+		if (i == 1) {
+			q.logStats();
+		}
+		q.resetStats();
+		ASSERT_EQ(q.getStats().m_executed, 0u);
+	}
+}
+#endif
+
+#if HX_USE_CPP11_THREADS
+TEST_F(hxTaskQueueTest, ExternalProducers) {
+	enum { PRODUCERS = 4 };
+	struct Producer {
+		static void run(hxTaskQueue* q, TaskTest* tasks) {
+			for (int32_t k = 0; k < MAX_TASKS; ++k) {
+				tasks[k].m_reenqueueCount = k;
+				q->enqueue(&tasks[k]);
+			}
+		}
+	};
+
+	// A queue without a thread pool is not thread safe.
+	for (int32_t i = 1; i <= MAX_POOL; ++i) {
+		TaskTest tasks[PRODUCERS][MAX_TASKS];
+		{
+			hxTaskQueue q(i);
+			std::thread producers[PRODUCERS];
+			for (int32_t j = 0; j < PRODUCERS; ++j) {
+				producers[j] = std::thread(Producer::run, &q, tasks[j]);
+			}
+			for (int32_t j = 0; j < PRODUCERS; ++j) {
+				producers[j].join();
+			}
+			q.waitForAll();
+		}
+		for (int32_t j = 0; j < PRODUCERS; ++j) {
+			for (int32_t k = 0; k < MAX_TASKS; ++k) {
+				ASSERT_TRUE(tasks[j][k].m_execCount == (k + 1));
+			}
+		}
+	}
+}
+#endif
+
+#if HX_USE_NUMA
+TEST_F(hxTaskQueueTest, Nodes) {
+	// Pool threads alternate between two nodes.  Tasks enqueued to either node
+	// run and are stolen by the other node's threads as needed.
+	int32_t nodes[MAX_POOL];
+	for (int32_t i = 0; i < MAX_POOL; ++i) {
+		nodes[i] = i & 1;
+	}
+	for (int32_t i = 1; i <= MAX_POOL; ++i) {
+		int32_t nodeCount = (i > 1) ? 2 : 1;
+		TaskTest tasks[MAX_TASKS];
+		TaskTest batchTasks[MAX_TASKS];
+		hxTask* batch[MAX_TASKS];
+		{
+			hxTaskQueue q(i, hxnull, nodes);
+			for (int32_t k = 0; k < MAX_TASKS; ++k) {
+				tasks[k].m_reenqueueCount = k;
+				q.enqueue(&tasks[k], k % nodeCount);
+				batch[k] = batchTasks + k;
+			}
+			q.enqueueBatch(batch, MAX_TASKS, nodeCount - 1);
+			q.waitForAll();
+		}
+		for (int32_t k = 0; k < MAX_TASKS; ++k) {
+			ASSERT_EQ(tasks[k].m_execCount, k + 1);
+			ASSERT_EQ(batchTasks[k].m_execCount, 1);
+		}
+	}
+}
+#endif
+
+// ----------------------------------------------------------------------------
+#if HX_USE_CPP20_COROUTINES
+static hxCoroutineTask hxTaskQueueTestYielding(int32_t* counter, int32_t yields) {
+	for (int32_t i = 0; i < yields; ++i) {
+		++*counter;
+		co_await hxTaskYield();
+	}
+	++*counter;
+}
+
+struct hxTaskQueueTestPoll : public hxTaskPoll<hxTaskQueueTestPoll> {
+	explicit hxTaskQueueTestPoll(hx_timestamp_t deadline) : m_deadline(deadline) { }
+	bool isReady() const { return hxTimeSampleTimestamp() >= m_deadline; }
+	void await_resume() const { }
+
+	hx_timestamp_t m_deadline;
+};
+
+static hxCoroutineTask hxTaskQueueTestAwaiting(hxCoroutineTask* child, int32_t* counter, int32_t* result) {
+	co_await *child;
+	*result = *counter;
+
+	// Parked until the deadline and then until the condition is polled as true.
+	hx_timestamp_t deadline = hxTimeSampleTimestamp() + g_hxTimeDefaultTimingCutoff * 100u;
+	co_await hxTaskSleep(g_hxTimeDefaultTimingCutoff * 100u);
+	if (hxTimeSampleTimestamp() >= deadline) {
+		++*result;
+	}
+	co_await hxTaskQueueTestPoll(deadline + g_hxTimeDefaultTimingCutoff * 100u);
+	++*result;
+}
+
+TEST_F(hxTaskQueueTest, Coroutine) {
+	for (int32_t i = 0; i <= MAX_POOL; ++i) {
+		int32_t counter = 0;
+		int32_t result = 0;
+		{
+			hxCoroutineTask child = hxTaskQueueTestYielding(&counter, 5);
+			hxCoroutineTask parent = hxTaskQueueTestAwaiting(&child, &counter, &result);
+			hxTaskQueue q(i);
+			q.enqueue(&parent);
+			q.enqueue(&child);
+			q.waitForAll();
+			ASSERT_TRUE(child.isDone());
+			ASSERT_TRUE(parent.isDone());
+		}
+		ASSERT_EQ(counter, 6);
+		ASSERT_EQ(result, 8);
+	}
+}
+
+static hxCoroutineTask hxTaskQueueTestDma(uint8_t* dst, const uint8_t* src, uint32_t size, int32_t* result) {
+	hxDmaSyncPoint syncPoint;
+	hxDmaStart(dst, src, size, "coroutine dma");
+	hxDmaAddSyncPoint(syncPoint);
+	co_await hxTaskAwaitDma(syncPoint, "coroutine dma");
+	*result = ::memcmp(dst, src, size) == 0 ? 1 : 0;
+}
+
+TEST_F(hxTaskQueueTest, CoroutineDma) {
+	uint8_t src[256];
+	for (uint32_t i = 0u; i < sizeof src; ++i) {
+		src[i] = (uint8_t)i;
+	}
+	for (int32_t i = 0; i <= MAX_POOL; ++i) {
+		uint8_t dst[256];
+		::memset(dst, 0x00, sizeof dst);
+		int32_t result = 0;
+		{
+			hxCoroutineTask task = hxTaskQueueTestDma(dst, src, (uint32_t)sizeof src, &result);
+			hxTaskQueue q(i);
+			q.enqueue(&task);
+			q.waitForAll();
+			ASSERT_TRUE(task.isDone());
+		}
+		ASSERT_EQ(result, 1);
+	}
+	hxDmaEndFrame();
+}
+#endif // HX_USE_CPP20_COROUTINES
+
+// ----------------------------------------------------------------------------
+
+BENCHMARK(hxTaskQueueBenchmark, EnqueueBatchWait) {
+	struct CountTask : public hxTask {
+		CountTask() : m_execCount(0) { }
+		virtual void execute(hxTaskQueue* q) HX_OVERRIDE { (void)q; ++m_execCount; }
+		int32_t m_execCount;
+	};
+	const uint32_t count = 64u;
+	CountTask tasks[count];
+	hxTask* batch[count];
+	for (uint32_t i = 0u; i < count; ++i) {
+		batch[i] = tasks + i;
+	}
+
+	hxTaskQueue q;
+	while (benchmark.keepRunning()) {
+		q.enqueueBatch(batch, count);
+		q.waitForAll();
+	}
+	// Warmup iterations are not counted.
+	ASSERT_TRUE((uint32_t)tasks[count - 1u].m_execCount >= benchmark.iterations());
+}
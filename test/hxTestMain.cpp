@@ -15,10 +15,50 @@
 #include <hx/hxProfiler.h>
 #include <hx/hxSort.h>
 #include <hx/hxStockpile.h>
+#include <hx/hxTaskCoroutine.h>
 #include <hx/hxTaskQueue.h>
 
 HX_REGISTER_FILENAME_HASH
 
+// ----------------------------------------------------------------------------
+// Console commands for BENCHMARK.  Command line arguments are executed as
+// console commands before the tests are run.  E.g.:
+//
+//   hxtest "benchmarkbaseline baseline.txt" "benchmarkresults results.txt"
+
+static void hxTestBenchmarkBaselineCommand(const char* filename) {
+	hxBenchmark::setBaselineFile(filename);
+}
+hxConsoleCommandNamed(hxTestBenchmarkBaselineCommand, benchmarkbaseline);
+
+static void hxTestBenchmarkResultsCommand(const char* filename) {
+	hxBenchmark::setResultsFile(filename);
+}
+hxConsoleCommandNamed(hxTestBenchmarkResultsCommand, benchmarkresults);
+
+TEST(hxBenchmarkTest, Baseline) {
+	// A baseline that is impossible to meet is reported as a regression.
+	char previous[HX_MAX_LINE];
+	hxsnprintf(previous, HX_MAX_LINE, "%s", hxBenchmark::getBaselineFile());
+	{
+		hxFile file(hxFile::out, "hxBenchmarkTest_Baseline.txt");
+		file.print("hxBenchmarkTest.Other 1000.0\nhxBenchmarkTest.Baseline 0.000001\n");
+	}
+	ASSERT_TRUE(hxConsoleExecLine("benchmarkbaseline hxBenchmarkTest_Baseline.txt"));
+
+	hxBenchmark benchmark("hxBenchmarkTest.Baseline");
+	benchmark.setLimits(1000u, 10u);
+	while (benchmark.keepRunning()) {
+		hxFree(hxMalloc(4u));
+	}
+	ASSERT_TRUE(benchmark.iterations() >= 1u);
+	ASSERT_TRUE(benchmark.bytesAllocatedPerOp() >= 4.0);
+	hxLog("TEST_EXPECTING_WARNINGS:\n");
+	ASSERT_TRUE(!benchmark.report());
+
+	hxBenchmark::setBaselineFile(previous);
+}
+
 #if (HX_TEST_DIE_AT_THE_END) && (HX_RELEASE) < 1
 TEST(hxDeathTest, Fail) {
 	hxLog("TEST_EXPECTING_ASSERTS:\n");
@@ -32,9 +72,13 @@ TEST(hxDeathTest, NothingAsserted) {
 }
 #endif
 
-int32_t hxTestMain() {
+int32_t hxTestMain(int argc, char** argv) {
 	hxInit();
 
+	for (int i = 1; i < argc; ++i) {
+		hxConsoleExecLine(argv[i]);
+	}
+
 	hxLogConsole("hatchling platform " HATCHLING_TAG "\n");
 	hxLogConsole("release %d profile %d flags %d%d%d%d build: " __DATE__ " " __TIME__ "\n",
 		(int)(HX_RELEASE), (int)(HX_PROFILE), (int)(HX_USE_CPP11_THREADS),
@@ -59,10 +103,10 @@ int32_t hxTestMain() {
 }
 
 extern "C"
-int main() {
+int main(int argc, char** argv) {
 	::testing::InitGoogleTest();
 
-	int32_t testsFailing = hxTestMain();
+	int32_t testsFailing = hxTestMain(argc, argv);
 
 #if (HX_TEST_DIE_AT_THE_END) && (HX_RELEASE) < 1
 	hxAssertMsg(testsFailing == 2, "expected 2 tests to fail");